@@ -1,9 +1,33 @@
+// mmap, sysconf and clock_gettime, for the pools that map their memory
+// (and pread, ftruncate and flock, for the pools in files)
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
 
 #include "mem_pool.h"
 
+// The gap scan has an AVX2 version, picked at run time if the CPU has it
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define     MEM_GAP_SCAN_AVX2   1
+#include <immintrin.h>
+#else
+#define     MEM_GAP_SCAN_AVX2   0
+#endif
+
 /*************/
 /*           */
 /* Constants */
@@ -13,18 +37,119 @@
 #define     MEM_FILL_FACTOR     0.75
 #define     MEM_EXPAND_FACTOR   2
 
+#define     MEM_TLSF_FL_COUNT   64
+#define     MEM_TLSF_SL_LOG2    4
+#define     MEM_TLSF_SL_COUNT   (1 << MEM_TLSF_SL_LOG2)
+
+#define     MEM_BUDDY_ORDERS    64
+
+#define     MEM_SLAB_CLASSES    16
+#define     MEM_SLAB_OBJECTS    64
+
+// Boundary-tag blocks are multiples of MEM_TAG_ALIGN, which leaves the low
+// bits of the size for the block's state
+#define     MEM_TAG_ALIGN           ((size_t) 16)
+#define     MEM_TAG_SIZE_MASK       (~(MEM_TAG_ALIGN - 1))
+#define     MEM_TAG_ALLOCATED       ((size_t) 1)
+#define     MEM_TAG_PREV_ALLOCATED  ((size_t) 2)
+
+// ARENA and STACK allocations are aligned to at least MEM_ARENA_ALIGN, as
+// malloc's are
+#define     MEM_ARENA_ALIGN         ((size_t) 16)
+
 static const unsigned   MEM_POOL_STORE_INIT_CAPACITY    = 20;
 static const float      MEM_POOL_STORE_FILL_FACTOR      = MEM_FILL_FACTOR;
 static const unsigned   MEM_POOL_STORE_EXPAND_FACTOR    = MEM_EXPAND_FACTOR;
 
-static const unsigned   MEM_NODE_HEAP_INIT_CAPACITY     = 40;
-static const float      MEM_NODE_HEAP_FILL_FACTOR       = MEM_FILL_FACTOR;
+// The node heap is a table of chunks of MEM_NODE_CHUNK_SIZE nodes each
+static const unsigned   MEM_NODE_CHUNK_SIZE             = 256;
+static const unsigned   MEM_NODE_HEAP_INIT_CAPACITY     = 8;
 static const unsigned   MEM_NODE_HEAP_EXPAND_FACTOR     = MEM_EXPAND_FACTOR;
 
+// Null link in the node list, and the most nodes a node's index can hold
+static const unsigned   MEM_NODE_NIL                    = (unsigned) -1;
+static const unsigned   MEM_NODE_MAX                    = 1u << 30;
+
 static const unsigned   MEM_GAP_IX_INIT_CAPACITY        = 40;
 static const float      MEM_GAP_IX_FILL_FACTOR          = MEM_FILL_FACTOR;
 static const unsigned   MEM_GAP_IX_EXPAND_FACTOR        = MEM_EXPAND_FACTOR;
 
+// Null link in the gap tree (gap index positions are unsigned)
+static const unsigned   MEM_GAP_IX_NIL                  = (unsigned) -1;
+
+// Null link in the free block lists of a POOL_BOUNDARY_TAGS pool, which
+// link blocks by their offset in the pool so that the lists stay valid
+// wherever the pool memory is mapped
+static const size_t     MEM_TAG_NIL                     = (size_t) -1;
+
+// Smallest BUDDY block is 2^MEM_BUDDY_MIN_ORDER bytes
+static const unsigned   MEM_BUDDY_MIN_ORDER             = 4;
+
+// Largest request served from a slab, and the alignment (and size) of the
+// slab descriptors, which lets a record find its slab by masking its address
+static const size_t     MEM_SLAB_MAX_SIZE               = 512;
+static const size_t     MEM_SLAB_ALIGN                  = 2048;
+
+static const unsigned   MEM_SLAB_RUNS_INIT_CAPACITY     = 16;
+static const unsigned   MEM_SLAB_RUNS_EXPAND_FACTOR     = MEM_EXPAND_FACTOR;
+
+// Granularity of the page map, which finds segments by address
+static const unsigned   MEM_PAGE_SHIFT                  = 12;
+
+// A POOL_COMPACT pool keeps its offsets and sizes in 32 bits, and its list
+// links in 31 (the top bits hold the node's state), all ones being the null
+// link
+static const size_t     MEM_COMPACT_MAX_SIZE            = UINT32_MAX;
+static const unsigned   MEM_COMPACT_NIL                 = (1u << 31) - 1;
+static const unsigned   MEM_COMPACT_INIT_CAPACITY       = 64;
+static const unsigned   MEM_COMPACT_EXPAND_FACTOR       = MEM_EXPAND_FACTOR;
+
+// Alignment of the pool memory, so that BUDDY blocks, which are aligned to
+// their size within the pool, are aligned in memory too
+static const size_t     MEM_POOL_ALIGN                  = 4096;
+
+// A POOL_GROW pool reserves the address space to grow into, so that it can
+// get to MEM_POOL_GROW_LIMIT times the size it is opened with, and grow by
+// at least the minimum reserve (the maximum caps it on 32-bit systems)
+static const size_t     MEM_POOL_GROW_LIMIT             = 64;
+static const size_t     MEM_POOL_GROW_MIN_RESERVE       = (size_t) 64 << 20;
+static const size_t     MEM_POOL_GROW_MAX_RESERVE       = (sizeof(size_t) > 4) ? SIZE_MAX : (size_t) 1 << 30;
+
+// Mapped pool memory starts on a huge page boundary, for the kernel to be
+// able to back it with huge pages
+static const size_t     MEM_HUGE_PAGE_SIZE              = (size_t) 2 << 20;
+
+// Pages from the huge page pool are asked for at that size, whatever the
+// system's default huge page size is (log2 of the size, shifted into place)
+#if defined(MAP_HUGE_2MB)
+#define     MEM_MAP_HUGE_2MB    MAP_HUGE_2MB
+#elif defined(MAP_HUGE_SHIFT)
+#define     MEM_MAP_HUGE_2MB    (21 << MAP_HUGE_SHIFT)
+#endif
+
+// POOL_PREFAULT pools of more than one slice are faulted in by a thread per
+// slice (as many as there are CPUs), smaller ones by mmap where it can
+static const size_t     MEM_PREFAULT_SLICE              = (size_t) 256 << 20;
+#define     MEM_PREFAULT_MAX_THREADS    16
+
+#ifdef MAP_POPULATE
+#define     MEM_MAP_POPULATE    MAP_POPULATE
+#else
+#define     MEM_MAP_POPULATE    0
+#endif
+
+// First bytes of a pool file, and the version of the layout that follows
+static const uint64_t   MEM_POOL_FILE_MAGIC             = 0x4c4f4f504d454d44;
+static const uint32_t   MEM_POOL_FILE_VERSION           = 1;
+
+// A pool file is mapped where it was mapped before if that is free, without
+// taking over anything that is mapped there
+#ifdef MAP_FIXED_NOREPLACE
+#define     MEM_MAP_FIXED_NOREPLACE     MAP_FIXED_NOREPLACE
+#else
+#define     MEM_MAP_FIXED_NOREPLACE     0
+#endif
+
 /*********************/
 /*                   */
 /* Type declarations */
@@ -35,11 +160,27 @@ typedef struct _node {
     
     alloc_t alloc_record;
     
-    unsigned used;
+    // Neighbours in the segment list, as node heap positions
+    // (MEM_NODE_NIL at the ends)
+    unsigned next, prev;
+    
+    union {
+        
+        // Position of the node's entry in gap_ix, while it is a gap
+        unsigned gap;
+        
+        // One past the position of the slab the node is the run of in the
+        // slab cache's run table, 0 if not a run, while it is allocated
+        unsigned slab;
+        
+    };
+    
+    unsigned used : 1;
     
-    unsigned allocated;
+    unsigned allocated : 1;
     
-    struct _node *next, *prev;
+    // The node's own position in the node heap, for linking to it
+    unsigned index : 30;
     
 } node_t, *node_pt;
 
@@ -49,1115 +190,6541 @@ typedef struct _gap {
     
     node_pt node;
     
+    union {
+        
+        struct {
+            
+            // Links of the AVL gap tree, as positions in gap_ix
+            unsigned parent, left, right;
+            
+            unsigned height;
+            
+            // Largest gap in the subtree rooted here (for FIRST_FIT
+            // and NEXT_FIT)
+            size_t max_size;
+            
+        };
+        
+        struct {
+            
+            // Links of the TLSF segregated list the gap is on
+            unsigned prev_gap, next_gap;
+            
+        };
+        
+        // Start offset of the gap, which finds it in the scan arrays
+        // (POOL_GAP_SCAN)
+        size_t scan_start;
+        
+    };
+    
 } gap_t, *gap_pt;
 
-typedef struct _pool_mgr {
+typedef struct _tlsf {
     
-    pool_t pool;
+    // One bit per first-level class (power of two) with a non-empty list
+    uint64_t fl_bitmap;
     
-    node_pt node_heap;
+    // One bit per second-level subdivision with a non-empty list
+    uint32_t sl_bitmap[MEM_TLSF_FL_COUNT];
     
-    unsigned total_nodes;
+    // Heads of the segregated gap lists, as positions in gap_ix
+    unsigned heads[MEM_TLSF_FL_COUNT][MEM_TLSF_SL_COUNT];
     
-    unsigned used_nodes;
+} tlsf_t, *tlsf_pt;
+
+typedef struct _buddy {
     
-    gap_pt gap_ix;
+    // One bit per order with a non-empty list
+    uint64_t bitmap;
     
-    unsigned gap_ix_capacity;
+    // Heads of the per-order free block lists, as positions in gap_ix
+    unsigned heads[MEM_BUDDY_ORDERS];
     
-} pool_mgr_t, *pool_mgr_pt;
-
-/***************************/
-/*                         */
-/* Static global variables */
-/*                         */
-/***************************/
-
-static pool_mgr_pt *pool_store = NULL;
-
-static unsigned pool_store_size = 0;
-
-static unsigned pool_store_capacity = 0;
-
-/********************************************/
-/*                                          */
-/* Forward declarations of static functions */
-/*                                          */
-/********************************************/
-
-static alloc_status _mem_resize_pool_store();
-
-static alloc_status _mem_resize_node_heap(pool_mgr_pt pool_mgr);
-
-static alloc_status _mem_resize_gap_ix(pool_mgr_pt pool_mgr);
-
-static alloc_status _mem_add_to_gap_ix(pool_mgr_pt pool_mgr, size_t size, node_pt node);
-
-static alloc_status _mem_remove_from_gap_ix(pool_mgr_pt pool_mgr, size_t size, node_pt node);
-
-static alloc_status _mem_sort_gap_ix(pool_mgr_pt pool_mgr);
+} buddy_t, *buddy_pt;
 
-static alloc_status _remove_gap(pool_mgr_pt pool_mgr, gap_pt gap) {
+typedef struct _slab {
     
-    // find the position of the node in the gap index
-    // loop from there to the end of the array:
-    //    pull the entries (i.e. copy over) one position up
-    //    this effectively deletes the chosen node
-    
-    // Get a reference to the last gap
-    const gap_pt lastGap = &(pool_mgr->gap_ix[pool_mgr->pool.num_gaps - 1]);
+    // Neighbours on the class's list of slabs with free objects
+    struct _slab *next, *prev;
     
-    // Copy the end gap to the position of the to be deleted gap
-    *gap = *lastGap;
+    // The run the objects are carved from
+    node_pt node;
     
-    // Nothing directly links to gaps, other than the gap_ix table,
-    // so there's no cleanup work to do
+    char *mem;
     
-    // update metadata (num_gaps)
-    // Our to-be-deleted gap is now gone, decrement the used_gaps count
-    --(pool_mgr->pool.num_gaps);
+    // Object size and class
+    size_t size;
     
-    // NOTE: This does leave a copy of the last gap in the gap table,
-    // however we're now considering that gap as available space, not
-    // to be indexed, sorted and available for overriting.
+    unsigned size_class;
     
-    // zero out the element at position num_gaps!
-    // Nevertheless, let's nuke it anyway (just in case)
-    lastGap->node = NULL;
-    lastGap->size = 0;
+    // One bit per free object
+    uint64_t free_mask;
     
-    // We've altered the gap list, so let's resort it
-    return _mem_sort_gap_ix(pool_mgr);
+    // The records handed out for the objects
+    alloc_t records[MEM_SLAB_OBJECTS];
     
-}
-
-static alloc_status _remove_node(pool_mgr_pt pool_mgr, node_pt node) {
+} slab_t, *slab_pt;
 
-    // Cannot move nodes, because it breaks the alloc pointers
-    // just mark the node as not used
-    node->used = 0;
+typedef struct _slab_cache {
     
-    // Remove the node from the linked list
+    // Slabs with at least one free object, per size class
+    slab_pt partial[MEM_SLAB_CLASSES];
     
-    // Rewire the node's previous connection
-    if(node->prev != NULL) {
-        
-        // Rewire [n-1]'s next to [n+1]
-        node->prev->next = node->next;
-        
-    } else {
-        
-        // Node is the first element, set [n+1]'s previous to NULL
-        node->next->prev = NULL;
-        
-    }
+    // Every slab, so a run's node can refer to its slab by position
+    slab_pt *runs;
     
-    // Rewire the node's next connection
-    if(node->next != NULL) {
-        
-        // Rewire [n+1]'s previous to [n-1]
-        node->next->prev = node->prev;
-        
-    } else {
-        
-        // Node is the last element, set [n-1]'s next to NULL
-        node->prev->next = NULL;
-        
-    }
+    unsigned num_runs;
     
-    return ALLOC_OK;
+    unsigned runs_capacity;
     
-}
+} slab_cache_t, *slab_cache_pt;
 
-static alloc_status _add_gap(pool_mgr_pt pool_mgr, node_pt node) {
-    
-    gap_pt gap = NULL;
+typedef struct _tag {
     
-    // Look below for gaps (gap merging)
+    // Size of the block below, only valid while that block is free
+    // (it is that block's footer)
+    size_t prev_size;
     
-    // Get the ending address of this node
-    const char * nodeEndingAddress = (((char *) node->alloc_record.mem) + node->alloc_record.size);
+    // Size of the block, header included, or-ed with MEM_TAG_ALLOCATED
+    // and MEM_TAG_PREV_ALLOCATED
+    size_t size;
     
-    for(unsigned int i = 0; i < pool_mgr->pool.num_gaps; ++i) {
+    union {
         
-        // Does this gap begin where the node ends?
-        if(nodeEndingAddress == pool_mgr->gap_ix[i].node->alloc_record.mem) {
-            
-            // There's an adjacent gap above us, let's use it
-            //printf("Merging above gap.\r\n");
-            
-            // Remove the node attached to the adjacent gap
-            _remove_node(pool_mgr, pool_mgr->gap_ix[i].node);
-            
-            // Set the passed in node to gap
-            pool_mgr->gap_ix[i].node = node;
-            node->allocated = 0;
-            
-            // Expand previous gap
-            pool_mgr->gap_ix[i].size += node->alloc_record.size;
-            pool_mgr->gap_ix[i].node->alloc_record.size = pool_mgr->gap_ix[i].size;
-            
-            // Store the gap for a later return
-            gap = &(pool_mgr->gap_ix[i]);
+        // The record handed out, while the block is allocated
+        alloc_t alloc_record;
+        
+        struct {
             
-            break;
+            // Links of the segregated list the block is on, while it is
+            // free, as offsets in the pool (MEM_TAG_NIL if none)
+            size_t prev_free, next_free;
             
-        }
+        };
         
-    }
+    };
     
-    // Look above for gaps (gap merging)
+} tag_t, *tag_pt;
+
+typedef struct _tag_index {
     
-    for(unsigned int i = 0; i < pool_mgr->pool.num_gaps; ++i) {
-        
-        // Get the ending address of this gap
-        const char * gapEndingAddress = (((char *) pool_mgr->gap_ix[i].node->alloc_record.mem) + pool_mgr->gap_ix[i].node->alloc_record.size);
-        
-        // Does this gap begin where the node ends?
-        if(node->alloc_record.mem == gapEndingAddress) {
-            
-            // There's an adjacent gap below us, let's use it
-            //printf("Merging below gap.\r\n");
-            
-            // Remove the node passed in
-            _remove_node(pool_mgr, node);
-            
-            // Set the passed in node to gap
-            node->allocated = 0;
-            
-            // Expand previous gap
-            pool_mgr->gap_ix[i].size += node->alloc_record.size;
-            pool_mgr->gap_ix[i].node->alloc_record.size = pool_mgr->gap_ix[i].size;
-            pool_mgr->gap_ix[i].node->allocated = 0;
-            
-            
-            
-            if(gap != NULL) {
-                
-                _remove_gap(pool_mgr, gap);
-                
-                return ALLOC_OK;
-                
-            }
-            
-            // Store the gap for a later return
-            gap = &(pool_mgr->gap_ix[i]);
-            
-            break;
-            
-        }
-        
-    }
+    // Same two-level classes as tlsf_t, the lists link the blocks themselves
+    uint64_t fl_bitmap;
     
-    if(gap != NULL) {
-        return ALLOC_OK;
-    }
+    uint32_t sl_bitmap[MEM_TLSF_FL_COUNT];
     
-    // No gap to merge, create a new one
+    size_t heads[MEM_TLSF_FL_COUNT][MEM_TLSF_SL_COUNT];
     
-    // expand the gap index, if necessary (call the function)
-    // Do we need to grab more space?
-    if(_mem_resize_gap_ix(pool_mgr) != ALLOC_OK) {
-        
-        // Return ALLOC_FAIL on failure to resize
-        return ALLOC_FAIL;
-        
-    }
+    // Offset of the end of the last block
+    size_t end;
     
-    // add the entry at the end
-    // Increment used_gaps
-    ++(pool_mgr->pool.num_gaps);
+} tag_index_t, *tag_index_pt;
+
+typedef struct _pool_file {
     
-    // Get a reference to the new gap we just "created"
-    const gap_pt newGap = &(pool_mgr->gap_ix[pool_mgr->pool.num_gaps - 1]);
+    // MEM_POOL_FILE_MAGIC, written last when the file is set up
+    uint64_t magic;
     
-    // update metadata (num_gaps)
-    // Setup the new gap
-    newGap->size = node->alloc_record.size;
-    newGap->node = node;
-    node->allocated = 0;
+    uint32_t version;
     
-    // We've altered the gap list, so let's resort it
+    uint32_t policy;
     
-    // sort the gap index (call the function)
-    // check success
-    return _mem_sort_gap_ix(pool_mgr);
+    // Size of this header, the pool memory starts on the next MEM_POOL_ALIGN
+    // boundary after it
+    size_t header_size;
     
-}
-
-static node_pt _add_node(pool_mgr_pt pool_mgr, node_pt precedingNode) {
+    size_t total_size;
     
-    // Do we need to grab more space?
-    if(_mem_resize_node_heap(pool_mgr) != ALLOC_OK) {
-        
-        // Return NULL on failure to resize
-        return NULL;
-        
-    }
+    // Where the file was mapped when it was last open, it is mapped there
+    // again if it can be
+    uintptr_t base;
     
-    // Increment used_nodes
-    ++(pool_mgr->used_nodes);
+    // The pool's counters, as of the last close
+    size_t alloc_size;
     
-    // Get a reference to the new node we just "created"
-    const node_pt newNode = &(pool_mgr->node_heap[pool_mgr->used_nodes - 1]);
+    unsigned num_allocs;
     
-    // There's a chance this node's memory came from a realloc and contains
-    // garbage, let's nuke it (just in case)
+    unsigned num_gaps;
     
-    newNode->next = NULL;
-    newNode->prev = NULL;
-    newNode->allocated = 0;
-    newNode->alloc_record.mem = NULL;
-    newNode->alloc_record.size = 0;
+    // Set while the file is open, so that a file that was never closed has
+    // its counters recounted
+    unsigned in_use;
     
-    // Is this the first node to be added to the heap?
-    if(pool_mgr->used_nodes == 1) {
-        
-        // It is, special case, next and prev are already NULL, just return it
-        
-        return newNode;
-        
-    }
+    // Offset of the memory of the allocation set with mem_pool_set_root
+    // (MEM_TAG_NIL if none)
+    size_t root;
     
-    // More than one node exists in the list
-    if(precedingNode) {
-        
-        // Wire the new node's prev to the end node
-        newNode->prev = precedingNode;
-        
-        // Is there a node after the preceding node?
-        if (precedingNode->next) {
-            
-            // Wire the new node's next to the later node
-            newNode->next = precedingNode->next;
-            
-        } else {
-            
-            // Wire the new node's next to NULL
-            newNode->next = NULL;
-            
-        }
-        
-        // Wire the end node's next to the new node
-        precedingNode->next = newNode;
-        
-    } else {
-        
-        // Find the last node in the linked list by parsing it to the end
-        node_pt endNode = pool_mgr->node_heap;
-        
-        while(endNode->next != NULL) {
-            
-            // Just keep swimming...
-            endNode = endNode->next;
-            
-        }
-        
-        // Wire the end node's next to the new node
-        endNode->next = newNode;
-        
-        // Wire the new node's prev to the end node
-        newNode->prev = endNode;
-        
-    }
+    // The free block lists, which link blocks by offset
+    tag_index_t tags;
     
-    return newNode;
+} pool_file_t, *pool_file_pt;
+
+typedef struct _arena_block {
     
-}
+    // The record handed out, its mem is NULL once it has been deallocated
+    alloc_t alloc_record;
+    
+    // The block placed before this one, NULL for the first
+    struct _arena_block *prev;
+    
+} arena_block_t, *arena_block_pt;
 
-node_pt _convert_gap_to_node_and_gap(pool_mgr_pt pool_mgr, gap_pt gap, size_t size) {
+typedef struct _prefault_slice {
     
-    //printf("Before Node\t%p\r\n", node->alloc_record.mem);
-    //printf("Before Gap\t%p\r\n", gap->node->alloc_record.mem);
+    // The pages from mem to end, written to one per page
+    char *mem;
+    char *end;
     
-    // What about the case where the gap is just large enough?
-    if(gap->size == size) {
-        
-        // Special case, the new node exactly fits the provided space
-        const node_pt node = gap->node;
-        
-        node->allocated = 1;
-        
-        // Remove the associated gap
-        _remove_gap(pool_mgr, gap);
-        
-        // Return the node
-        return node;
-        
-    }
+    size_t page_size;
     
-    // Use the existing node for allocated space
-    const node_pt allocatedNode = gap->node;
+} prefault_slice_t, *prefault_slice_pt;
+
+typedef struct _arena {
     
-    // Setup allocatedNode
-    allocatedNode->allocated = 1;
-    allocatedNode->used = 1;
-    allocatedNode->alloc_record.size = size;
+    // Where the free space above the blocks starts
+    char *top;
     
-    // Generate a new node to represent the gap
-    gap->node = _add_node(pool_mgr, allocatedNode);
+    // The block placed last, NULL if none
+    arena_block_pt last;
     
-    // Calculate new gap/node size
-    gap->size = gap->node->alloc_record.size = gap->size - size;
+} arena_t, *arena_pt;
+
+typedef struct _compact_node {
     
-    // Point the new (gap) node at the correct starting memory
-    gap->node->alloc_record.mem = ((char *) allocatedNode->alloc_record.mem) + size;
+    // Start of the segment, as an offset in the pool, and its size
+    uint32_t offset, size;
     
-    // Setup gap->node
-    gap->node->allocated = 0;
-    gap->node->used = 1;
+    // Neighbours in the segment list, as positions in the node array
+    // (MEM_COMPACT_NIL at the ends), with the node's state in the top bits
+    unsigned next : 31;
     
-    return allocatedNode;
+    unsigned allocated : 1;
     
-}
-
-/****************************************/
-/*                                      */
-/* Definitions of user-facing functions */
-/*                                      */
-/****************************************/
+    unsigned prev : 31;
+    
+    unsigned used : 1;
+    
+} compact_node_t, *compact_node_pt;
 
-alloc_status mem_init() {
+typedef struct _compact {
     
-    // Ensure that it's called only once until mem_free
+    // The nodes, in one array. No record points into them, so the array
+    // is moved when it grows.
+    compact_node_pt nodes;
+    
+    unsigned capacity;
+    
+    // Nodes taken from the array so far, the dead ones among them are
+    // chained through next and recycled first (MEM_COMPACT_NIL if none)
+    unsigned used_nodes;
+    
+    unsigned free_nodes;
+    
+    // Lowest addressed node starting in each page of the pool,
+    // MEM_COMPACT_NIL if none
+    uint32_t *page_map;
+    
+} compact_t, *compact_pt;
+
+typedef struct _pool_mgr {
+    
+    pool_t pool;
+    
+    // Chunks of nodes. Chunks are added as the heap grows, but never
+    // moved, so the nodes (and the allocation records) stay put.
+    node_pt *node_heap;
+    
+    unsigned node_chunks;
+    
+    unsigned node_chunks_capacity;
+    
+    unsigned total_nodes;
+    
+    unsigned used_nodes;
+    
+    // Dead nodes below used_nodes, chained through next and recycled
+    // before the heap grows (MEM_NODE_NIL if none)
+    unsigned free_nodes;
+    
+    gap_pt gap_ix;
+    
+    unsigned gap_ix_capacity;
+    
+    // Size, start offset and gap_ix position of every gap, in address
+    // order, used instead of the tree by POOL_GAP_SCAN pools (NULL otherwise)
+    size_t *gap_sizes;
+    
+    size_t *gap_starts;
+    
+    unsigned *gap_slots;
+    
+    // Root of the gap tree, keyed by (size, address) for BEST_FIT
+    // and by address for FIRST_FIT and NEXT_FIT
+    unsigned gap_ix_root;
+    
+    // Where the last NEXT_FIT allocation ended, the next search starts there
+    char *cursor;
+    
+    // Segregated gap lists, used instead of the tree by TLSF pools
+    tlsf_pt tlsf;
+    
+    // Free block lists, used instead of the tree by BUDDY pools
+    buddy_pt buddy;
+    
+    // Size-class slabs for small requests (POOL_SLAB pools only)
+    slab_cache_pt slabs;
+    
+    // Lowest addressed node starting in each page of the pool, NULL if none
+    node_pt *page_map;
+    
+    // Free block lists of a POOL_BOUNDARY_TAGS pool, which has no node heap,
+    // gap index or page map
+    tag_index_pt tags;
+    
+    // Header of the file a file-backed pool is mapped from, which holds the
+    // block lists (NULL for other pools)
+    pool_file_pt file;
+    
+    // The file a file-backed pool is mapped from, open and locked until the
+    // pool is closed, so that no other pool can open it meanwhile
+    int file_fd;
+    
+    // Top of an ARENA or STACK pool, which has no node heap, gap index or
+    // page map
+    arena_pt arena;
+    
+    // Nodes of a POOL_COMPACT pool, which has no node heap or gap index,
+    // and a page map of its own
+    compact_pt compact;
+    
+    // Address space reserved for the pool memory of a POOL_GROW pool, which
+    // is made accessible as the pool grows (0 for other pools)
+    size_t reserved;
+    
+    // Length of the mapping the pool memory is, 0 if it was allocated
+    size_t mapped;
+    
+    // Size of the pages behind the pool memory
+    size_t page_size;
+    
+    // How long it took to fault in the pages of a POOL_PREFAULT pool
+    double prefault_ms;
+    
+} pool_mgr_t, *pool_mgr_pt;
+
+/***************************/
+/*                         */
+/* Static global variables */
+/*                         */
+/***************************/
+
+static pool_mgr_pt *pool_store = NULL;
+
+static unsigned pool_store_size = 0;
+
+static unsigned pool_store_capacity = 0;
+
+// Gap scans, as picked by _gap_scan_select
+static unsigned (*_gap_scan_first_fit)(const size_t *sizes, unsigned num_gaps, size_t size);
+
+static unsigned (*_gap_scan_best_fit)(const size_t *sizes, unsigned num_gaps, size_t size);
+
+/********************************************/
+/*                                          */
+/* Forward declarations of static functions */
+/*                                          */
+/********************************************/
+
+static alloc_status _mem_resize_pool_store();
+
+static void _mem_clear_lists(pool_mgr_pt pool_mgr);
+
+static alloc_status _mem_check_flags(size_t size, alloc_policy policy, unsigned flags);
+
+static char *_mem_alloc_pool_mem(pool_mgr_pt pool_mgr, size_t size, unsigned flags);
+
+static alloc_status _mem_free_pool_mem(pool_mgr_pt pool_mgr);
+
+static pool_file_pt _mem_map_pool_file(pool_mgr_pt pool_mgr, const char *path, size_t size, int *created);
+
+static unsigned _mem_prefault_threads(size_t size);
+
+static void *_mem_prefault_slice(void *slice);
+
+static void _mem_prefault(pool_mgr_pt pool_mgr, char *mem, size_t size);
+
+static double _mem_now_ms();
+
+static alloc_status _mem_grow(pool_mgr_pt pool_mgr, size_t size);
+
+static alloc_status _mem_grow_nodes(pool_mgr_pt pool_mgr, size_t size);
+
+static alloc_status _mem_release(pool_mgr_pt pool_mgr, const char *mem, size_t size, size_t keep);
+
+static alloc_status _mem_fill_pool(pool_mgr_pt pool_mgr);
+
+static alloc_status _mem_resize_node_heap(pool_mgr_pt pool_mgr);
+
+static node_pt _mem_node_at(pool_mgr_pt pool_mgr, unsigned index);
+
+static node_pt _mem_node_next(pool_mgr_pt pool_mgr, node_pt node);
+
+static node_pt _mem_node_prev(pool_mgr_pt pool_mgr, node_pt node);
+
+static alloc_status _mem_resize_gap_ix(pool_mgr_pt pool_mgr);
+
+static alloc_status _mem_add_to_gap_ix(pool_mgr_pt pool_mgr, size_t size, node_pt node);
+
+static alloc_status _mem_remove_from_gap_ix(pool_mgr_pt pool_mgr, size_t size, node_pt node);
+
+static alloc_status _mem_update_gap_ix(pool_mgr_pt pool_mgr, unsigned gap, size_t size, node_pt node);
+
+static unsigned _mem_find_gap_ix(pool_mgr_pt pool_mgr, size_t size, node_pt node);
+
+static unsigned _mem_find_best_fit(pool_mgr_pt pool_mgr, size_t size);
+
+static unsigned _mem_find_first_fit(pool_mgr_pt pool_mgr, size_t size);
+
+static unsigned _mem_find_next_fit(pool_mgr_pt pool_mgr, size_t size);
+
+static void _gap_scan_select();
+
+static unsigned _gap_scan_position(pool_mgr_pt pool_mgr, unsigned count, size_t offset);
+
+static unsigned _gap_scan_find(pool_mgr_pt pool_mgr, unsigned count, size_t start, unsigned slot);
+
+static void _gap_scan_insert(pool_mgr_pt pool_mgr, unsigned gap);
+
+static void _gap_scan_remove(pool_mgr_pt pool_mgr, unsigned gap);
+
+static int _gap_scan_update(pool_mgr_pt pool_mgr, unsigned gap, size_t size, node_pt node);
+
+static unsigned _mem_scan_fit(pool_mgr_pt pool_mgr, size_t size);
+
+static void _gap_tree_insert(pool_mgr_pt pool_mgr, unsigned gap);
+
+static void _gap_tree_unlink(pool_mgr_pt pool_mgr, unsigned gap);
+
+static void _gap_tree_relocate(pool_mgr_pt pool_mgr, unsigned from, unsigned to);
+
+static unsigned _mem_find_good_fit(pool_mgr_pt pool_mgr, size_t size);
+
+static void _tlsf_insert(pool_mgr_pt pool_mgr, unsigned gap);
+
+static void _tlsf_unlink(pool_mgr_pt pool_mgr, unsigned gap);
+
+static void _tlsf_relocate(pool_mgr_pt pool_mgr, unsigned to);
+
+static size_t _buddy_block_size(size_t size);
+
+static void _buddy_insert(pool_mgr_pt pool_mgr, unsigned gap);
+
+static void _buddy_unlink(pool_mgr_pt pool_mgr, unsigned gap);
+
+static void _buddy_relocate(pool_mgr_pt pool_mgr, unsigned to);
+
+static alloc_status _buddy_free(pool_mgr_pt pool_mgr, node_pt node);
+
+static unsigned _mem_log2(size_t size);
+
+static node_pt _mem_alloc_node(pool_mgr_pt pool_mgr, size_t size);
+
+static node_pt _mem_alloc_node_aligned(pool_mgr_pt pool_mgr, size_t size, size_t alignment);
+
+static alloc_status _mem_alloc_node_batch(pool_mgr_pt pool_mgr, const size_t *sizes, alloc_pt *out, unsigned n);
+
+static void _mem_map_node(pool_mgr_pt pool_mgr, node_pt node);
+
+static void _mem_unmap_node(pool_mgr_pt pool_mgr, node_pt node);
+
+static node_pt _mem_find_node(pool_mgr_pt pool_mgr, const char *mem);
+
+static alloc_pt _slab_alloc(pool_mgr_pt pool_mgr, size_t size);
+
+static alloc_status _slab_free(pool_mgr_pt pool_mgr, alloc_pt alloc);
+
+static void _slab_release_empty(pool_mgr_pt pool_mgr);
+
+static alloc_status _tlsf_search(uint64_t fl_bitmap, const uint32_t *sl_bitmap, size_t size, unsigned *fl, unsigned *sl);
+
+static tag_pt _tag_at(pool_mgr_pt pool_mgr, size_t offset);
+
+static size_t _tag_offset(pool_mgr_pt pool_mgr, tag_pt tag);
+
+static alloc_status _tag_open(pool_mgr_pt pool_mgr);
+
+static void _tag_reset(pool_mgr_pt pool_mgr);
+
+static void _tag_empty_lists(pool_mgr_pt pool_mgr);
+
+static alloc_status _tag_restore(pool_mgr_pt pool_mgr);
+
+static alloc_pt _tag_alloc(pool_mgr_pt pool_mgr, size_t size);
+
+static alloc_pt _tag_alloc_aligned(pool_mgr_pt pool_mgr, size_t size, size_t alignment);
+
+static alloc_pt _tag_place(pool_mgr_pt pool_mgr, tag_pt tag, size_t block, size_t size);
+
+static alloc_status _tag_alloc_batch(pool_mgr_pt pool_mgr, const size_t *sizes, alloc_pt *out, unsigned n);
+
+static alloc_status _tag_free(pool_mgr_pt pool_mgr, alloc_pt alloc);
+
+static alloc_status _tag_resize(pool_mgr_pt pool_mgr, alloc_pt alloc, size_t size);
+
+static alloc_pt _tag_find(pool_mgr_pt pool_mgr, const char *mem);
+
+static void _tag_inspect(pool_mgr_pt pool_mgr, pool_segment_pt segments, unsigned *num_segments);
+
+static alloc_status _arena_open(pool_mgr_pt pool_mgr);
+
+static void _arena_reset(pool_mgr_pt pool_mgr);
+
+static alloc_pt _arena_alloc(pool_mgr_pt pool_mgr, size_t size, size_t alignment);
+
+static void _arena_pop(pool_mgr_pt pool_mgr, arena_block_pt block);
+
+static alloc_status _arena_free(pool_mgr_pt pool_mgr, alloc_pt alloc);
+
+static alloc_status _stack_free_batch(pool_mgr_pt pool_mgr, alloc_pt *allocs, unsigned n);
+
+static alloc_status _arena_resize(pool_mgr_pt pool_mgr, alloc_pt alloc, size_t size);
+
+static alloc_pt _arena_find(pool_mgr_pt pool_mgr, const char *mem);
+
+static unsigned _arena_inspect(pool_mgr_pt pool_mgr, pool_segment_pt segments);
+
+static alloc_status _compact_open(pool_mgr_pt pool_mgr, size_t size);
+
+static void _compact_reset(pool_mgr_pt pool_mgr);
+
+static unsigned _compact_new_node(pool_mgr_pt pool_mgr);
+
+static void _compact_map(pool_mgr_pt pool_mgr, unsigned node);
+
+static void _compact_unmap(pool_mgr_pt pool_mgr, unsigned node);
+
+static void _compact_unlink(pool_mgr_pt pool_mgr, unsigned node);
+
+static char *_compact_alloc(pool_mgr_pt pool_mgr, size_t size);
+
+static unsigned _compact_find(pool_mgr_pt pool_mgr, const char *mem);
+
+static void _compact_free(pool_mgr_pt pool_mgr, unsigned node);
+
+static unsigned _compact_inspect(pool_mgr_pt pool_mgr, pool_segment_pt segments);
+
+static void _gap_ix_link(pool_mgr_pt pool_mgr, unsigned gap) {
+    
+    // Scanned gaps are only in the arrays
+    if(pool_mgr->gap_sizes) {
+        
+        _gap_scan_insert(pool_mgr, gap);
+        return;
+        
+    }
+    
+    switch(pool_mgr->pool.policy) {
+            
+        case TLSF:
+            _tlsf_insert(pool_mgr, gap);
+            break;
+            
+        case BUDDY:
+            _buddy_insert(pool_mgr, gap);
+            break;
+            
+        default:
+            _gap_tree_insert(pool_mgr, gap);
+            break;
+            
+    }
+    
+}
+
+static void _gap_ix_unlink(pool_mgr_pt pool_mgr, unsigned gap) {
+    
+    // Scanned gaps are only in the arrays
+    if(pool_mgr->gap_sizes) {
+        
+        _gap_scan_remove(pool_mgr, gap);
+        return;
+        
+    }
+    
+    switch(pool_mgr->pool.policy) {
+            
+        case TLSF:
+            _tlsf_unlink(pool_mgr, gap);
+            break;
+            
+        case BUDDY:
+            _buddy_unlink(pool_mgr, gap);
+            break;
+            
+        default:
+            _gap_tree_unlink(pool_mgr, gap);
+            break;
+            
+    }
+    
+}
+
+static void _gap_ix_relocate(pool_mgr_pt pool_mgr, unsigned from, unsigned to) {
+    
+    // Scanned gaps are only in the arrays, which keep their order
+    if(pool_mgr->gap_sizes) {
+        
+        const unsigned position = _gap_scan_find(pool_mgr, pool_mgr->pool.num_gaps - 1, pool_mgr->gap_ix[to].scan_start, from);
+        
+        pool_mgr->gap_slots[position] = to;
+        return;
+        
+    }
+    
+    switch(pool_mgr->pool.policy) {
+            
+        case TLSF:
+            _tlsf_relocate(pool_mgr, to);
+            break;
+            
+        case BUDDY:
+            _buddy_relocate(pool_mgr, to);
+            break;
+            
+        default:
+            _gap_tree_relocate(pool_mgr, from, to);
+            break;
+            
+    }
+    
+}
+
+static alloc_status _remove_gap(pool_mgr_pt pool_mgr, unsigned gap) {
+    
+    // Take the gap out of the index first, its position is about to be reused
+    _gap_ix_unlink(pool_mgr, gap);
+    
+    // Get the position of the last gap
+    const unsigned lastGap = pool_mgr->pool.num_gaps - 1;
+    
+    // Copy the end gap to the position of the to be deleted gap
+    if(gap != lastGap) {
+        
+        pool_mgr->gap_ix[gap] = pool_mgr->gap_ix[lastGap];
+        pool_mgr->gap_ix[gap].node->gap = gap;
+        
+        // The moved gap kept its links, but whoever pointed at lastGap
+        // has to point at its new position now
+        _gap_ix_relocate(pool_mgr, lastGap, gap);
+        
+    }
+    
+    // update metadata (num_gaps)
+    // Our to-be-deleted gap is now gone, decrement the used_gaps count
+    --(pool_mgr->pool.num_gaps);
+    
+    // zero out the element at position num_gaps!
+    pool_mgr->gap_ix[lastGap].node = NULL;
+    pool_mgr->gap_ix[lastGap].size = 0;
+    
+    return ALLOC_OK;
+    
+}
+
+static alloc_status _remove_node(pool_mgr_pt pool_mgr, node_pt node) {
+
+    // Cannot move nodes, because it breaks the alloc pointers
+    // just mark the node as not used
+    node->used = 0;
+    
+    // Its segment start is gone, while its next link is still good
+    _mem_unmap_node(pool_mgr, node);
+    
+    // Remove the node from the linked list
+    const node_pt prev = _mem_node_prev(pool_mgr, node);
+    const node_pt next = _mem_node_next(pool_mgr, node);
+    
+    // Rewire the node's previous connection
+    if(prev != NULL) {
+        
+        // Rewire [n-1]'s next to [n+1]
+        prev->next = node->next;
+        
+    } else {
+        
+        // Node is the first element, set [n+1]'s previous to nil
+        next->prev = MEM_NODE_NIL;
+        
+    }
+    
+    // Rewire the node's next connection
+    if(next != NULL) {
+        
+        // Rewire [n+1]'s previous to [n-1]
+        next->prev = node->prev;
+        
+    } else {
+        
+        // Node is the last element, set [n-1]'s next to nil
+        prev->next = MEM_NODE_NIL;
+        
+    }
+    
+    // Put the node on the dead list, for _add_node to reuse
+    node->next = pool_mgr->free_nodes;
+    pool_mgr->free_nodes = node->index;
+    
+    return ALLOC_OK;
+    
+}
+
+static alloc_status _coalesce_gap(pool_mgr_pt pool_mgr, node_pt node) {
+    
+    // The list is in address order, so the only gaps this one can merge
+    // with are its immediate neighbours
+    const node_pt prev = _mem_node_prev(pool_mgr, node);
+    const node_pt next = _mem_node_next(pool_mgr, node);
+    
+    node->allocated = 0;
+    
+    if(prev != NULL && prev->allocated == 0) {
+        
+        // Grow the gap below over this node (and the gap above, if any)
+        size_t size = prev->alloc_record.size + node->alloc_record.size;
+        
+        if(next != NULL && next->allocated == 0) {
+            
+            size += next->alloc_record.size;
+            
+            _remove_gap(pool_mgr, next->gap);
+            _remove_node(pool_mgr, next);
+            
+        }
+        
+        _remove_node(pool_mgr, node);
+        
+        prev->alloc_record.size = size;
+        
+        return _mem_update_gap_ix(pool_mgr, prev->gap, size, prev);
+        
+    }
+    
+    if(next != NULL && next->allocated == 0) {
+        
+        // Take over the gap above, which now starts at this node
+        const unsigned gap = next->gap;
+        
+        node->alloc_record.size += next->alloc_record.size;
+        
+        _remove_node(pool_mgr, next);
+        
+        return _mem_update_gap_ix(pool_mgr, gap, node->alloc_record.size, node);
+        
+    }
+    
+    // No gap to merge, create a new one
+    return _mem_add_to_gap_ix(pool_mgr, node->alloc_record.size, node);
+    
+}
+
+static alloc_status _add_gap(pool_mgr_pt pool_mgr, node_pt node) {
+    
+    // BUDDY only ever merges a block with its buddy
+    if(pool_mgr->pool.policy == BUDDY) {
+        return _buddy_free(pool_mgr, node);
+    }
+    
+    // Everything else merges with its list neighbours, in constant time
+    return _coalesce_gap(pool_mgr, node);
+    
+}
+
+static node_pt _add_node(pool_mgr_pt pool_mgr, node_pt precedingNode) {
+    
+    node_pt newNode;
+    
+    if(pool_mgr->free_nodes != MEM_NODE_NIL) {
+        
+        // Reuse a dead node, the heap stays as it is
+        newNode = _mem_node_at(pool_mgr, pool_mgr->free_nodes);
+        
+        pool_mgr->free_nodes = newNode->next;
+        
+    } else {
+        
+        // Do we need to grab more space?
+        if(_mem_resize_node_heap(pool_mgr) != ALLOC_OK) {
+            
+            // Return NULL on failure to resize
+            return NULL;
+            
+        }
+        
+        // Get a reference to the new node we just "created"
+        newNode = _mem_node_at(pool_mgr, pool_mgr->used_nodes);
+        
+        // It keeps its position for good, the links refer to it
+        newNode->index = pool_mgr->used_nodes;
+        
+        // Increment used_nodes
+        ++(pool_mgr->used_nodes);
+        
+    }
+    
+    // There's a chance this node's memory came from a realloc and contains
+    // garbage, let's nuke it (just in case)
+    
+    newNode->next = MEM_NODE_NIL;
+    newNode->prev = MEM_NODE_NIL;
+    newNode->gap = MEM_GAP_IX_NIL;
+    newNode->allocated = 0;
+    newNode->alloc_record.mem = NULL;
+    newNode->alloc_record.size = 0;
+    
+    // Is this the first node to be added to the heap?
+    if(pool_mgr->used_nodes == 1) {
+        
+        // It is, special case, next and prev are already NULL, just return it
+        
+        return newNode;
+        
+    }
+    
+    // More than one node exists in the list
+    if(precedingNode) {
+        
+        // Wire the new node's prev to the end node
+        newNode->prev = precedingNode->index;
+        
+        const node_pt laterNode = _mem_node_next(pool_mgr, precedingNode);
+        
+        // Is there a node after the preceding node?
+        if (laterNode) {
+            
+            // Wire the new node's next to the later node
+            newNode->next = laterNode->index;
+            
+            // And the later node back to the new one
+            laterNode->prev = newNode->index;
+            
+        } else {
+            
+            // Wire the new node's next to nil
+            newNode->next = MEM_NODE_NIL;
+            
+        }
+        
+        // Wire the end node's next to the new node
+        precedingNode->next = newNode->index;
+        
+    } else {
+        
+        // Find the last node in the linked list by parsing it to the end
+        node_pt endNode = _mem_node_at(pool_mgr, 0);
+        
+        while(endNode->next != MEM_NODE_NIL) {
+            
+            // Just keep swimming...
+            endNode = _mem_node_at(pool_mgr, endNode->next);
+            
+        }
+        
+        // Wire the end node's next to the new node
+        endNode->next = newNode->index;
+        
+        // Wire the new node's prev to the end node
+        newNode->prev = endNode->index;
+        
+    }
+    
+    return newNode;
+    
+}
+
+static node_pt _convert_gap_to_node_and_gap(pool_mgr_pt pool_mgr, unsigned gap, size_t size) {
+    
+    // Use the existing node for allocated space
+    const node_pt allocatedNode = pool_mgr->gap_ix[gap].node;
+    
+    // What about the case where the gap is just large enough?
+    if(pool_mgr->gap_ix[gap].size == size) {
+        
+        // Special case, the new node exactly fits the provided space
+        allocatedNode->allocated = 1;
+        
+        // Remove the associated gap
+        _remove_gap(pool_mgr, gap);
+        
+        // Return the node
+        return allocatedNode;
+        
+    }
+    
+    // Calculate new gap/node size
+    const size_t remaining = pool_mgr->gap_ix[gap].size - size;
+    
+    // Setup allocatedNode
+    allocatedNode->allocated = 1;
+    allocatedNode->used = 1;
+    allocatedNode->alloc_record.size = size;
+    
+    // Generate a new node to represent the gap
+    const node_pt gapNode = _add_node(pool_mgr, allocatedNode);
+    
+    if(gapNode == NULL) {
+        return NULL;
+    }
+    
+    // Point the new (gap) node at the correct starting memory
+    gapNode->alloc_record.mem = ((char *) allocatedNode->alloc_record.mem) + size;
+    gapNode->alloc_record.size = remaining;
+    
+    _mem_map_node(pool_mgr, gapNode);
+    
+    // Setup gapNode
+    gapNode->allocated = 0;
+    gapNode->used = 1;
+    
+    // The gap shrank and moved up, re-key it in the index
+    _mem_update_gap_ix(pool_mgr, gap, remaining, gapNode);
+    
+    return allocatedNode;
+    
+}
+
+static alloc_status _mem_resize_node(pool_mgr_pt pool_mgr, node_pt node, size_t size) {
+    
+    const size_t oldSize = node->alloc_record.size;
+    
+    // Only the segment right above can give or take the difference
+    const node_pt next = _mem_node_next(pool_mgr, node);
+    const int nextIsGap = next != NULL && next->allocated == 0;
+    
+    if(size == oldSize) {
+        return ALLOC_OK;
+    }
+    
+    if(size < oldSize) {
+        
+        const size_t freed = oldSize - size;
+        
+        if(nextIsGap) {
+            
+            // The gap above grows down over the freed tail
+            _mem_unmap_node(pool_mgr, next);
+            
+            next->alloc_record.mem -= freed;
+            next->alloc_record.size += freed;
+            
+            _mem_map_node(pool_mgr, next);
+            
+            node->alloc_record.size = size;
+            
+            return _mem_update_gap_ix(pool_mgr, next->gap, next->alloc_record.size, next);
+            
+        }
+        
+        // Make room in the gap index first, so nothing has to be undone
+        // once the tail is split off
+        if(_mem_resize_gap_ix(pool_mgr) != ALLOC_OK) {
+            return ALLOC_FAIL;
+        }
+        
+        const node_pt gapNode = _add_node(pool_mgr, node);
+        
+        if(gapNode == NULL) {
+            return ALLOC_FAIL;
+        }
+        
+        gapNode->alloc_record.mem = node->alloc_record.mem + size;
+        gapNode->alloc_record.size = freed;
+        gapNode->used = 1;
+        
+        _mem_map_node(pool_mgr, gapNode);
+        
+        node->alloc_record.size = size;
+        
+        return _mem_add_to_gap_ix(pool_mgr, freed, gapNode);
+        
+    }
+    
+    // Growing only works into a large enough gap right above
+    const size_t needed = size - oldSize;
+    
+    if(!nextIsGap || next->alloc_record.size < needed) {
+        return ALLOC_FAIL;
+    }
+    
+    if(next->alloc_record.size == needed) {
+        
+        // The gap is used up
+        _remove_gap(pool_mgr, next->gap);
+        _remove_node(pool_mgr, next);
+        
+    } else {
+        
+        // The gap shrinks and moves up
+        _mem_unmap_node(pool_mgr, next);
+        
+        next->alloc_record.mem += needed;
+        next->alloc_record.size -= needed;
+        
+        _mem_map_node(pool_mgr, next);
+        
+        _mem_update_gap_ix(pool_mgr, next->gap, next->alloc_record.size, next);
+        
+    }
+    
+    node->alloc_record.size = size;
+    
+    return ALLOC_OK;
+    
+}
+
+static node_pt _buddy_alloc(pool_mgr_pt pool_mgr, size_t size, size_t alignment) {
+    
+    // Round up to a power of two, which is also the block's alignment
+    const size_t block = _buddy_block_size(size);
+    
+    if(block == 0) {
+        return NULL;
+    }
+    
+    const unsigned order = _mem_log2(block);
+    
+    // A block of at least the alignment is aligned, and splitting it keeps
+    // the lower half, so it's where the search starts
+    const unsigned minOrder = (alignment > block) ? _mem_log2(alignment) : order;
+    
+    if(minOrder >= MEM_BUDDY_ORDERS) {
+        return NULL;
+    }
+    
+    // Smallest order with a free block that is large enough
+    const uint64_t orders = pool_mgr->buddy->bitmap & (~(uint64_t) 0 << minOrder);
+    
+    if(orders == 0) {
+        return NULL;
+    }
+    
+    unsigned current = (unsigned) __builtin_ctzll(orders);
+    
+    node_pt node = pool_mgr->gap_ix[pool_mgr->buddy->heads[current]].node;
+    
+    _remove_gap(pool_mgr, node->gap);
+    
+    // Halve the block until it is the right order, freeing the upper halves
+    while(current > order) {
+        
+        --current;
+        
+        const size_t half = (size_t) 1 << current;
+        
+        const node_pt upper = _add_node(pool_mgr, node);
+        
+        if(upper == NULL) {
+            
+            // Put back what's left of the block
+            _mem_add_to_gap_ix(pool_mgr, node->alloc_record.size, node);
+            
+            return NULL;
+            
+        }
+        
+        node->alloc_record.size = half;
+        
+        upper->alloc_record.mem = node->alloc_record.mem + half;
+        upper->alloc_record.size = half;
+        upper->allocated = 0;
+        upper->used = 1;
+        
+        _mem_map_node(pool_mgr, upper);
+        
+        _mem_add_to_gap_ix(pool_mgr, half, upper);
+        
+    }
+    
+    // The record keeps the requested size, the block size follows from it
+    node->allocated = 1;
+    node->alloc_record.size = size;
+    
+    return node;
+    
+}
+
+static alloc_status _buddy_free(pool_mgr_pt pool_mgr, node_pt node) {
+    
+    size_t block = _buddy_block_size(node->alloc_record.size);
+    
+    node->allocated = 0;
+    node->alloc_record.size = block;
+    
+    // Merge with the buddy for as long as it is free and whole. The buddy
+    // is the block at offset ^ block, which is always a list neighbour.
+    while(1) {
+        
+        const size_t offset = (size_t) (node->alloc_record.mem - pool_mgr->pool.mem);
+        
+        const node_pt buddy = (offset & block) ? _mem_node_prev(pool_mgr, node) : _mem_node_next(pool_mgr, node);
+        
+        if(buddy == NULL || buddy->allocated || buddy->alloc_record.size != block) {
+            break;
+        }
+        
+        _remove_gap(pool_mgr, buddy->gap);
+        
+        // The lower of the two carries on as the merged block
+        if(offset & block) {
+            
+            _remove_node(pool_mgr, node);
+            node = buddy;
+            
+        } else {
+            
+            _remove_node(pool_mgr, buddy);
+            
+        }
+        
+        block <<= 1;
+        node->alloc_record.size = block;
+        
+    }
+    
+    return _mem_add_to_gap_ix(pool_mgr, block, node);
+    
+}
+
+static alloc_status _buddy_carve(pool_mgr_pt pool_mgr, node_pt node) {
+    
+    // Split the pool into the largest aligned power-of-two blocks that fit,
+    // in descending order; whatever is below the smallest block is a gap
+    // that is never handed out
+    size_t remaining = node->alloc_record.size;
+    
+    node->allocated = 0;
+    
+    while(1) {
+        
+        const size_t block = (remaining >> MEM_BUDDY_MIN_ORDER) ? (size_t) 1 << _mem_log2(remaining) : remaining;
+        
+        node->alloc_record.size = block;
+        
+        if(_mem_add_to_gap_ix(pool_mgr, block, node) != ALLOC_OK) {
+            return ALLOC_FAIL;
+        }
+        
+        remaining -= block;
+        
+        if(remaining == 0) {
+            return ALLOC_OK;
+        }
+        
+        const node_pt next = _add_node(pool_mgr, node);
+        
+        if(next == NULL) {
+            return ALLOC_FAIL;
+        }
+        
+        next->alloc_record.mem = node->alloc_record.mem + block;
+        next->used = 1;
+        
+        _mem_map_node(pool_mgr, next);
+        
+        node = next;
+        
+    }
+    
+}
+
+// Carve a node of the given size out of the pool, as the policy says
+static node_pt _mem_alloc_node(pool_mgr_pt pool_mgr, size_t size) {
+    
+    // Check if any gaps, return null if none
+    if(pool_mgr->pool.num_gaps < 1) {
+        return NULL;
+    }
+    
+    // Find a block of memory from the gap table
+    node_pt newNode = NULL;
+    
+    if(pool_mgr->pool.policy == BUDDY) {
+        
+        // Split a free block down to size, no gap to carve from
+        newNode = _buddy_alloc(pool_mgr, size, 1);
+        
+    }
+    
+    // The gap to carve the allocation out of
+    unsigned gap = MEM_GAP_IX_NIL;
+    
+    if(pool_mgr->gap_sizes) {
+        
+        // POOL_GAP_SCAN pools have no tree, the gap arrays are scanned instead
+        gap = _mem_scan_fit(pool_mgr, size);
+        
+    } else if(pool_mgr->pool.policy == FIRST_FIT) {
+        
+        // The lowest addressed gap that is large enough, from the gap tree
+        gap = _mem_find_first_fit(pool_mgr, size);
+        
+    } else if(pool_mgr->pool.policy == NEXT_FIT) {
+        
+        // The lowest addressed gap that is large enough, from the cursor on
+        gap = _mem_find_next_fit(pool_mgr, size);
+        
+    } else if(pool_mgr->pool.policy == BEST_FIT) {
+        
+        // The smallest gap that is large enough, straight from the gap tree
+        gap = _mem_find_best_fit(pool_mgr, size);
+        
+    }
+    
+    if(pool_mgr->pool.policy == TLSF) {
+        
+        // A gap from the first non-empty class that is guaranteed to fit
+        gap = _mem_find_good_fit(pool_mgr, size);
+        
+    }
+    
+    if(gap != MEM_GAP_IX_NIL) {
+        
+        newNode = _convert_gap_to_node_and_gap(pool_mgr, gap, size);
+        
+    }
+    
+    // Not a slab run, unless _slab_create says so
+    if(newNode) {
+        newNode->slab = 0;
+    }
+    
+    // Move the cursor past the allocation. It's an address, not a node,
+    // so merges and splits around it can't invalidate it.
+    if(newNode && pool_mgr->pool.policy == NEXT_FIT) {
+        pool_mgr->cursor = newNode->alloc_record.mem + size;
+    }
+    
+    return newNode;
+    
+}
+
+static node_pt _mem_alloc_node_aligned(pool_mgr_pt pool_mgr, size_t size, size_t alignment) {
+    
+    // BUDDY blocks are aligned to their size, so a large enough one will do,
+    // as long as the pool memory itself is aligned that much
+    if(pool_mgr->pool.policy == BUDDY) {
+        
+        if(((uintptr_t) pool_mgr->pool.mem & (alignment - 1)) != 0) {
+            return NULL;
+        }
+        
+        const node_pt node = _buddy_alloc(pool_mgr, size, alignment);
+        
+        if(node) {
+            node->slab = 0;
+        }
+        
+        return node;
+        
+    }
+    
+    // Enough for the allocation wherever the gap starts
+    if(size > SIZE_MAX - (alignment - 1)) {
+        return NULL;
+    }
+    
+    const node_pt node = _mem_alloc_node(pool_mgr, size + alignment - 1);
+    
+    if(node == NULL) {
+        return NULL;
+    }
+    
+    const size_t padding = (size_t) (-(uintptr_t) node->alloc_record.mem & (alignment - 1));
+    
+    // The tail that isn't needed goes back to the gap above
+    if(_mem_resize_node(pool_mgr, node, padding + size) != ALLOC_OK) {
+        
+        _add_gap(pool_mgr, node);
+        
+        return NULL;
+        
+    }
+    
+    if(padding == 0) {
+        
+        if(pool_mgr->pool.policy == NEXT_FIT) {
+            pool_mgr->cursor = node->alloc_record.mem + size;
+        }
+        
+        return node;
+        
+    }
+    
+    // The padding stays with the node, which becomes a gap, and the
+    // allocation gets a new node right after it
+    const node_pt alignedNode = _add_node(pool_mgr, node);
+    
+    if(alignedNode == NULL) {
+        
+        _add_gap(pool_mgr, node);
+        
+        return NULL;
+        
+    }
+    
+    alignedNode->alloc_record.mem = node->alloc_record.mem + padding;
+    alignedNode->alloc_record.size = size;
+    alignedNode->allocated = 1;
+    alignedNode->used = 1;
+    alignedNode->slab = 0;
+    
+    _mem_map_node(pool_mgr, alignedNode);
+    
+    node->alloc_record.size = padding;
+    
+    _coalesce_gap(pool_mgr, node);
+    
+    if(pool_mgr->pool.policy == NEXT_FIT) {
+        pool_mgr->cursor = alignedNode->alloc_record.mem + size;
+    }
+    
+    return alignedNode;
+    
+}
+
+static alloc_status _mem_alloc_node_batch(pool_mgr_pt pool_mgr, const size_t *sizes, alloc_pt *out, unsigned n) {
+    
+    // Slab objects come out of their slabs, everything else is carved out
+    // of a single gap, one after the other
+    size_t total = 0;
+    
+    unsigned carved = 0;
+    
+    for(unsigned u = 0; u < n; ++u) {
+        
+        if(pool_mgr->slabs && sizes[u] <= MEM_SLAB_MAX_SIZE) {
+            continue;
+        }
+        
+        if(sizes[u] > SIZE_MAX - total) {
+            return ALLOC_FAIL;
+        }
+        
+        total += sizes[u];
+        
+        ++carved;
+        
+    }
+    
+    // One gap index update for all of them
+    node_pt carve = NULL;
+    
+    if(carved) {
+        
+        carve = _mem_alloc_node(pool_mgr, total);
+        
+        if(carve == NULL) {
+            return ALLOC_FAIL;
+        }
+        
+    }
+    
+    // Split the carve into the allocations, in order
+    node_pt last = NULL;
+    
+    unsigned u;
+    
+    for(u = 0; u < n; ++u) {
+        
+        if(pool_mgr->slabs && sizes[u] <= MEM_SLAB_MAX_SIZE) {
+            
+            out[u] = _slab_alloc(pool_mgr, sizes[u]);
+            
+            if(out[u] == NULL) {
+                break;
+            }
+            
+            continue;
+            
+        }
+        
+        if(last == NULL) {
+            
+            // The first one keeps the carve's node
+            last = carve;
+            
+            last->alloc_record.size = sizes[u];
+            
+        } else {
+            
+            const node_pt node = _add_node(pool_mgr, last);
+            
+            if(node == NULL) {
+                break;
+            }
+            
+            node->alloc_record.mem = last->alloc_record.mem + last->alloc_record.size;
+            node->alloc_record.size = sizes[u];
+            node->allocated = 1;
+            node->used = 1;
+            node->slab = 0;
+            
+            _mem_map_node(pool_mgr, node);
+            
+            last = node;
+            
+        }
+        
+        out[u] = &(last->alloc_record);
+        
+    }
+    
+    if(u == n) {
+        return ALLOC_OK;
+    }
+    
+    // Out of memory for a node or a slab, put back what was done so far
+    for(unsigned v = 0; v < u; ++v) {
+        
+        if(pool_mgr->slabs && sizes[v] <= MEM_SLAB_MAX_SIZE) {
+            
+            _slab_free(pool_mgr, out[v]);
+            
+        } else if((node_pt) out[v] != carve) {
+            
+            _remove_node(pool_mgr, (node_pt) out[v]);
+            
+        }
+        
+    }
+    
+    if(carve) {
+        
+        carve->alloc_record.size = total;
+        
+        _add_gap(pool_mgr, carve);
+        
+    }
+    
+    return ALLOC_FAIL;
+    
+}
+
+/****************************************/
+/*                                      */
+/* Definitions of user-facing functions */
+/*                                      */
+/****************************************/
+
+alloc_status mem_init() {
+    
+    // Ensure that it's called only once until mem_free
     if(pool_store != NULL) {
         
-        // Yes it has
-        return ALLOC_CALLED_AGAIN;
+        // Yes it has
+        return ALLOC_CALLED_AGAIN;
+        
+    }
+    
+    // allocate the pool store with initial capacity
+    // Create room for MEM_POOL_STORE_INIT_CAPACITY pools
+    pool_store = (pool_mgr_pt *) calloc(MEM_POOL_STORE_INIT_CAPACITY, sizeof(pool_mgr_t));
+    
+    // Did the malloc call succeed?
+    if(pool_store == NULL) {
+        
+        // Return ALLOC_FAIL on failure
+        printf("Failed to allocate necessary memory.\r\n");
+        return ALLOC_FAIL;
+        
+    }
+    
+    // Initialize the memory management system
+    // Set the size and capacity
+    pool_store_capacity = MEM_POOL_STORE_INIT_CAPACITY;
+    pool_store_size = 0;
+    
+    // Pick the gap scans this CPU can run
+    _gap_scan_select();
+    
+    // TODO ???
+    // Has the system already been initialized?
+    
+    return ALLOC_OK;
+    
+}
+
+alloc_status mem_free() {
+    
+    // ensure that it's called only once for each mem_init
+    if(pool_store == NULL) {
+        // TODO is this the right return status?
+        return ALLOC_CALLED_AGAIN;
+    }
+    
+    // make sure all pool managers have been deallocated
+    for(unsigned int i = 0; i < pool_store_size; ++i) {
+        
+        // Free each pool currently in use
+        mem_pool_close((pool_pt) pool_store[i]);
+        
+    }
+    
+    // can free the pool store array
+    // Free the pool_store
+    free(pool_store);
+    
+    // update static variables
+    pool_store = NULL;
+    pool_store_size = 0;
+    pool_store_capacity = 0;
+
+    return ALLOC_OK;
+    
+}
+
+pool_pt mem_pool_open(size_t size, alloc_policy policy) {
+    
+    return mem_pool_open_flags(size, policy, 0);
+    
+}
+
+pool_pt mem_pool_open_flags(size_t size, alloc_policy policy, unsigned flags) {
+    
+    // Make sure there the pool store is allocated
+    // Has the pool_store been initialized?
+    if(pool_store == NULL) {
+        
+        // I'm going to choose to go ahead and initialize it here
+        if(mem_init() != ALLOC_OK) {
+            return NULL;
+        }
+        
+    }
+    
+    // Turn down what can't be opened before the pool memory is taken (and
+    // maybe prefaulted)
+    if(_mem_check_flags(size, policy, flags) != ALLOC_OK) {
+        return NULL;
+    }
+    
+    // Expand the pool store, if necessary
+    // Do we need to grab more space?
+    if(_mem_resize_pool_store() != ALLOC_OK) {
+        
+        // Return NULL on failure to resize
+        return NULL;
+        
+    }
+    
+    // Allocate a new mem pool_mgr
+    // Create the pool
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) calloc(1, sizeof(pool_mgr_t));
+    
+    // Check success, on error return null
+    // Did the calloc call succeed?
+    if(pool_mgr == NULL) {
+        
+        // It didn't :(
+        return NULL;
+        
+    }
+    
+    // Initialize pool mgr
+    // Setup the public facing pool
+    pool_mgr->pool.alloc_size = 0;
+    pool_mgr->pool.total_size = size;
+    pool_mgr->pool.policy = policy;
+    pool_mgr->pool.num_gaps = 0;
+    pool_mgr->pool.num_allocs = 0;
+    
+    // Allocate a new memory pool
+    // Attempt to allocate the size requested, rounded up to the alignment
+    // (with its pages faulted in, for POOL_PREFAULT, which is timed)
+    const double start = (flags & POOL_PREFAULT) ? _mem_now_ms() : 0;
+    
+    pool_mgr->pool.mem = _mem_alloc_pool_mem(pool_mgr, size, flags);
+    
+    if(flags & POOL_PREFAULT) {
+        pool_mgr->prefault_ms = _mem_now_ms() - start;
+    }
+    
+    // check success, on error deallocate mgr and return null
+    // Did the malloc call succeed?
+    if(pool_mgr->pool.mem == NULL) {
+        
+        // It didn't :(
+        
+        free(pool_mgr);
+        
+        return NULL;
+        
+    }
+    
+    // ARENA and STACK pools only bump a pointer
+    if(policy == ARENA || policy == STACK) {
+        
+        if(_arena_open(pool_mgr) != ALLOC_OK) {
+            
+            _mem_free_pool_mem(pool_mgr);
+            free(pool_mgr);
+            
+            return NULL;
+            
+        }
+        
+        // Connect our new pool manager to the pointer table
+        pool_store[pool_store_size] = pool_mgr;
+        
+        ++pool_store_size;
+        
+        return (pool_pt) pool_mgr;
+        
+    }
+    
+    // Compact pools have an array of small nodes instead of the node heap
+    if(flags & POOL_COMPACT) {
+        
+        if(_compact_open(pool_mgr, size) != ALLOC_OK) {
+            
+            _mem_free_pool_mem(pool_mgr);
+            free(pool_mgr);
+            
+            return NULL;
+            
+        }
+        
+        // Connect our new pool manager to the pointer table
+        pool_store[pool_store_size] = pool_mgr;
+        
+        ++pool_store_size;
+        
+        return (pool_pt) pool_mgr;
+        
+    }
+    
+    // Boundary-tag pools keep the segment metadata in the pool memory
+    if(flags & POOL_BOUNDARY_TAGS) {
+        
+        if(_tag_open(pool_mgr) != ALLOC_OK) {
+            
+            _mem_free_pool_mem(pool_mgr);
+            free(pool_mgr->tags);
+            free(pool_mgr);
+            
+            return NULL;
+            
+        }
+        
+        // Connect our new pool manager to the pointer table
+        pool_store[pool_store_size] = pool_mgr;
+        
+        ++pool_store_size;
+        
+        return (pool_pt) pool_mgr;
+        
+    }
+    
+    // allocate a new node heap (the chunk table, chunks come as needed)
+    pool_mgr->node_heap = (node_pt *) calloc(MEM_NODE_HEAP_INIT_CAPACITY, sizeof(node_pt));
+    pool_mgr->node_chunks = 0;
+    pool_mgr->node_chunks_capacity = MEM_NODE_HEAP_INIT_CAPACITY;
+    pool_mgr->total_nodes = 0;
+    pool_mgr->used_nodes = 0;
+    pool_mgr->free_nodes = MEM_NODE_NIL;
+    
+    // check success, on error deallocate mgr/pool and return null
+    if(pool_mgr->node_heap == NULL) {
+        
+        // It didn't :(
+        
+        _mem_free_pool_mem(pool_mgr);
+        free(pool_mgr);
+        
+        return NULL;
+        
+    }
+    
+    // allocate a new gap index
+    pool_mgr->gap_ix = (gap_pt) calloc(MEM_GAP_IX_INIT_CAPACITY, sizeof(gap_t));
+    pool_mgr->gap_ix_capacity = MEM_GAP_IX_INIT_CAPACITY;
+    pool_mgr->gap_ix_root = MEM_GAP_IX_NIL;
+    pool_mgr->cursor = pool_mgr->pool.mem;
+    
+    // check success, on error deallocate mgr/pool/heap and return null
+    if(pool_mgr->gap_ix == NULL) {
+        
+        // It didn't :(
+        
+        _mem_free_pool_mem(pool_mgr);
+        free(pool_mgr->node_heap);
+        free(pool_mgr);
+        
+        return NULL;
+        
+    }
+    
+    // Scanned gap arrays instead of the tree, for the policies that use it
+    if(flags & POOL_GAP_SCAN) {
+        
+        pool_mgr->gap_sizes = (size_t *) calloc(MEM_GAP_IX_INIT_CAPACITY, sizeof(size_t));
+        pool_mgr->gap_starts = (size_t *) calloc(MEM_GAP_IX_INIT_CAPACITY, sizeof(size_t));
+        pool_mgr->gap_slots = (unsigned *) calloc(MEM_GAP_IX_INIT_CAPACITY, sizeof(unsigned));
+        
+        if(pool_mgr->gap_sizes == NULL || pool_mgr->gap_starts == NULL || pool_mgr->gap_slots == NULL) {
+            
+            // It didn't :(
+            
+            _mem_free_pool_mem(pool_mgr);
+            free(pool_mgr->node_heap);
+            free(pool_mgr->gap_ix);
+            free(pool_mgr->gap_sizes);
+            free(pool_mgr->gap_starts);
+            free(pool_mgr->gap_slots);
+            free(pool_mgr);
+            
+            return NULL;
+            
+        }
+        
+    }
+    
+    // TLSF pools keep their gaps on segregated lists instead of the tree
+    if(policy == TLSF) {
+        
+        pool_mgr->tlsf = (tlsf_pt) calloc(1, sizeof(tlsf_t));
+        
+        if(pool_mgr->tlsf == NULL) {
+            
+            // It didn't :(
+            
+            _mem_free_pool_mem(pool_mgr);
+            free(pool_mgr->node_heap);
+            free(pool_mgr->gap_ix);
+            free(pool_mgr->gap_sizes);
+            free(pool_mgr->gap_starts);
+            free(pool_mgr->gap_slots);
+            free(pool_mgr);
+            
+            return NULL;
+            
+        }
+        
+    }
+    
+    // BUDDY pools keep a free list per block order
+    if(policy == BUDDY) {
+        
+        pool_mgr->buddy = (buddy_pt) calloc(1, sizeof(buddy_t));
+        
+        if(pool_mgr->buddy == NULL) {
+            
+            // It didn't :(
+            
+            _mem_free_pool_mem(pool_mgr);
+            free(pool_mgr->node_heap);
+            free(pool_mgr->gap_ix);
+            free(pool_mgr->gap_sizes);
+            free(pool_mgr->gap_starts);
+            free(pool_mgr->gap_slots);
+            free(pool_mgr);
+            
+            return NULL;
+            
+        }
+        
+    }
+    
+    _mem_clear_lists(pool_mgr);
+    
+    // Small requests come out of size-class slabs, if asked for
+    if(flags & POOL_SLAB) {
+        
+        pool_mgr->slabs = (slab_cache_pt) calloc(1, sizeof(slab_cache_t));
+        
+        if(pool_mgr->slabs == NULL) {
+            
+            // It didn't :(
+            
+            _mem_free_pool_mem(pool_mgr);
+            free(pool_mgr->node_heap);
+            free(pool_mgr->gap_ix);
+            free(pool_mgr->gap_sizes);
+            free(pool_mgr->gap_starts);
+            free(pool_mgr->gap_slots);
+            free(pool_mgr->tlsf);
+            free(pool_mgr->buddy);
+            free(pool_mgr);
+            
+            return NULL;
+            
+        }
+        
+    }
+    
+    // Map the pool's pages to the segments that start in them
+    pool_mgr->page_map = (node_pt *) calloc((size >> MEM_PAGE_SHIFT) + 1, sizeof(node_pt));
+    
+    if(pool_mgr->page_map == NULL) {
+        
+        // It didn't :(
+        
+        _mem_free_pool_mem(pool_mgr);
+        free(pool_mgr->node_heap);
+        free(pool_mgr->gap_ix);
+        free(pool_mgr->gap_sizes);
+        free(pool_mgr->gap_starts);
+        free(pool_mgr->gap_slots);
+        free(pool_mgr->tlsf);
+        free(pool_mgr->buddy);
+        free(pool_mgr->slabs);
+        free(pool_mgr);
+        
+        return NULL;
+        
+    }
+    
+    // initialize top node of node heap
+    // Add the starting node / gap representing a completely empty pool
+    // (the first chunk of the node heap is allocated here)
+    if(_mem_fill_pool(pool_mgr) != ALLOC_OK) {
+        
+        // It didn't :(
+        
+        for(unsigned i = 0; i < pool_mgr->node_chunks; ++i) {
+            free(pool_mgr->node_heap[i]);
+        }
+        
+        _mem_free_pool_mem(pool_mgr);
+        free(pool_mgr->node_heap);
+        free(pool_mgr->gap_ix);
+        free(pool_mgr->gap_sizes);
+        free(pool_mgr->gap_starts);
+        free(pool_mgr->gap_slots);
+        free(pool_mgr->tlsf);
+        free(pool_mgr->buddy);
+        free(pool_mgr->slabs);
+        free(pool_mgr->page_map);
+        free(pool_mgr);
+        
+        return NULL;
+        
+    }
+    
+    // link pool mgr to pool store
+    // Connect our new pool manager to the pointer table
+    pool_store[pool_store_size] = pool_mgr;
+    
+    // Increment pool_store_size
+    ++pool_store_size;
+    
+    // Return the addLess of the mgr, cast to (pool_pt)
+    // Return the pointer (casted to a pool_pt)
+    return (pool_pt) pool_mgr;
+    
+}
+
+pool_pt mem_pool_open_file(const char *path, size_t size, alloc_policy policy) {
+    
+    if(pool_store == NULL) {
+        
+        if(mem_init() != ALLOC_OK) {
+            return NULL;
+        }
+        
+    }
+    
+    if(_mem_resize_pool_store() != ALLOC_OK) {
+        return NULL;
+    }
+    
+    // Only a boundary-tag pool has all of its metadata in the pool memory
+    // (and TLSF is the policy those place blocks with)
+    if(path == NULL || policy != TLSF) {
+        return NULL;
+    }
+    
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) calloc(1, sizeof(pool_mgr_t));
+    
+    if(pool_mgr == NULL) {
+        return NULL;
+    }
+    
+    int created;
+    
+    const pool_file_pt file = _mem_map_pool_file(pool_mgr, path, size, &created);
+    
+    if(file == NULL) {
+        
+        free(pool_mgr);
+        
+        return NULL;
+        
+    }
+    
+    pool_mgr->file = file;
+    pool_mgr->pool.policy = TLSF;
+    
+    if(created) {
+        
+        // One free block over the whole pool. The lists are set up in a
+        // copy, and the header is written after, the magic number last:
+        // until then it stays blank, and the next open starts over
+        tag_index_t tags;
+        
+        pool_mgr->tags = &tags;
+        pool_mgr->pool.total_size = size;
+        
+        if(_tag_open(pool_mgr) != ALLOC_OK) {
+            
+            _mem_free_pool_mem(pool_mgr);
+            free(pool_mgr);
+            
+            return NULL;
+            
+        }
+        
+        file->version = MEM_POOL_FILE_VERSION;
+        file->policy = TLSF;
+        file->header_size = (size_t) (pool_mgr->pool.mem - (char *) file);
+        file->total_size = size;
+        file->root = MEM_TAG_NIL;
+        file->tags = tags;
+        file->magic = MEM_POOL_FILE_MAGIC;
+        
+        pool_mgr->tags = &(file->tags);
+        
+    } else {
+        
+        pool_mgr->tags = &(file->tags);
+        
+        // The blocks are where they were, only the counters are copied
+        pool_mgr->pool.total_size = file->total_size;
+        pool_mgr->pool.alloc_size = file->alloc_size;
+        pool_mgr->pool.num_allocs = file->num_allocs;
+        pool_mgr->pool.num_gaps = file->num_gaps;
+        
+        // Mapped somewhere else, the records point at the old memory, and
+        // never closed, the counters and the lists may be out of date (a
+        // file the blocks don't add up in isn't opened)
+        if((file->base != (uintptr_t) file || file->in_use) && _tag_restore(pool_mgr) != ALLOC_OK) {
+            
+            _mem_free_pool_mem(pool_mgr);
+            free(pool_mgr);
+            
+            return NULL;
+            
+        }
+        
+    }
+    
+    file->base = (uintptr_t) file;
+    file->in_use = 1;
+    
+    pool_store[pool_store_size] = pool_mgr;
+    
+    ++pool_store_size;
+    
+    return (pool_pt) pool_mgr;
+    
+}
+
+alloc_status mem_pool_close(pool_pt pool) {
+    
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    // Upcast the pool pointer to a pool_mgr pointer
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    // check if this pool is allocated
+    if(pool_mgr == NULL) {
+        return ALLOC_FAIL;
+    }
+    
+    // Slabs kept around empty hold on to their runs, give them back first
+    if(pool_mgr->slabs) {
+        _slab_release_empty(pool_mgr);
+    }
+    
+    // Boundary-tag, ARENA, STACK and compact pools have no node heap, but
+    // count their allocations (a file-backed pool keeps them, for the next
+    // open)
+    if((pool_mgr->tags || pool_mgr->arena || pool_mgr->compact) && pool_mgr->file == NULL && pool_mgr->pool.num_allocs != 0) {
+        return ALLOC_NOT_FREED;
+    }
+    
+    for(node_pt node = (pool_mgr->tags || pool_mgr->arena || pool_mgr->compact) ? NULL : _mem_node_at(pool_mgr, 0); node != NULL; node = _mem_node_next(pool_mgr, node)) {
+        
+        // check if pool has only one gap
+        if(node->allocated) {
+            return ALLOC_NOT_FREED;
+        }
+        
+    }
+    
+    // check if it has zero allocations
+    if(pool_mgr->pool.num_allocs <= 0) {
+        // TODO How does this case differ?
+        //return ALLOC_FAIL;
+    }
+
+    // find mgr in pool store and set to null
+    for(unsigned i = 0; i < pool_store_size; ++i) {
+        
+        if(pool_store[i] == pool_mgr) {
+            pool_store[i] = NULL;
+            break;
+        }
+        
+    }
+    
+    alloc_status status = ALLOC_OK;
+    
+    // A file-backed pool leaves its counters in the file, and the file
+    // written back (its block lists are in there too)
+    if(pool_mgr->file) {
+        
+        pool_mgr->file->alloc_size = pool_mgr->pool.alloc_size;
+        pool_mgr->file->num_allocs = pool_mgr->pool.num_allocs;
+        pool_mgr->file->num_gaps = pool_mgr->pool.num_gaps;
+        pool_mgr->file->in_use = 0;
+        
+        // The pool is still closed if the flush fails, but the caller has
+        // to know the file may not hold it
+        if(msync(pool_mgr->file, pool_mgr->mapped, MS_SYNC) != 0) {
+            status = ALLOC_FAIL;
+        }
+        
+        pool_mgr->tags = NULL;
+        
+    }
+    
+    // Free the allocated memory
+    // free memory pool
+    if(_mem_free_pool_mem(pool_mgr) != ALLOC_OK) {
+        status = ALLOC_FAIL;
+    }
+    
+    // Free the array of gaps
+    // free gap index
+    free(pool_mgr->gap_ix);
+    free(pool_mgr->gap_sizes);
+    free(pool_mgr->gap_starts);
+    free(pool_mgr->gap_slots);
+    
+    // Free the chunks of nodes
+    // free node heap
+    for(unsigned i = 0; i < pool_mgr->node_chunks; ++i) {
+        free(pool_mgr->node_heap[i]);
+    }
+    
+    free(pool_mgr->node_heap);
+    
+    // free the segregated lists (NULL unless TLSF or BUDDY)
+    free(pool_mgr->tlsf);
+    free(pool_mgr->buddy);
+    
+    // free the slab cache (NULL unless POOL_SLAB)
+    if(pool_mgr->slabs) {
+        free(pool_mgr->slabs->runs);
+    }
+    
+    free(pool_mgr->slabs);
+    
+    // free the page map
+    free(pool_mgr->page_map);
+    
+    // free the block lists (NULL unless POOL_BOUNDARY_TAGS)
+    free(pool_mgr->tags);
+    
+    // free the top (NULL unless ARENA or STACK)
+    free(pool_mgr->arena);
+    
+    // free the compact nodes and their page map (NULL unless POOL_COMPACT)
+    if(pool_mgr->compact) {
+        free(pool_mgr->compact->nodes);
+        free(pool_mgr->compact->page_map);
+    }
+    
+    free(pool_mgr->compact);
+    
+    // Free the pool_mgr struct
+    // free mgr
+    free(pool_mgr);
+    
+    return status;
+    
+}
+
+alloc_status mem_pool_reset(pool_pt pool) {
+    
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    if(pool_mgr == NULL) {
+        return ALLOC_FAIL;
+    }
+    
+    pool_mgr->pool.num_allocs = 0;
+    pool_mgr->pool.alloc_size = 0;
+    pool_mgr->pool.num_gaps = 0;
+    
+    // A boundary-tag pool is one free block again
+    if(pool_mgr->tags) {
+        
+        _tag_reset(pool_mgr);
+        
+        if(pool_mgr->file) {
+            pool_mgr->file->root = MEM_TAG_NIL;
+        }
+        
+        return ALLOC_OK;
+        
+    }
+    
+    // So is an ARENA or STACK pool, its top goes back to the start
+    if(pool_mgr->arena) {
+        
+        _arena_reset(pool_mgr);
+        
+        return ALLOC_OK;
+        
+    }
+    
+    // And a compact pool is its first node again
+    if(pool_mgr->compact) {
+        
+        _compact_reset(pool_mgr);
+        
+        return ALLOC_OK;
+        
+    }
+    
+    // The slab descriptors are outside the pool, their runs go with the rest
+    if(pool_mgr->slabs) {
+        
+        for(unsigned i = 0; i < pool_mgr->slabs->num_runs; ++i) {
+            free(pool_mgr->slabs->runs[i]);
+        }
+        
+        pool_mgr->slabs->num_runs = 0;
+        
+        memset(pool_mgr->slabs->partial, 0, sizeof(pool_mgr->slabs->partial));
+        
+    }
+    
+    // Forget every node, the chunks stay to be handed out again
+    pool_mgr->used_nodes = 0;
+    pool_mgr->free_nodes = MEM_NODE_NIL;
+    
+    pool_mgr->gap_ix_root = MEM_GAP_IX_NIL;
+    pool_mgr->cursor = pool_mgr->pool.mem;
+    
+    _mem_clear_lists(pool_mgr);
+    
+    memset(pool_mgr->page_map, 0, ((pool_mgr->pool.total_size >> MEM_PAGE_SHIFT) + 1) * sizeof(node_pt));
+    
+    // Can't fail, the first chunk is there
+    return _mem_fill_pool(pool_mgr);
+    
+}
+
+pool_mark_t mem_pool_mark(pool_pt pool) {
+    
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    // The mark is just how far up the top is
+    if(pool_mgr == NULL || pool_mgr->arena == NULL) {
+        return 0;
+    }
+    
+    return (pool_mark_t) (pool_mgr->arena->top - pool_mgr->pool.mem);
+    
+}
+
+alloc_status mem_pool_rollback(pool_pt pool, pool_mark_t mark) {
+    
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    if(pool_mgr == NULL || pool_mgr->arena == NULL) {
+        return ALLOC_FAIL;
+    }
+    
+    const arena_pt arena = pool_mgr->arena;
+    
+    // Marks are offsets into the pool
+    if(mark > pool_mgr->pool.total_size) {
+        return ALLOC_FAIL;
+    }
+    
+    char *const top = pool_mgr->pool.mem + mark;
+    
+    // Everything placed since goes, only the counters need the blocks. A
+    // mark from before an earlier rollback may be in a block placed after
+    // that, which stays.
+    while(arena->last != NULL && (char *) arena->last >= top) {
+        _arena_pop(pool_mgr, arena->last);
+    }
+    
+    // The deallocated blocks now on top go too
+    while(arena->last != NULL && arena->last->alloc_record.mem == NULL) {
+        _arena_pop(pool_mgr, arena->last);
+    }
+    
+    return ALLOC_OK;
+    
+}
+
+alloc_status mem_pool_trim(pool_pt pool, size_t keep_bytes) {
+    
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    if(pool_mgr == NULL) {
+        return ALLOC_FAIL;
+    }
+    
+    alloc_status status = ALLOC_OK;
+    
+    if(pool_mgr->tags) {
+        
+        // Free blocks are on the segregated lists, their headers stay
+        const tag_index_pt tags = pool_mgr->tags;
+        
+        for(unsigned fl = 0; fl < MEM_TLSF_FL_COUNT; ++fl) {
+            for(unsigned sl = 0; sl < MEM_TLSF_SL_COUNT; ++sl) {
+                for(tag_pt tag = _tag_at(pool_mgr, tags->heads[fl][sl]); tag != NULL; tag = _tag_at(pool_mgr, tag->next_free)) {
+                    
+                    if(_mem_release(pool_mgr, (char *) (tag + 1), (tag->size & MEM_TAG_SIZE_MASK) - sizeof(tag_t), keep_bytes) != ALLOC_OK) {
+                        status = ALLOC_FAIL;
+                    }
+                    
+                }
+            }
+        }
+        
+    } else if(pool_mgr->arena) {
+        
+        // The space above the top, and what deallocated blocks below it
+        // held (their headers stay)
+        const arena_pt arena = pool_mgr->arena;
+        
+        status = _mem_release(pool_mgr, arena->top, (size_t) (pool_mgr->pool.mem + pool_mgr->pool.total_size - arena->top), keep_bytes);
+        
+        for(arena_block_pt block = arena->last; block != NULL; block = block->prev) {
+            
+            if(block->alloc_record.mem == NULL && _mem_release(pool_mgr, (char *) (block + 1), block->alloc_record.size, keep_bytes) != ALLOC_OK) {
+                status = ALLOC_FAIL;
+            }
+            
+        }
+        
+    } else if(pool_mgr->compact) {
+        
+        // The gaps are found on the list
+        const compact_pt compact = pool_mgr->compact;
+        
+        for(unsigned node = 0; node != MEM_COMPACT_NIL; node = compact->nodes[node].next) {
+            
+            if(compact->nodes[node].allocated == 0 &&
+               _mem_release(pool_mgr, pool_mgr->pool.mem + compact->nodes[node].offset, compact->nodes[node].size, keep_bytes) != ALLOC_OK) {
+                status = ALLOC_FAIL;
+            }
+            
+        }
+        
+    } else {
+        
+        // Every gap is in the gap index, nothing is kept in them
+        for(unsigned gap = 0; gap < pool_mgr->pool.num_gaps; ++gap) {
+            
+            const node_pt node = pool_mgr->gap_ix[gap].node;
+            
+            if(_mem_release(pool_mgr, node->alloc_record.mem, node->alloc_record.size, keep_bytes) != ALLOC_OK) {
+                status = ALLOC_FAIL;
+            }
+            
+        }
+        
+    }
+    
+    return status;
+    
+}
+
+double mem_pool_prefault_ms(pool_pt pool) {
+    
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    return (pool_mgr == NULL) ? 0 : pool_mgr->prefault_ms;
+    
+}
+
+alloc_status mem_pool_set_root(pool_pt pool, alloc_pt alloc) {
+    
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    // Only a file-backed pool outlives the process, NULL clears the root
+    if(pool_mgr == NULL || pool_mgr->file == NULL) {
+        return ALLOC_FAIL;
+    }
+    
+    if(alloc == NULL) {
+        
+        pool_mgr->file->root = MEM_TAG_NIL;
+        
+        return ALLOC_OK;
+        
+    }
+    
+    if(_tag_find(pool_mgr, alloc->mem) != alloc) {
+        return ALLOC_FAIL;
+    }
+    
+    pool_mgr->file->root = (size_t) (alloc->mem - pool_mgr->pool.mem);
+    
+    return ALLOC_OK;
+    
+}
+
+alloc_pt mem_pool_root(pool_pt pool) {
+    
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    if(pool_mgr == NULL || pool_mgr->file == NULL || pool_mgr->file->root == MEM_TAG_NIL) {
+        return NULL;
+    }
+    
+    return _tag_find(pool_mgr, pool_mgr->pool.mem + pool_mgr->file->root);
+    
+}
+
+alloc_pt mem_new_alloc(pool_pt pool, size_t size) {
+    
+    // Get pool_mgr from pool by casting the pointer to (pool_mgr_pt)
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    // expand heap node, if necessary, quit on error
+    // check used nodes fewer than total nodes, quit on error
+    // get a node for allocation:
+    // Get a new node
+    
+    // if FIRST_FIT, then find the first sufficient node in the node heap
+    
+    // if BEST_FIT, then find the first sufficient node in the gap index
+    
+    // check if node found
+    // update metadata (num_allocs, alloc_size)
+    // calculate the size of the remaining gap, if any
+    // remove node from gap index
+    // convert gap_node to an allocation node of given size
+    // adjust node heap:
+    //   if remaining gap, need a new node
+    //   find an unused one in the node heap
+    //   make sure one was found
+    //   initialize it to a gap node
+    //   update metadata (used_nodes)
+    //   update linked list (new node right after the node for allocation)
+    //   add to gap index
+    //   check if successful
+    // return allocation record by casting the node to (alloc_pt)
+    
+    // Configure the node
+    
+    // Steal some memory from the gap table
+    
+    alloc_pt alloc = NULL;
+    
+    // A POOL_GROW pool that is out of room grows and tries again
+    do {
+        
+        if(pool_mgr->tags) {
+            
+            // The record is in the block's header
+            alloc = _tag_alloc(pool_mgr, size);
+            
+        } else if(pool_mgr->arena) {
+            
+            // So it is for an ARENA or STACK block, which goes on top of the
+            // last one
+            alloc = _arena_alloc(pool_mgr, size, MEM_ARENA_ALIGN);
+            
+        } else if(pool_mgr->compact) {
+            
+            // A compact pool has no records to hand out, only memory
+            // (mem_alloc_ptr)
+            alloc = NULL;
+            
+        } else if(pool_mgr->slabs && size <= MEM_SLAB_MAX_SIZE) {
+            
+            // Small requests come out of a slab, no node or gap involved
+            alloc = _slab_alloc(pool_mgr, size);
+            
+        } else {
+            
+            const node_pt newNode = _mem_alloc_node(pool_mgr, size);
+            
+            if(newNode) {
+                alloc = &(newNode->alloc_record);
+            }
+            
+        }
+        
+    } while(alloc == NULL && _mem_grow(pool_mgr, size) == ALLOC_OK);
+    
+    if(alloc) {
+        
+        ++(pool_mgr->pool.num_allocs);
+        
+        pool_mgr->pool.alloc_size += size;
+        
+        return alloc;
+        
+    } else {
+        
+        printf("Failed to alloc memory!\r\n");
+        
+        return NULL;
+        
+    }
+    
+}
+
+alloc_pt mem_new_alloc_aligned(pool_pt pool, size_t size, size_t alignment) {
+    
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    // Only powers of two
+    if(alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+    
+    alloc_pt alloc = NULL;
+    
+    // Slab objects are aligned to the largest power of two in their size,
+    // larger alignments aren't possible there, however much the pool grows
+    if(pool_mgr->slabs && size <= MEM_SLAB_MAX_SIZE && alignment > MEM_SLAB_MAX_SIZE) {
+        
+        printf("Failed to alloc memory!\r\n");
+        
+        return NULL;
+        
+    }
+    
+    // A POOL_GROW pool that is out of room grows by enough for the padding
+    // too, and tries again
+    do {
+        
+        if(pool_mgr->tags) {
+            
+            alloc = _tag_alloc_aligned(pool_mgr, size, alignment);
+            
+        } else if(pool_mgr->arena) {
+            
+            alloc = _arena_alloc(pool_mgr, size, (alignment > MEM_ARENA_ALIGN) ? alignment : MEM_ARENA_ALIGN);
+            
+        } else if(pool_mgr->compact) {
+            
+            alloc = NULL;
+            
+        } else if(pool_mgr->slabs && size <= MEM_SLAB_MAX_SIZE) {
+            
+            // Ask for a multiple of the alignment, small requests can't
+            // leave the slabs
+            alloc = _slab_alloc(pool_mgr, ((size ? size : 1) + alignment - 1) & ~(alignment - 1));
+            
+            if(alloc) {
+                alloc->size = size;
+            }
+            
+        } else {
+            
+            const node_pt newNode = _mem_alloc_node_aligned(pool_mgr, size, alignment);
+            
+            if(newNode) {
+                alloc = &(newNode->alloc_record);
+            }
+            
+        }
+        
+    } while(alloc == NULL && size <= SIZE_MAX - alignment && _mem_grow(pool_mgr, size + alignment) == ALLOC_OK);
+    
+    if(alloc) {
+        
+        ++(pool_mgr->pool.num_allocs);
+        
+        pool_mgr->pool.alloc_size += size;
+        
+        return alloc;
+        
+    } else {
+        
+        printf("Failed to alloc memory!\r\n");
+        
+        return NULL;
+        
+    }
+    
+}
+
+alloc_status mem_new_alloc_batch(pool_pt pool, const size_t *sizes, alloc_pt *out, unsigned n) {
+    
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    size_t requested = 0;
+    
+    for(unsigned u = 0; u < n; ++u) {
+        
+        if(sizes[u] > SIZE_MAX - requested) {
+            return ALLOC_FAIL;
+        }
+        
+        requested += sizes[u];
+        
+    }
+    
+    // All of them in one piece, where the pool kind allows it (BUDDY blocks
+    // can't be placed back to back, and ARENA and STACK blocks are as cheap
+    // one at a time)
+    alloc_status status = ALLOC_FAIL;
+    
+    if(n == 0) {
+        
+        return ALLOC_OK;
+        
+    } else if(pool_mgr->tags) {
+        
+        status = _tag_alloc_batch(pool_mgr, sizes, out, n);
+        
+    } else if(pool_mgr->pool.policy != BUDDY && pool_mgr->arena == NULL && pool_mgr->compact == NULL) {
+        
+        // A POOL_GROW pool grows until they fit
+        do {
+            status = _mem_alloc_node_batch(pool_mgr, sizes, out, n);
+        } while(status != ALLOC_OK && _mem_grow(pool_mgr, requested) == ALLOC_OK);
+        
+    }
+    
+    if(status == ALLOC_OK) {
+        
+        pool_mgr->pool.num_allocs += n;
+        
+        pool_mgr->pool.alloc_size += requested;
+        
+        return ALLOC_OK;
+        
+    }
+    
+    // No gap large enough for all of them, one at a time then, all or none
+    for(unsigned u = 0; u < n; ++u) {
+        
+        out[u] = mem_new_alloc(pool, sizes[u]);
+        
+        if(out[u] == NULL) {
+            
+            while(u > 0) {
+                mem_del_alloc(pool, out[--u]);
+            }
+            
+            return ALLOC_FAIL;
+            
+        }
+        
+    }
+    
+    return ALLOC_OK;
+    
+}
+
+alloc_status mem_del_alloc(pool_pt pool, alloc_pt alloc) {
+    
+    const size_t size = alloc->size;
+    
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    // get node from alloc by casting the pointer to (node_pt)
+    // find the node in the node heap
+    // this is node-to-delete
+    // make sure it's found
+    // convert to gap node
+    // update metadata (num_allocs, alloc_size)
+    // if the next node in the list is also a gap, merge into node-to-delete
+    //   remove the next node from gap index
+    //   check success
+    //   add the size to the node-to-delete
+    //   update node as unused
+    //   update metadata (used nodes)
+    //   update linked list:
+    /*
+                    if (next->next) {
+                        next->next->prev = node_to_del;
+                        node_to_del->next = next->next;
+                    } else {
+                        node_to_del->next = NULL;
+                    }
+                    next->next = NULL;
+                    next->prev = NULL;
+     */
+
+    // this merged node-to-delete might need to be added to the gap index
+    // but one more thing to check...
+    // if the previous node in the list is also a gap, merge into previous!
+    //   remove the previous node from gap index
+    //   check success
+    //   add the size of node-to-delete to the previous
+    //   update node-to-delete as unused
+    //   update metadata (used_nodes)
+    //   update linked list
+    /*
+                    if (node_to_del->next) {
+                        prev->next = node_to_del->next;
+                        node_to_del->next->prev = prev;
+                    } else {
+                        prev->next = NULL;
+                    }
+                    node_to_del->next = NULL;
+                    node_to_del->prev = NULL;
+     */
+    //   change the node to add to the previous node!
+    // add the resulting node to the gap index
+    // check success
+
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    // Slab objects go back to their slab, everything else is a node
+    alloc_status status;
+    
+    if(pool_mgr->tags) {
+        
+        status = _tag_free(pool_mgr, alloc);
+        
+    } else if(pool_mgr->arena) {
+        
+        status = _arena_free(pool_mgr, alloc);
+        
+    } else if(pool_mgr->compact) {
+        
+        // A compact pool hands out no records, this isn't one of its own
+        status = ALLOC_FAIL;
+        
+    } else if(pool_mgr->slabs && size <= MEM_SLAB_MAX_SIZE) {
+        
+        status = _slab_free(pool_mgr, alloc);
+        
+    } else {
+        
+        // Upcast to node
+        const node_pt node = (node_pt) alloc;
+        
+        // Call the internal function that will handle this
+        status = _add_gap(pool_mgr, node);
+        
+    }
+    
+    if(status == ALLOC_OK) {
+        
+        --(pool_mgr->pool.num_allocs);
+        
+        pool_mgr->pool.alloc_size -= size;
+        
+        return ALLOC_OK;
+        
+    } else {
+        
+        return ALLOC_FAIL;
+        
+    }
+    
+}
+
+alloc_pt mem_realloc_alloc(pool_pt pool, alloc_pt alloc, size_t size) {
+    
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    // A compact pool hands out no records, this isn't one of its own
+    if(pool_mgr->compact) {
+        return NULL;
+    }
+    
+    const size_t oldSize = alloc->size;
+    
+    alloc_status status = ALLOC_FAIL;
+    
+    // Try to resize where it is first
+    if(pool_mgr->tags) {
+        
+        status = _tag_resize(pool_mgr, alloc, size);
+        
+    } else if(pool_mgr->arena) {
+        
+        status = _arena_resize(pool_mgr, alloc, size);
+        
+        // The last block can grow with a POOL_GROW pool, in place
+        while(status != ALLOC_OK && (arena_block_pt) alloc == pool_mgr->arena->last &&
+              _mem_grow(pool_mgr, size - oldSize) == ALLOC_OK) {
+            
+            status = _arena_resize(pool_mgr, alloc, size);
+            
+        }
+        
+    } else if(pool_mgr->slabs && (oldSize <= MEM_SLAB_MAX_SIZE || size <= MEM_SLAB_MAX_SIZE)) {
+        
+        // The size tells slab objects from nodes, so an object can only stay
+        // put while it still fits its object, and a node can't become one
+        if(oldSize <= MEM_SLAB_MAX_SIZE && size <= MEM_SLAB_MAX_SIZE) {
+            
+            const slab_pt slab = (slab_pt) ((uintptr_t) alloc & ~(uintptr_t) (MEM_SLAB_ALIGN - 1));
+            
+            if(size <= slab->size) {
+                
+                alloc->size = size;
+                
+                status = ALLOC_OK;
+                
+            }
+            
+        }
+        
+    } else if(pool_mgr->pool.policy == BUDDY) {
+        
+        // A block is freed by the size of its record, which has to keep
+        // rounding up to the same block
+        if(_buddy_block_size(size) == _buddy_block_size(oldSize)) {
+            
+            alloc->size = size;
+            
+            status = ALLOC_OK;
+            
+        }
+        
+    } else {
+        
+        status = _mem_resize_node(pool_mgr, (node_pt) alloc, size);
+        
+    }
+    
+    if(status == ALLOC_OK) {
+        
+        pool_mgr->pool.alloc_size = pool_mgr->pool.alloc_size - oldSize + size;
+        
+        return alloc;
+        
+    }
+    
+    // A STACK allocation can't be moved, the old one would be below the new
+    if(pool_mgr->pool.policy == STACK) {
+        return NULL;
+    }
+    
+    // Last resort, move it (the old allocation stays if that fails)
+    const alloc_pt moved = mem_new_alloc(pool, size);
+    
+    if(moved == NULL) {
+        return NULL;
+    }
+    
+    memcpy(moved->mem, alloc->mem, (size < oldSize) ? size : oldSize);
+    
+    mem_del_alloc(pool, alloc);
+    
+    return moved;
+    
+}
+
+alloc_status mem_del_alloc_batch(pool_pt pool, alloc_pt *allocs, unsigned n) {
+    
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    // A compact pool hands out no records, these aren't its own
+    if(pool_mgr->compact) {
+        return ALLOC_FAIL;
+    }
+    
+    // STACK allocations have to be the ones on top, in any order
+    if(pool_mgr->pool.policy == STACK) {
+        
+        size_t freed = 0;
+        
+        for(unsigned u = 0; u < n; ++u) {
+            freed += allocs[u]->size;
+        }
+        
+        if(_stack_free_batch(pool_mgr, allocs, n) != ALLOC_OK) {
+            return ALLOC_FAIL;
+        }
+        
+        pool_mgr->pool.num_allocs -= n;
+        
+        pool_mgr->pool.alloc_size -= freed;
+        
+        return ALLOC_OK;
+        
+    }
+    
+    // BUDDY blocks only merge with their buddies, boundary-tag blocks
+    // merge in constant time already, and ARENA blocks never do
+    if(pool_mgr->tags || pool_mgr->arena || pool_mgr->pool.policy == BUDDY) {
+        
+        alloc_status status = ALLOC_OK;
+        
+        for(unsigned u = 0; u < n; ++u) {
+            
+            if(mem_del_alloc(pool, allocs[u]) != ALLOC_OK) {
+                status = ALLOC_FAIL;
+            }
+            
+        }
+        
+        return status;
+        
+    }
+    
+    size_t freed = 0;
+    
+    // Mark the nodes free, they aren't in the gap index yet
+    for(unsigned u = 0; u < n; ++u) {
+        
+        freed += allocs[u]->size;
+        
+        if(pool_mgr->slabs && allocs[u]->size <= MEM_SLAB_MAX_SIZE) {
+            continue;
+        }
+        
+        const node_pt node = (node_pt) allocs[u];
+        
+        node->allocated = 0;
+        node->gap = MEM_GAP_IX_NIL;
+        
+    }
+    
+    // Merge each run of free segments into its first one, which is indexed
+    // once. Every segment of a run is visited at most twice, whichever of
+    // its nodes comes up first, and is gone (or indexed) after.
+    alloc_status status = ALLOC_OK;
+    
+    for(unsigned u = 0; u < n; ++u) {
+        
+        if(pool_mgr->slabs && allocs[u]->size <= MEM_SLAB_MAX_SIZE) {
+            continue;
+        }
+        
+        const node_pt node = (node_pt) allocs[u];
+        
+        if(node->used == 0 || node->gap != MEM_GAP_IX_NIL) {
+            continue;
+        }
+        
+        node_pt start = node;
+        
+        for(node_pt prev = _mem_node_prev(pool_mgr, start);
+            prev != NULL && prev->allocated == 0;
+            prev = _mem_node_prev(pool_mgr, start)) {
+            
+            start = prev;
+            
+        }
+        
+        size_t size = start->alloc_record.size;
+        
+        for(node_pt next = _mem_node_next(pool_mgr, start);
+            next != NULL && next->allocated == 0;
+            next = _mem_node_next(pool_mgr, start)) {
+            
+            size += next->alloc_record.size;
+            
+            if(next->gap != MEM_GAP_IX_NIL) {
+                _remove_gap(pool_mgr, next->gap);
+            }
+            
+            _remove_node(pool_mgr, next);
+            
+        }
+        
+        start->alloc_record.size = size;
+        
+        if(start->gap != MEM_GAP_IX_NIL) {
+            
+            _mem_update_gap_ix(pool_mgr, start->gap, size, start);
+            
+        } else if(_mem_add_to_gap_ix(pool_mgr, size, start) != ALLOC_OK) {
+            
+            status = ALLOC_FAIL;
+            
+        }
+        
+    }
+    
+    // Slab objects last: a run that is given back merges with its
+    // neighbours the usual way, so those have to be settled first
+    for(unsigned u = 0; u < n; ++u) {
+        
+        if(pool_mgr->slabs && allocs[u]->size <= MEM_SLAB_MAX_SIZE) {
+            _slab_free(pool_mgr, allocs[u]);
+        }
+        
+    }
+    
+    pool_mgr->pool.num_allocs -= n;
+    
+    pool_mgr->pool.alloc_size -= freed;
+    
+    return status;
+    
+}
+
+void *mem_alloc_ptr(pool_pt pool, size_t size) {
+    
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    // A zero-size segment would start where the next one does, and the
+    // pointer couldn't tell them apart, so it gets a byte (as with malloc)
+    if(size == 0) {
+        size = 1;
+    }
+    
+    // A compact pool has no records, the memory is all it hands out
+    if(pool_mgr->compact) {
+        
+        char *const mem = _compact_alloc(pool_mgr, size);
+        
+        if(mem == NULL) {
+            
+            printf("Failed to alloc memory!\r\n");
+            
+            return NULL;
+            
+        }
+        
+        ++(pool_mgr->pool.num_allocs);
+        
+        pool_mgr->pool.alloc_size += size;
+        
+        return mem;
+        
+    }
+    
+    const alloc_pt alloc = mem_new_alloc(pool, size);
+    
+    // Hand out the memory itself, the record can be found again from it
+    return alloc ? alloc->mem : NULL;
+    
+}
+
+alloc_status mem_free_ptr(pool_pt pool, void *mem) {
+    
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    // A boundary-tag block's header sits right before its memory
+    if(pool_mgr->tags) {
+        
+        const alloc_pt alloc = _tag_find(pool_mgr, (const char *) mem);
+        
+        return alloc ? mem_del_alloc(pool, alloc) : ALLOC_FAIL;
+        
+    }
+    
+    // So does an ARENA or STACK block's
+    if(pool_mgr->arena) {
+        
+        const alloc_pt alloc = _arena_find(pool_mgr, (const char *) mem);
+        
+        return alloc ? mem_del_alloc(pool, alloc) : ALLOC_FAIL;
+        
+    }
+    
+    // A compact pool has its own page map, and no records
+    if(pool_mgr->compact) {
+        
+        const unsigned node = _compact_find(pool_mgr, (const char *) mem);
+        
+        if(node == MEM_COMPACT_NIL) {
+            return ALLOC_FAIL;
+        }
+        
+        _compact_free(pool_mgr, node);
+        
+        return ALLOC_OK;
+        
+    }
+    
+    // The segment the memory is in
+    const node_pt node = _mem_find_node(pool_mgr, (const char *) mem);
+    
+    if(node == NULL || node->allocated == 0) {
+        return ALLOC_FAIL;
+    }
+    
+    // A slab object's record is in its slab
+    if(node->slab) {
+        
+        const slab_pt slab = pool_mgr->slabs->runs[node->slab - 1];
+        
+        const size_t offset = (size_t) ((char *) mem - slab->mem);
+        const unsigned object = (unsigned) (offset / slab->size);
+        
+        if(offset % slab->size != 0 || object >= MEM_SLAB_OBJECTS || (slab->free_mask >> object) & 1) {
+            return ALLOC_FAIL;
+        }
+        
+        return mem_del_alloc(pool, &(slab->records[object]));
+        
+    }
+    
+    // Anything else has to be the start of an allocation
+    if(node->alloc_record.mem != mem) {
+        return ALLOC_FAIL;
+    }
+    
+    return mem_del_alloc(pool, &(node->alloc_record));
+    
+}
+
+void mem_inspect_pool(pool_pt pool, pool_segment_pt *segments, unsigned *num_segments) {
+    
+    // get the mgr from the pool
+    // Upcast the pool pointer to a pool_mgr pointer
+    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    
+    // Boundary-tag pools have one segment per block, found by walking the pool
+    if(pool_mgr->tags) {
+        
+        *segments = (pool_segment_pt) calloc(pool_mgr->pool.num_allocs + pool_mgr->pool.num_gaps, sizeof(pool_segment_t));
+        
+        if(*segments == NULL) {
+            return;
+        }
+        
+        _tag_inspect(pool_mgr, *segments, num_segments);
+        
+        return;
+        
+    }
+    
+    // ARENA and STACK pools have one segment per block, and the free space
+    // on top
+    if(pool_mgr->arena) {
+        
+        *segments = (pool_segment_pt) calloc(_arena_inspect(pool_mgr, NULL), sizeof(pool_segment_t));
+        
+        if(*segments == NULL) {
+            return;
+        }
+        
+        *num_segments = _arena_inspect(pool_mgr, *segments);
+        
+        return;
+        
+    }
+    
+    // Compact pools have a node per segment, on their own list
+    if(pool_mgr->compact) {
+        
+        *segments = (pool_segment_pt) calloc(pool_mgr->pool.num_allocs + pool_mgr->pool.num_gaps, sizeof(pool_segment_t));
+        
+        if(*segments == NULL) {
+            return;
+        }
+        
+        *num_segments = _compact_inspect(pool_mgr, *segments);
+        
+        return;
+        
+    }
+    
+    // allocate the segments array with size == used_nodes
+    *segments = (pool_segment_pt) calloc(pool_mgr->used_nodes, sizeof(pool_segment_t));
+    
+    // check successful
+    if(segments == NULL) {
+        return;
+    }
+    
+    // loop through the node heap and the segments array
+    int currentSegment = 0;
+    
+    node_pt currentNode = _mem_node_at(pool_mgr, 0);
+    
+    // Traverse the linked list
+    while(currentNode) {
+        
+        if(currentNode->used != 0) {
+            (*segments)[currentSegment].size = currentNode->alloc_record.size;
+            
+            // A BUDDY allocation occupies its whole (rounded up) block
+            if(pool_mgr->pool.policy == BUDDY && currentNode->allocated) {
+                (*segments)[currentSegment].size = _buddy_block_size(currentNode->alloc_record.size);
+            }
+            
+            (*segments)[currentSegment].allocated = currentNode->allocated;
+            ++currentSegment;
+        }
+        
+        currentNode = _mem_node_next(pool_mgr, currentNode);
+        
+    }
+    
+    /*for(int i = 0; i < pool_mgr->used_nodes; ++i) {
+        
+        // Skip unused nodes
+        if(pool_mgr->node_heap[i].used == 0) {
+            continue;
+        }
+        
+        // for each node, write the size and allocated in the segment
+        (*segments)[currentSegment].size = pool_mgr->node_heap[i].alloc_record.size;
+        (*segments)[currentSegment].allocated = pool_mgr->node_heap[i].allocated;
+        
+        ++currentSegment;
+        
+    }*/
+    
+    // "return" the values:
+    *num_segments = currentSegment;
+    return;
+    
+}
+
+/***********************************/
+/*                                 */
+/* Definitions of static functions */
+/*                                 */
+/***********************************/
+
+static alloc_status _mem_resize_pool_store() {
+    
+    // check if necessary
+    /*
+                if (((float) pool_store_size / pool_store_capacity)
+                    > MEM_POOL_STORE_FILL_FACTOR) {...}
+     */
+    // don't forget to update capacity variables
+    
+    // Are too many pools in use?
+    if(pool_store_size < pool_store_capacity * MEM_POOL_STORE_FILL_FACTOR) {
+        
+        // NO, do nothing
+        return ALLOC_OK;
+        
+    }
+    
+    // We'll use a temporary pointer, in the event that the realloc call fails,
+    // we'd rather deny the mem_pool_open call rather than obliterate the entire pool_store
+    
+    pool_mgr_pt * bob = (pool_mgr_pt *) realloc(pool_store, pool_store_capacity * MEM_POOL_STORE_EXPAND_FACTOR * sizeof(pool_mgr_pt));
+    
+    // Did the realloc call succeed?
+    if(bob == NULL) {
+        
+        // Return NULL on failure
+        printf("Failed to resize node heap.\r\n");
+        return ALLOC_FAIL;
+        
+    } else {
+        
+        // Assign bob to the pool_store
+        pool_store = bob;
+        
+        // Modify the pool_store_capacity to match the new size
+        pool_store_capacity *= MEM_POOL_STORE_EXPAND_FACTOR;
+        
+    }
+
+    return ALLOC_OK;
+    
+}
+
+static void _mem_clear_lists(pool_mgr_pt pool_mgr) {
+    
+    // Empty segregated lists (NULL unless TLSF or BUDDY)
+    if(pool_mgr->tlsf) {
+        
+        memset(pool_mgr->tlsf, 0, sizeof(tlsf_t));
+        
+        for(unsigned fl = 0; fl < MEM_TLSF_FL_COUNT; ++fl) {
+            for(unsigned sl = 0; sl < MEM_TLSF_SL_COUNT; ++sl) {
+                pool_mgr->tlsf->heads[fl][sl] = MEM_GAP_IX_NIL;
+            }
+        }
+        
+    }
+    
+    if(pool_mgr->buddy) {
+        
+        memset(pool_mgr->buddy, 0, sizeof(buddy_t));
+        
+        for(unsigned order = 0; order < MEM_BUDDY_ORDERS; ++order) {
+            pool_mgr->buddy->heads[order] = MEM_GAP_IX_NIL;
+        }
+        
+    }
+    
+}
+
+static alloc_status _mem_fill_pool(pool_mgr_pt pool_mgr) {
+    
+    // The first node, for the whole pool
+    const node_pt node = _add_node(pool_mgr, NULL);
+    
+    if(node == NULL) {
+        return ALLOC_FAIL;
+    }
+    
+    // Configure the node
+    node->alloc_record.mem = pool_mgr->pool.mem;
+    node->alloc_record.size = pool_mgr->pool.total_size;
+    node->next = MEM_NODE_NIL;
+    node->prev = MEM_NODE_NIL;
+    node->used = 1;
+    node->allocated = 1;
+    
+    _mem_map_node(pool_mgr, node);
+    
+    // Add the gap (BUDDY needs it cut into power-of-two blocks)
+    if(pool_mgr->pool.policy == BUDDY) {
+        return _buddy_carve(pool_mgr, node);
+    }
+    
+    return _add_gap(pool_mgr, node);
+    
+}
+
+static alloc_status _mem_check_flags(size_t size, alloc_policy policy, unsigned flags) {
+    
+    if((unsigned) policy > STACK || (flags & ~POOL_ALL_FLAGS) != 0) {
+        return ALLOC_FAIL;
+    }
+    
+    // ARENA and STACK pools only bump a pointer, none of the options but
+    // growing and those for the pool memory apply
+    if((policy == ARENA || policy == STACK) && (flags & ~(POOL_GROW | POOL_MMAP | POOL_HUGE_PAGES | POOL_PREFAULT)) != 0) {
+        return ALLOC_FAIL;
+    }
+    
+    // Boundary-tag pools place blocks with TLSF lists (slab runs would need
+    // nodes, and the last block can't take in more pool)
+    if((flags & POOL_BOUNDARY_TAGS) && (policy != TLSF || (flags & (POOL_SLAB | POOL_GAP_SCAN | POOL_GROW)))) {
+        return ALLOC_FAIL;
+    }
+    
+    // Only the policies that search the gaps by address or size scan them
+    if((flags & POOL_GAP_SCAN) && policy != FIRST_FIT && policy != NEXT_FIT && policy != BEST_FIT) {
+        return ALLOC_FAIL;
+    }
+    
+    // Compact pools walk their list for FIRST_FIT and BEST_FIT fits, and
+    // only take the options for the pool memory (slab runs and scanned gaps
+    // need the full nodes, and a grown pool could outgrow the offsets)
+    if((flags & POOL_COMPACT) && ((policy != FIRST_FIT && policy != BEST_FIT) || size > MEM_COMPACT_MAX_SIZE
+                                  || (flags & ~(POOL_COMPACT | POOL_MMAP | POOL_HUGE_PAGES | POOL_PREFAULT)))) {
+        return ALLOC_FAIL;
+    }
+    
+    return ALLOC_OK;
+    
+}
+
+static char *_mem_alloc_pool_mem(pool_mgr_pt pool_mgr, size_t size, unsigned flags) {
+    
+    if(size > SIZE_MAX - (MEM_POOL_ALIGN - 1)) {
+        return NULL;
+    }
+    
+    size_t rounded = (size + MEM_POOL_ALIGN - 1) & ~(MEM_POOL_ALIGN - 1);
+    
+    if(rounded == 0) {
+        rounded = MEM_POOL_ALIGN;
+    }
+    
+    pool_mgr->page_size = (size_t) sysconf(_SC_PAGESIZE);
+    
+    if((flags & (POOL_MMAP | POOL_HUGE_PAGES | POOL_GROW)) == 0) {
+        
+        char *mem = (char *) aligned_alloc(MEM_POOL_ALIGN, rounded);
+        
+        if(mem && (flags & POOL_PREFAULT)) {
+            _mem_prefault(pool_mgr, mem, size);
+        }
+        
+        return mem;
+        
+    }
+    
+    // A growing pool reserves the address space to grow into up front and
+    // only makes the start of it accessible, so the pool never moves and
+    // the regions it adds are contiguous
+    size_t reserve = 0;
+    
+    if(flags & POOL_GROW) {
+        
+        reserve = (rounded <= MEM_POOL_GROW_MAX_RESERVE / (MEM_POOL_GROW_LIMIT - 1)) ? rounded * (MEM_POOL_GROW_LIMIT - 1) : MEM_POOL_GROW_MAX_RESERVE;
+        
+        if(reserve < MEM_POOL_GROW_MIN_RESERVE) {
+            reserve = MEM_POOL_GROW_MIN_RESERVE;
+        }
+        
+    }
+    
+    if(rounded > SIZE_MAX - reserve - 2 * MEM_HUGE_PAGE_SIZE) {
+        return NULL;
+    }
+    
+    const size_t length = rounded + reserve;
+    
+    // mmap can fault the pages in itself, one after the other
+    const int populate = (flags & POOL_PREFAULT) && MEM_MAP_POPULATE && reserve == 0 && _mem_prefault_threads(size) == 1;
+    
+#if defined(MAP_HUGETLB) && defined(MEM_MAP_HUGE_2MB)
+    // Pages from the 2 MiB huge page pool, if the system has some set aside
+    // (not for a growing pool, it makes pages accessible a region at a time)
+    if((flags & POOL_HUGE_PAGES) && reserve == 0) {
+        
+        const size_t hugeLength = (length + MEM_HUGE_PAGE_SIZE - 1) & ~(MEM_HUGE_PAGE_SIZE - 1);
+        
+        char *mem = (char *) mmap(NULL, hugeLength, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MEM_MAP_HUGE_2MB | (populate ? MEM_MAP_POPULATE : 0), -1, 0);
+        
+        if(mem != (char *) MAP_FAILED) {
+            
+            pool_mgr->mapped = hugeLength;
+            pool_mgr->page_size = MEM_HUGE_PAGE_SIZE;
+            
+            if((flags & POOL_PREFAULT) && !populate) {
+                _mem_prefault(pool_mgr, mem, size);
+            }
+            
+            return mem;
+            
+        }
+        
+    }
+#endif
+    
+    // Map a huge page more than needed, then unmap what is below the first
+    // huge page boundary and what is above the pool
+    char *map = (char *) mmap(NULL, length + MEM_HUGE_PAGE_SIZE, reserve ? PROT_NONE : PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | (reserve ? MAP_NORESERVE : 0) | (populate ? MEM_MAP_POPULATE : 0), -1, 0);
+    
+    if(map == (char *) MAP_FAILED) {
+        return NULL;
+    }
+    
+    char *mem = (char *) (((uintptr_t) map + MEM_HUGE_PAGE_SIZE - 1) & ~(uintptr_t) (MEM_HUGE_PAGE_SIZE - 1));
+    
+    if(mem > map) {
+        munmap(map, (size_t) (mem - map));
+    }
+    
+    const size_t page = pool_mgr->page_size;
+    
+    char *const end = map + ((length + MEM_HUGE_PAGE_SIZE + page - 1) & ~(page - 1));
+    char *const top = mem + ((length + page - 1) & ~(page - 1));
+    
+    if(end > top) {
+        munmap(top, (size_t) (end - top));
+    }
+    
+    if(reserve && mprotect(mem, rounded, PROT_READ | PROT_WRITE) != 0) {
+        
+        munmap(mem, length);
+        
+        return NULL;
+        
+    }
+    
+#ifdef MADV_HUGEPAGE
+    // Otherwise transparent huge pages, where the kernel has them enabled
+    // (failing that, the pool has regular pages)
+    if(flags & POOL_HUGE_PAGES) {
+        madvise(mem, length, MADV_HUGEPAGE);
+    }
+#endif
+    
+    pool_mgr->mapped = length;
+    pool_mgr->reserved = reserve ? length : 0;
+    
+    // Only the pool as opened, for a growing pool
+    if((flags & POOL_PREFAULT) && !populate) {
+        _mem_prefault(pool_mgr, mem, size);
+    }
+    
+    return mem;
+    
+}
+
+static alloc_status _mem_free_pool_mem(pool_mgr_pt pool_mgr) {
+    
+    int result = 0;
+    
+    // A file-backed pool's mapping starts with the file header, and closing
+    // the file lets another pool open it
+    if(pool_mgr->file) {
+        
+        result = munmap(pool_mgr->file, pool_mgr->mapped);
+        close(pool_mgr->file_fd);
+        
+    } else if(pool_mgr->mapped) {
+        
+        result = munmap(pool_mgr->pool.mem, pool_mgr->mapped);
+        
+    } else {
+        
+        free(pool_mgr->pool.mem);
+        
+    }
+    
+    return (result == 0) ? ALLOC_OK : ALLOC_FAIL;
+    
+}
+
+static pool_file_pt _mem_map_pool_file(pool_mgr_pt pool_mgr, const char *path, size_t size, int *created) {
+    
+    // The pool memory starts on the first MEM_POOL_ALIGN boundary after the
+    // header
+    const size_t header = (sizeof(pool_file_t) + MEM_POOL_ALIGN - 1) & ~(MEM_POOL_ALIGN - 1);
+    
+    const int fd = open(path, O_RDWR | O_CREAT, 0600);
+    
+    if(fd < 0) {
+        return NULL;
+    }
+    
+    // Open in another pool (here or in another process), it would be
+    // mapped twice, and its records pointed at the wrong mapping
+    if(flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        
+        close(fd);
+        
+        return NULL;
+        
+    }
+    
+    struct stat st;
+    
+    if(fstat(fd, &st) != 0) {
+        
+        close(fd);
+        
+        return NULL;
+        
+    }
+    
+    // Whatever a short file doesn't have reads as zeros
+    pool_file_t stored;
+    
+    memset(&stored, 0, sizeof(pool_file_t));
+    
+    if(st.st_size != 0 && pread(fd, &stored, sizeof(pool_file_t), 0) < 0) {
+        
+        close(fd);
+        
+        return NULL;
+        
+    }
+    
+    size_t length;
+    
+    // An empty file is a new pool, and so is one with a blank header: the
+    // header is only written once the pool is set up, so that is a create
+    // that failed or was cut short (or a file sized with zeros beforehand)
+    static const pool_file_t blank;
+    
+    *created = memcmp(&stored, &blank, sizeof(pool_file_t)) == 0;
+    
+    if(*created) {
+        
+        // Big enough to hold one block, the file is all zeros until it is
+        // set up (a file that was sized already is sized again)
+        if((size & MEM_TAG_SIZE_MASK) < sizeof(tag_t) || size > SIZE_MAX - header - (MEM_POOL_ALIGN - 1)) {
+            
+            close(fd);
+            
+            return NULL;
+            
+        }
+        
+        length = header + ((size + MEM_POOL_ALIGN - 1) & ~(MEM_POOL_ALIGN - 1));
+        
+        if((off_t) length < 0 || ftruncate(fd, (off_t) length) != 0) {
+            
+            close(fd);
+            
+            return NULL;
+            
+        }
+        
+    } else {
+        
+        // The header tells where to map the file, check that it is a pool
+        // file laid out like this one
+        if(st.st_size < (off_t) header || stored.magic != MEM_POOL_FILE_MAGIC || stored.version != MEM_POOL_FILE_VERSION
+           || stored.header_size != header || stored.policy != TLSF
+           || stored.total_size > (size_t) st.st_size - header || stored.tags.end > stored.total_size
+           || stored.tags.end < sizeof(tag_t) || (stored.tags.end & ~MEM_TAG_SIZE_MASK) != 0) {
+            
+            close(fd);
+            
+            return NULL;
+            
+        }
+        
+        length = (size_t) st.st_size;
+        
+    }
+    
+    void *const hint = *created ? NULL : (void *) stored.base;
+    
+    char *map = (char *) mmap(hint, length, PROT_READ | PROT_WRITE, MAP_SHARED | (hint ? MEM_MAP_FIXED_NOREPLACE : 0), fd, 0);
+    
+    // Taken, the file goes wherever there is room
+    if(map == (char *) MAP_FAILED && hint) {
+        map = (char *) mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    
+    if(map == (char *) MAP_FAILED) {
+        
+        close(fd);
+        
+        return NULL;
+        
+    }
+    
+    pool_mgr->file_fd = fd;
+    pool_mgr->mapped = length;
+    pool_mgr->page_size = (size_t) sysconf(_SC_PAGESIZE);
+    pool_mgr->pool.mem = map + header;
+    
+    return (pool_file_pt) map;
+    
+}
+
+static unsigned _mem_prefault_threads(size_t size) {
+    
+    size_t threads = size / MEM_PREFAULT_SLICE;
+    
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    
+    if(cpus > 0 && threads > (size_t) cpus) {
+        threads = (size_t) cpus;
+    }
+    
+    if(threads > MEM_PREFAULT_MAX_THREADS) {
+        threads = MEM_PREFAULT_MAX_THREADS;
+    }
+    
+    return threads ? (unsigned) threads : 1;
+    
+}
+
+static void *_mem_prefault_slice(void *slice) {
+    
+    const prefault_slice_pt pages = (prefault_slice_pt) slice;
+    
+    // A write, so that the page is the pool's own and not the shared zero
+    // page (nothing in the pool is kept yet)
+    for(volatile char *page = pages->mem; page < pages->end; page += pages->page_size) {
+        *page = 0;
+    }
+    
+    return NULL;
+    
+}
+
+static void _mem_prefault(pool_mgr_pt pool_mgr, char *mem, size_t size) {
+    
+    const unsigned threads = _mem_prefault_threads(size);
+    
+    const size_t pages = (size + pool_mgr->page_size - 1) / pool_mgr->page_size;
+    
+    prefault_slice_t slices[MEM_PREFAULT_MAX_THREADS];
+    
+    pthread_t workers[MEM_PREFAULT_MAX_THREADS];
+    
+    int started[MEM_PREFAULT_MAX_THREADS] = {0};
+    
+    // The same number of pages to each thread, this one takes the first
+    // slice, and any a thread couldn't be started for
+    for(unsigned t = 0; t < threads; ++t) {
+        
+        slices[t].mem = mem + pages * t / threads * pool_mgr->page_size;
+        slices[t].end = mem + pages * (t + 1) / threads * pool_mgr->page_size;
+        slices[t].page_size = pool_mgr->page_size;
+        
+        if(t > 0) {
+            started[t] = (pthread_create(&workers[t], NULL, _mem_prefault_slice, &slices[t]) == 0);
+        }
+        
+    }
+    
+    for(unsigned t = 0; t < threads; ++t) {
+        
+        if(started[t]) {
+            
+            pthread_join(workers[t], NULL);
+            
+        } else {
+            
+            _mem_prefault_slice(&slices[t]);
+            
+        }
+        
+    }
+    
+}
+
+static double _mem_now_ms() {
+    
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return (double) ts.tv_sec * 1e3 + (double) ts.tv_nsec / 1e6;
+    
+}
+
+static alloc_status _mem_grow(pool_mgr_pt pool_mgr, size_t size) {
+    
+    // Only a POOL_GROW pool has room to grow into
+    if(pool_mgr->reserved == 0) {
+        return ALLOC_FAIL;
+    }
+    
+    const size_t total = pool_mgr->pool.total_size;
+    
+    // Add at least as much as the pool has, so that a pool filled up one
+    // allocation at a time grows a logarithmic number of times
+    size_t grow = (size > total) ? size : total;
+    
+    if(grow < MEM_POOL_ALIGN) {
+        grow = MEM_POOL_ALIGN;
+    }
+    
+    if(grow > pool_mgr->reserved - total) {
+        grow = pool_mgr->reserved - total;
+    }
+    
+    if(grow == 0 || grow < size) {
+        return ALLOC_FAIL;
+    }
+    
+    // Make the new region accessible (its first page may be already)
+    const size_t page = pool_mgr->page_size;
+    
+    const size_t from = (total + page - 1) & ~(page - 1);
+    const size_t to = (total + grow + page - 1) & ~(page - 1);
+    
+    if(to > from && mprotect(pool_mgr->pool.mem + from, to - from, PROT_READ | PROT_WRITE) != 0) {
+        return ALLOC_FAIL;
+    }
+    
+    // ARENA and STACK pools just have a higher end for the top
+    if(pool_mgr->arena) {
+        
+        pool_mgr->pool.total_size += grow;
+        
+        return ALLOC_OK;
+        
+    }
+    
+    // The page map covers the new pages too
+    const size_t pages = (total >> MEM_PAGE_SHIFT) + 1;
+    const size_t newPages = ((total + grow) >> MEM_PAGE_SHIFT) + 1;
+    
+    node_pt *map = (node_pt *) realloc(pool_mgr->page_map, newPages * sizeof(node_pt));
+    
+    if(map == NULL) {
+        return ALLOC_FAIL;
+    }
+    
+    memset(map + pages, 0, (newPages - pages) * sizeof(node_pt));
+    
+    pool_mgr->page_map = map;
+    
+    return _mem_grow_nodes(pool_mgr, grow);
+    
+}
+
+static alloc_status _mem_grow_nodes(pool_mgr_pt pool_mgr, size_t size) {
+    
+    const size_t total = pool_mgr->pool.total_size;
+    
+    // Find the last segment, the new region goes after it. The first page
+    // always has a segment starting in it.
+    size_t page = total >> MEM_PAGE_SHIFT;
+    
+    while(pool_mgr->page_map[page] == NULL) {
+        --page;
+    }
+    
+    node_pt last = pool_mgr->page_map[page];
+    
+    while(last->next != MEM_NODE_NIL) {
+        last = _mem_node_next(pool_mgr, last);
+    }
+    
+    pool_mgr->pool.total_size += size;
+    
+    // BUDDY blocks have to stay aligned to their size, so the new region is
+    // carved from the end of the last block, taking in the piece below the
+    // smallest block size there (which is never handed out)
+    size_t offset = total;
+    
+    node_pt tail = NULL;
+    
+    if(pool_mgr->pool.policy == BUDDY && last->allocated == 0 && (last->alloc_record.size >> MEM_BUDDY_MIN_ORDER) == 0) {
+        
+        _remove_gap(pool_mgr, last->gap);
+        
+        offset -= last->alloc_record.size;
+        
+        tail = last;
+        
+    }
+    
+    const size_t start = offset;
+    
+    // Add the region as allocated blocks (one, unless BUDDY) ...
+    node_pt first = NULL;
+    node_pt node = last;
+    
+    while(offset < pool_mgr->pool.total_size) {
+        
+        const size_t remaining = pool_mgr->pool.total_size - offset;
+        
+        size_t block = remaining;
+        
+        if(pool_mgr->pool.policy == BUDDY && (remaining >> MEM_BUDDY_MIN_ORDER)) {
+            
+            block = (size_t) 1 << _mem_log2(remaining);
+            
+            if(offset != 0 && (offset & -offset) < block) {
+                block = offset & -offset;
+            }
+            
+        }
+        
+        if(first == NULL && tail != NULL) {
+            
+            node = tail;
+            
+        } else {
+            
+            const node_pt next = _add_node(pool_mgr, node);
+            
+            if(next == NULL) {
+                
+                // Take the blocks back out, the pool is as it was
+                while(first != NULL && node != first) {
+                    
+                    const node_pt prev = _mem_node_prev(pool_mgr, node);
+                    
+                    _remove_node(pool_mgr, node);
+                    
+                    node = prev;
+                    
+                }
+                
+                if(first != NULL && first != tail) {
+                    _remove_node(pool_mgr, first);
+                }
+                
+                pool_mgr->pool.total_size = total;
+                
+                if(tail != NULL) {
+                    
+                    tail->allocated = 0;
+                    tail->alloc_record.size = total - start;
+                    
+                    _mem_add_to_gap_ix(pool_mgr, tail->alloc_record.size, tail);
+                    
+                }
+                
+                return ALLOC_FAIL;
+                
+            }
+            
+            next->alloc_record.mem = pool_mgr->pool.mem + offset;
+            next->used = 1;
+            
+            _mem_map_node(pool_mgr, next);
+            
+            node = next;
+            
+        }
+        
+        node->allocated = 1;
+        node->alloc_record.size = block;
+        
+        if(first == NULL) {
+            first = node;
+        }
+        
+        offset += block;
+        
+    }
+    
+    // ... and free them from the top down, each merges with what is free
+    // above it and the first also with what is free below
+    while(1) {
+        
+        const node_pt prev = _mem_node_prev(pool_mgr, node);
+        
+        const int done = (node == first);
+        
+        alloc_status status;
+        
+        if(pool_mgr->pool.policy == BUDDY && (node->alloc_record.size >> MEM_BUDDY_MIN_ORDER) == 0) {
+            
+            node->allocated = 0;
+            
+            status = _mem_add_to_gap_ix(pool_mgr, node->alloc_record.size, node);
+            
+        } else {
+            
+            status = _add_gap(pool_mgr, node);
+            
+        }
+        
+        if(status != ALLOC_OK) {
+            return ALLOC_FAIL;
+        }
+        
+        if(done) {
+            return ALLOC_OK;
+        }
+        
+        node = prev;
+        
+    }
+    
+}
+
+static alloc_status _mem_release(pool_mgr_pt pool_mgr, const char *mem, size_t size, size_t keep) {
+    
+    // The first keep bytes stay, and the pages the segment only partly
+    // covers, which hold someone else's data
+    if(size <= keep) {
+        return ALLOC_OK;
+    }
+    
+    const uintptr_t page = (uintptr_t) pool_mgr->page_size;
+    
+    const uintptr_t from = ((uintptr_t) mem + keep + page - 1) & ~(page - 1);
+    const uintptr_t to = ((uintptr_t) mem + size) & ~(page - 1);
+    
+    if(to <= from) {
+        return ALLOC_OK;
+    }
+    
+    // The range stays mapped, its pages read as zeros once they are dropped
+    // (as the file has them, for a file-backed pool)
+    return (madvise((void *) from, to - from, MADV_DONTNEED) == 0) ? ALLOC_OK : ALLOC_FAIL;
+    
+}
+
+static alloc_status _mem_resize_node_heap(pool_mgr_pt pool_mgr) {
+    
+    // Is there room left in the last chunk?
+    if(pool_mgr->used_nodes < pool_mgr->total_nodes) {
+        
+        // YES, do nothing
+        return ALLOC_OK;
+        
+    }
+    
+    // Node positions have to fit a node's index
+    if(pool_mgr->total_nodes > MEM_NODE_MAX - MEM_NODE_CHUNK_SIZE) {
+        
+        printf("Failed to resize node heap.\r\n");
+        return ALLOC_FAIL;
+        
+    }
+    
+    // Is the chunk table full? It only holds pointers, so it may move
+    if(pool_mgr->node_chunks == pool_mgr->node_chunks_capacity) {
+        
+        // We'll use a temporary pointer, in the event that the realloc call fails
+        
+        node_pt *bob = (node_pt *) realloc(pool_mgr->node_heap, pool_mgr->node_chunks_capacity * MEM_NODE_HEAP_EXPAND_FACTOR * sizeof(node_pt));
+        
+        // Did the realloc call succeed?
+        if(bob == NULL) {
+            
+            // Return NULL on failure
+            printf("Failed to resize node heap.\r\n");
+            return ALLOC_FAIL;
+            
+        }
+        
+        pool_mgr->node_heap = bob;
+        pool_mgr->node_chunks_capacity *= MEM_NODE_HEAP_EXPAND_FACTOR;
+        
+    }
+    
+    // Add a chunk, the nodes handed out so far stay where they are
+    const node_pt chunk = (node_pt) calloc(MEM_NODE_CHUNK_SIZE, sizeof(node_t));
+    
+    if(chunk == NULL) {
+        
+        printf("Failed to resize node heap.\r\n");
+        return ALLOC_FAIL;
+        
+    }
+    
+    pool_mgr->node_heap[pool_mgr->node_chunks] = chunk;
+    
+    ++(pool_mgr->node_chunks);
+    
+    pool_mgr->total_nodes += MEM_NODE_CHUNK_SIZE;
+    
+    return ALLOC_OK;
+    
+}
+
+static node_pt _mem_node_at(pool_mgr_pt pool_mgr, unsigned index) {
+    
+    return &(pool_mgr->node_heap[index / MEM_NODE_CHUNK_SIZE][index % MEM_NODE_CHUNK_SIZE]);
+    
+}
+
+static node_pt _mem_node_next(pool_mgr_pt pool_mgr, node_pt node) {
+    
+    return (node->next != MEM_NODE_NIL) ? _mem_node_at(pool_mgr, node->next) : NULL;
+    
+}
+
+static node_pt _mem_node_prev(pool_mgr_pt pool_mgr, node_pt node) {
+    
+    return (node->prev != MEM_NODE_NIL) ? _mem_node_at(pool_mgr, node->prev) : NULL;
+    
+}
+
+/*
+ * Page map: for every page of the pool, the lowest addressed node that
+ * starts in it. A segment is then found from any address in it by going
+ * to the page and walking the list over the segments starting there.
+ */
+
+static void _mem_map_node(pool_mgr_pt pool_mgr, node_pt node) {
+    
+    const size_t page = (size_t) (node->alloc_record.mem - pool_mgr->pool.mem) >> MEM_PAGE_SHIFT;
+    
+    node_pt *entry = &(pool_mgr->page_map[page]);
+    
+    if(*entry == NULL || (*entry)->alloc_record.mem > node->alloc_record.mem) {
+        
+        *entry = node;
+        
+    } else if((*entry)->alloc_record.mem == node->alloc_record.mem) {
+        
+        // Zero-size segments start where the next one does, the first of
+        // them in the list is the one the page starts with
+        for(node_pt later = _mem_node_next(pool_mgr, node);
+            later != NULL && later->alloc_record.mem == node->alloc_record.mem;
+            later = _mem_node_next(pool_mgr, later)) {
+            
+            if(later == *entry) {
+                
+                *entry = node;
+                
+                break;
+                
+            }
+            
+        }
+        
+    }
+    
+}
+
+static void _mem_unmap_node(pool_mgr_pt pool_mgr, node_pt node) {
+    
+    const size_t page = (size_t) (node->alloc_record.mem - pool_mgr->pool.mem) >> MEM_PAGE_SHIFT;
+    
+    node_pt *entry = &(pool_mgr->page_map[page]);
+    
+    if(*entry != node) {
+        return;
+    }
+    
+    // The next segment takes over the page, if it starts in it
+    const node_pt next = _mem_node_next(pool_mgr, node);
+    
+    if(next != NULL && (size_t) (next->alloc_record.mem - pool_mgr->pool.mem) >> MEM_PAGE_SHIFT == page) {
+        
+        *entry = next;
+        
+    } else {
+        
+        *entry = NULL;
+        
+    }
+    
+}
+
+static node_pt _mem_find_node(pool_mgr_pt pool_mgr, const char *mem) {
+    
+    if(mem < pool_mgr->pool.mem || mem >= pool_mgr->pool.mem + pool_mgr->pool.total_size) {
+        return NULL;
+    }
+    
+    size_t page = (size_t) (mem - pool_mgr->pool.mem) >> MEM_PAGE_SHIFT;
+    
+    node_pt node = pool_mgr->page_map[page];
+    
+    // Nothing starts in the page below mem, so the segment started in an
+    // earlier page. Only slab runs are looked up from the middle, so don't
+    // look further back than the largest run.
+    if(node == NULL || node->alloc_record.mem > mem) {
+        
+        if(node != NULL) {
+            return _mem_node_prev(pool_mgr, node);
+        }
+        
+        const size_t lowest = (page > (MEM_SLAB_MAX_SIZE * MEM_SLAB_OBJECTS >> MEM_PAGE_SHIFT)) ?
+                              page - (MEM_SLAB_MAX_SIZE * MEM_SLAB_OBJECTS >> MEM_PAGE_SHIFT) : 0;
+        
+        while(node == NULL && page > lowest) {
+            node = pool_mgr->page_map[--page];
+        }
+        
+        if(node == NULL) {
+            return NULL;
+        }
+        
+    }
+    
+    // Walk up to the last segment that starts at or below mem
+    for(node_pt next = _mem_node_next(pool_mgr, node); next != NULL && next->alloc_record.mem <= mem; next = _mem_node_next(pool_mgr, next)) {
+        node = next;
+    }
+    
+    return node;
+    
+}
+
+static alloc_status _mem_resize_gap_ix(pool_mgr_pt pool_mgr) {
+    
+    // Are too many gaps in use?
+    if(pool_mgr->pool.num_gaps < pool_mgr->gap_ix_capacity * MEM_GAP_IX_FILL_FACTOR) {
+        
+        // NO, do nothing
+        return ALLOC_OK;
+        
+    }
+    
+    // We'll use a temporary pointer, in the event that the realloc call fails
+    
+    gap_pt bob = (gap_pt) realloc(pool_mgr->gap_ix, pool_mgr->gap_ix_capacity * MEM_GAP_IX_EXPAND_FACTOR * sizeof(gap_t));
+    
+    // Did the realloc call succeed?
+    if(bob == NULL) {
+        
+        // Return NULL on failure
+        printf("Failed to resize gap index.\r\n");
+        return ALLOC_FAIL;
+        
+    } else {
+        
+        // Assign bob to the pool_store
+        pool_mgr->gap_ix = bob;
+        
+    }
+    
+    // Same for the scan arrays, the capacity only grows once all of them have
+    if(pool_mgr->gap_sizes == NULL) {
+        
+        pool_mgr->gap_ix_capacity *= MEM_GAP_IX_EXPAND_FACTOR;
+        
+        return ALLOC_OK;
+        
+    }
+    
+    size_t *sizes = (size_t *) realloc(pool_mgr->gap_sizes, pool_mgr->gap_ix_capacity * MEM_GAP_IX_EXPAND_FACTOR * sizeof(size_t));
+    
+    if(sizes == NULL) {
+        
+        printf("Failed to resize gap index.\r\n");
+        return ALLOC_FAIL;
+        
+    }
+    
+    pool_mgr->gap_sizes = sizes;
+    
+    size_t *starts = (size_t *) realloc(pool_mgr->gap_starts, pool_mgr->gap_ix_capacity * MEM_GAP_IX_EXPAND_FACTOR * sizeof(size_t));
+    
+    if(starts == NULL) {
+        
+        printf("Failed to resize gap index.\r\n");
+        return ALLOC_FAIL;
+        
+    }
+    
+    pool_mgr->gap_starts = starts;
+    
+    unsigned *slots = (unsigned *) realloc(pool_mgr->gap_slots, pool_mgr->gap_ix_capacity * MEM_GAP_IX_EXPAND_FACTOR * sizeof(unsigned));
+    
+    if(slots == NULL) {
+        
+        printf("Failed to resize gap index.\r\n");
+        return ALLOC_FAIL;
+        
+    }
+    
+    pool_mgr->gap_slots = slots;
+    
+    // Modify the pool_store_capacity to match the new size
+    pool_mgr->gap_ix_capacity *= MEM_GAP_IX_EXPAND_FACTOR;
+    
+    return ALLOC_OK;
+    
+}
+
+static alloc_status _mem_add_to_gap_ix(pool_mgr_pt pool_mgr, size_t size, node_pt node) {
+    
+    // expand the gap index, if necessary (call the function)
+    if(_mem_resize_gap_ix(pool_mgr) != ALLOC_OK) {
+        
+        // Return ALLOC_FAIL on failure to resize
+        return ALLOC_FAIL;
+        
+    }
+    
+    // add the entry at the end
+    // update metadata (num_gaps)
+    const unsigned gap = (pool_mgr->pool.num_gaps)++;
+    
+    pool_mgr->gap_ix[gap].size = size;
+    pool_mgr->gap_ix[gap].node = node;
+    
+    node->gap = gap;
+    
+    // hang it in the gap tree (or on its TLSF list)
+    _gap_ix_link(pool_mgr, gap);
+    
+    return ALLOC_OK;
+    
+}
+
+static alloc_status _mem_remove_from_gap_ix(pool_mgr_pt pool_mgr, size_t size, node_pt node) {
+    
+    // find the position of the node in the gap index
+    const unsigned gap = _mem_find_gap_ix(pool_mgr, size, node);
+    
+    if(gap == MEM_GAP_IX_NIL) {
+        
+        // No such gap
+        printf("Failed to find gap in gap index.\r\n");
+        return ALLOC_FAIL;
+        
+    }
+    
+    return _remove_gap(pool_mgr, gap);
+    
+}
+
+static alloc_status _mem_update_gap_ix(pool_mgr_pt pool_mgr, unsigned gap, size_t size, node_pt node) {
+    
+    // The key changes, so the gap has to be re-hung in the index, unless
+    // it is scanned and keeps its place in the arrays
+    const int rehang = pool_mgr->gap_sizes == NULL || !_gap_scan_update(pool_mgr, gap, size, node);
+    
+    if(rehang) {
+        _gap_ix_unlink(pool_mgr, gap);
+    }
+    
+    pool_mgr->gap_ix[gap].size = size;
+    pool_mgr->gap_ix[gap].node = node;
+    
+    node->gap = gap;
+    
+    if(rehang) {
+        _gap_ix_link(pool_mgr, gap);
+    }
+    
+    return ALLOC_OK;
+    
+}
+
+/*
+ * The gap index is a dense array of gap_t (num_gaps long) threaded into an
+ * AVL tree ordered by (size, address), or by address alone for FIRST_FIT
+ * and NEXT_FIT.
+ * Links are array positions rather than pointers, so the array can still be
+ * grown with realloc(). Every entry also tracks the largest gap in its
+ * subtree, which lets the address-ordered tree answer first-fit queries.
+ */
+
+static int _gap_compare(pool_mgr_pt pool_mgr, size_t size, const char *mem, unsigned gap) {
+    
+    const gap_pt other = &(pool_mgr->gap_ix[gap]);
+    
+    // FIRST_FIT and NEXT_FIT order by address alone
+    if(pool_mgr->pool.policy == BEST_FIT && size != other->size) {
+        return (size < other->size) ? -1 : 1;
+    }
+    
+    if(mem != other->node->alloc_record.mem) {
+        return (mem < other->node->alloc_record.mem) ? -1 : 1;
+    }
+    
+    return 0;
+    
+}
+
+static unsigned _gap_height(pool_mgr_pt pool_mgr, unsigned gap) {
+    
+    return (gap == MEM_GAP_IX_NIL) ? 0 : pool_mgr->gap_ix[gap].height;
+    
+}
+
+static size_t _gap_max_size(pool_mgr_pt pool_mgr, unsigned gap) {
+    
+    return (gap == MEM_GAP_IX_NIL) ? 0 : pool_mgr->gap_ix[gap].max_size;
+    
+}
+
+static void _gap_update(pool_mgr_pt pool_mgr, unsigned gap) {
+    
+    const gap_pt entry = &(pool_mgr->gap_ix[gap]);
+    
+    const unsigned left = _gap_height(pool_mgr, entry->left);
+    const unsigned right = _gap_height(pool_mgr, entry->right);
+    
+    entry->height = 1 + ((left > right) ? left : right);
+    
+    // Recompute the largest gap below (and including) this one
+    const size_t leftMax = _gap_max_size(pool_mgr, entry->left);
+    const size_t rightMax = _gap_max_size(pool_mgr, entry->right);
+    
+    entry->max_size = entry->size;
+    
+    if(leftMax > entry->max_size) {
+        entry->max_size = leftMax;
+    }
+    
+    if(rightMax > entry->max_size) {
+        entry->max_size = rightMax;
+    }
+    
+}
+
+static void _gap_replace_child(pool_mgr_pt pool_mgr, unsigned parent, unsigned oldChild, unsigned newChild) {
+    
+    if(parent == MEM_GAP_IX_NIL) {
+        
+        pool_mgr->gap_ix_root = newChild;
+        
+    } else if(pool_mgr->gap_ix[parent].left == oldChild) {
+        
+        pool_mgr->gap_ix[parent].left = newChild;
+        
+    } else {
+        
+        pool_mgr->gap_ix[parent].right = newChild;
+        
+    }
+    
+    if(newChild != MEM_GAP_IX_NIL) {
+        pool_mgr->gap_ix[newChild].parent = parent;
+    }
+    
+}
+
+static unsigned _gap_rotate_left(pool_mgr_pt pool_mgr, unsigned gap) {
+    
+    const unsigned pivot = pool_mgr->gap_ix[gap].right;
+    const unsigned inner = pool_mgr->gap_ix[pivot].left;
+    
+    _gap_replace_child(pool_mgr, pool_mgr->gap_ix[gap].parent, gap, pivot);
+    
+    pool_mgr->gap_ix[gap].right = inner;
+    
+    if(inner != MEM_GAP_IX_NIL) {
+        pool_mgr->gap_ix[inner].parent = gap;
+    }
+    
+    pool_mgr->gap_ix[pivot].left = gap;
+    pool_mgr->gap_ix[gap].parent = pivot;
+    
+    _gap_update(pool_mgr, gap);
+    _gap_update(pool_mgr, pivot);
+    
+    return pivot;
+    
+}
+
+static unsigned _gap_rotate_right(pool_mgr_pt pool_mgr, unsigned gap) {
+    
+    const unsigned pivot = pool_mgr->gap_ix[gap].left;
+    const unsigned inner = pool_mgr->gap_ix[pivot].right;
+    
+    _gap_replace_child(pool_mgr, pool_mgr->gap_ix[gap].parent, gap, pivot);
+    
+    pool_mgr->gap_ix[gap].left = inner;
+    
+    if(inner != MEM_GAP_IX_NIL) {
+        pool_mgr->gap_ix[inner].parent = gap;
+    }
+    
+    pool_mgr->gap_ix[pivot].right = gap;
+    pool_mgr->gap_ix[gap].parent = pivot;
+    
+    _gap_update(pool_mgr, gap);
+    _gap_update(pool_mgr, pivot);
+    
+    return pivot;
+    
+}
+
+static void _gap_rebalance(pool_mgr_pt pool_mgr, unsigned gap) {
+    
+    // Walk up to the root fixing heights and rotating where it's lopsided
+    while(gap != MEM_GAP_IX_NIL) {
+        
+        const unsigned left = pool_mgr->gap_ix[gap].left;
+        const unsigned right = pool_mgr->gap_ix[gap].right;
+        
+        const int balance = (int) _gap_height(pool_mgr, left) - (int) _gap_height(pool_mgr, right);
+        
+        if(balance > 1) {
+            
+            if(_gap_height(pool_mgr, pool_mgr->gap_ix[left].left) < _gap_height(pool_mgr, pool_mgr->gap_ix[left].right)) {
+                _gap_rotate_left(pool_mgr, left);
+            }
+            
+            gap = _gap_rotate_right(pool_mgr, gap);
+            
+        } else if(balance < -1) {
+            
+            if(_gap_height(pool_mgr, pool_mgr->gap_ix[right].right) < _gap_height(pool_mgr, pool_mgr->gap_ix[right].left)) {
+                _gap_rotate_right(pool_mgr, right);
+            }
+            
+            gap = _gap_rotate_left(pool_mgr, gap);
+            
+        } else {
+            
+            _gap_update(pool_mgr, gap);
+            
+        }
+        
+        gap = pool_mgr->gap_ix[gap].parent;
+        
+    }
+    
+}
+
+static void _gap_tree_relocate(pool_mgr_pt pool_mgr, unsigned from, unsigned to) {
+    
+    const gap_pt moved = &(pool_mgr->gap_ix[to]);
+    
+    if(moved->parent == MEM_GAP_IX_NIL) {
+        
+        pool_mgr->gap_ix_root = to;
+        
+    } else if(pool_mgr->gap_ix[moved->parent].left == from) {
+        
+        pool_mgr->gap_ix[moved->parent].left = to;
+        
+    } else {
+        
+        pool_mgr->gap_ix[moved->parent].right = to;
+        
+    }
+    
+    if(moved->left != MEM_GAP_IX_NIL) {
+        pool_mgr->gap_ix[moved->left].parent = to;
+    }
+    
+    if(moved->right != MEM_GAP_IX_NIL) {
+        pool_mgr->gap_ix[moved->right].parent = to;
+    }
+    
+}
+
+static void _gap_tree_insert(pool_mgr_pt pool_mgr, unsigned gap) {
+    
+    const gap_pt entry = &(pool_mgr->gap_ix[gap]);
+    
+    entry->left = MEM_GAP_IX_NIL;
+    entry->right = MEM_GAP_IX_NIL;
+    entry->height = 1;
+    entry->max_size = entry->size;
+    
+    // Find the spot to hang the new leaf from
+    unsigned parent = MEM_GAP_IX_NIL;
+    unsigned current = pool_mgr->gap_ix_root;
+    int direction = 0;
+    
+    while(current != MEM_GAP_IX_NIL) {
+        
+        parent = current;
+        direction = _gap_compare(pool_mgr, entry->size, entry->node->alloc_record.mem, current);
+        
+        current = (direction < 0) ? pool_mgr->gap_ix[current].left : pool_mgr->gap_ix[current].right;
+        
+    }
+    
+    entry->parent = parent;
+    
+    if(parent == MEM_GAP_IX_NIL) {
+        
+        pool_mgr->gap_ix_root = gap;
+        
+    } else if(direction < 0) {
+        
+        pool_mgr->gap_ix[parent].left = gap;
+        
+    } else {
+        
+        pool_mgr->gap_ix[parent].right = gap;
+        
+    }
+    
+    _gap_rebalance(pool_mgr, parent);
+    
+}
+
+static void _gap_tree_unlink(pool_mgr_pt pool_mgr, unsigned gap) {
+    
+    const gap_pt entry = &(pool_mgr->gap_ix[gap]);
+    
+    // Where the rebalancing has to start from
+    unsigned start;
+    
+    if(entry->left == MEM_GAP_IX_NIL) {
+        
+        start = entry->parent;
+        _gap_replace_child(pool_mgr, entry->parent, gap, entry->right);
+        
+    } else if(entry->right == MEM_GAP_IX_NIL) {
+        
+        start = entry->parent;
+        _gap_replace_child(pool_mgr, entry->parent, gap, entry->left);
+        
+    } else {
+        
+        // Two children, the in-order successor takes this gap's place
+        unsigned successor = entry->right;
+        
+        while(pool_mgr->gap_ix[successor].left != MEM_GAP_IX_NIL) {
+            successor = pool_mgr->gap_ix[successor].left;
+        }
+        
+        const gap_pt next = &(pool_mgr->gap_ix[successor]);
+        
+        if(next->parent != gap) {
+            
+            start = next->parent;
+            
+            _gap_replace_child(pool_mgr, next->parent, successor, next->right);
+            
+            next->right = entry->right;
+            pool_mgr->gap_ix[next->right].parent = successor;
+            
+        } else {
+            
+            start = successor;
+            
+        }
+        
+        _gap_replace_child(pool_mgr, entry->parent, gap, successor);
+        
+        next->left = entry->left;
+        pool_mgr->gap_ix[next->left].parent = successor;
+        next->height = entry->height;
+        
+    }
+    
+    entry->parent = entry->left = entry->right = MEM_GAP_IX_NIL;
+    
+    _gap_rebalance(pool_mgr, start);
+    
+}
+
+static unsigned _mem_find_gap_ix(pool_mgr_pt pool_mgr, size_t size, node_pt node) {
+    
+    unsigned current = pool_mgr->gap_ix_root;
+    
+    while(current != MEM_GAP_IX_NIL) {
+        
+        const int direction = _gap_compare(pool_mgr, size, node->alloc_record.mem, current);
+        
+        if(direction == 0) {
+            return current;
+        }
+        
+        current = (direction < 0) ? pool_mgr->gap_ix[current].left : pool_mgr->gap_ix[current].right;
+        
+    }
+    
+    return MEM_GAP_IX_NIL;
+    
+}
+
+static unsigned _mem_find_best_fit(pool_mgr_pt pool_mgr, size_t size) {
+    
+    // Leftmost gap of at least size bytes: the smallest one that fits,
+    // and the lowest addressed one among equals
+    unsigned best = MEM_GAP_IX_NIL;
+    unsigned current = pool_mgr->gap_ix_root;
+    
+    while(current != MEM_GAP_IX_NIL) {
+        
+        if(pool_mgr->gap_ix[current].size >= size) {
+            
+            best = current;
+            current = pool_mgr->gap_ix[current].left;
+            
+        } else {
+            
+            current = pool_mgr->gap_ix[current].right;
+            
+        }
+        
+    }
+    
+    return best;
+    
+}
+
+static unsigned _gap_subtree_first_fit(pool_mgr_pt pool_mgr, unsigned current, size_t size) {
+    
+    // Lowest addressed gap of at least size bytes, steering by the subtree
+    // maxima: go left whenever something on the left fits
+    if(_gap_max_size(pool_mgr, current) < size) {
+        return MEM_GAP_IX_NIL;
+    }
+    
+    while(current != MEM_GAP_IX_NIL) {
+        
+        const gap_pt entry = &(pool_mgr->gap_ix[current]);
+        
+        if(entry->left != MEM_GAP_IX_NIL && _gap_max_size(pool_mgr, entry->left) >= size) {
+            
+            current = entry->left;
+            
+        } else if(entry->size >= size) {
+            
+            return current;
+            
+        } else {
+            
+            current = entry->right;
+            
+        }
+        
+    }
+    
+    return MEM_GAP_IX_NIL;
+    
+}
+
+static unsigned _mem_find_first_fit(pool_mgr_pt pool_mgr, size_t size) {
+    
+    return _gap_subtree_first_fit(pool_mgr, pool_mgr->gap_ix_root, size);
+    
+}
+
+static unsigned _gap_subtree_next_fit(pool_mgr_pt pool_mgr, unsigned current, size_t size, const char *cursor) {
+    
+    // Gaps don't overlap, so they end in address order too: skip right
+    // past the ones that end at or below the cursor
+    while(current != MEM_GAP_IX_NIL && _gap_max_size(pool_mgr, current) >= size) {
+        
+        const gap_pt entry = &(pool_mgr->gap_ix[current]);
+        
+        if(entry->node->alloc_record.mem + entry->size <= cursor) {
+            
+            current = entry->right;
+            
+            continue;
+            
+        }
+        
+        // This gap and all of its right subtree end above the cursor,
+        // only the left subtree still needs the bound
+        const unsigned left = _gap_subtree_next_fit(pool_mgr, entry->left, size, cursor);
+        
+        if(left != MEM_GAP_IX_NIL) {
+            return left;
+        }
+        
+        if(entry->size >= size) {
+            return current;
+        }
+        
+        return _gap_subtree_first_fit(pool_mgr, entry->right, size);
+        
+    }
+    
+    return MEM_GAP_IX_NIL;
+    
+}
+
+static unsigned _mem_find_next_fit(pool_mgr_pt pool_mgr, size_t size) {
+    
+    // First fit among the gaps that end above the cursor, which starts
+    // with the gap the cursor is in, then wrap around to the bottom
+    const unsigned gap = _gap_subtree_next_fit(pool_mgr, pool_mgr->gap_ix_root, size, pool_mgr->cursor);
+    
+    return (gap != MEM_GAP_IX_NIL) ? gap : _mem_find_first_fit(pool_mgr, size);
+    
+}
+
+/*
+ * Gap lists: TLSF and BUDDY pools keep their gaps on doubly-linked lists
+ * instead of the tree. The links are positions in gap_ix, like the tree's.
+ */
+
+static void _gap_list_push(pool_mgr_pt pool_mgr, unsigned *head, unsigned gap) {
+    
+    const gap_pt entry = &(pool_mgr->gap_ix[gap]);
+    
+    // Push on the front of the list
+    entry->prev_gap = MEM_GAP_IX_NIL;
+    entry->next_gap = *head;
+    
+    if(entry->next_gap != MEM_GAP_IX_NIL) {
+        pool_mgr->gap_ix[entry->next_gap].prev_gap = gap;
+    }
+    
+    *head = gap;
+    
+}
+
+static void _gap_list_remove(pool_mgr_pt pool_mgr, unsigned *head, unsigned gap) {
+    
+    const gap_pt entry = &(pool_mgr->gap_ix[gap]);
+    
+    if(entry->prev_gap != MEM_GAP_IX_NIL) {
+        
+        pool_mgr->gap_ix[entry->prev_gap].next_gap = entry->next_gap;
+        
+    } else {
+        
+        *head = entry->next_gap;
+        
+    }
+    
+    if(entry->next_gap != MEM_GAP_IX_NIL) {
+        pool_mgr->gap_ix[entry->next_gap].prev_gap = entry->prev_gap;
+    }
+    
+    entry->prev_gap = entry->next_gap = MEM_GAP_IX_NIL;
+    
+}
+
+static void _gap_list_relocate(pool_mgr_pt pool_mgr, unsigned *head, unsigned to) {
+    
+    const gap_pt moved = &(pool_mgr->gap_ix[to]);
+    
+    if(moved->prev_gap != MEM_GAP_IX_NIL) {
+        
+        pool_mgr->gap_ix[moved->prev_gap].next_gap = to;
+        
+    } else {
+        
+        *head = to;
+        
+    }
+    
+    if(moved->next_gap != MEM_GAP_IX_NIL) {
+        pool_mgr->gap_ix[moved->next_gap].prev_gap = to;
+    }
+    
+}
+
+static unsigned _mem_log2(size_t size) {
+    
+    return 63 - (unsigned) __builtin_clzll((unsigned long long) size);
+    
+}
+
+/*
+ * TLSF (two-level segregated fit): one gap list per size class. The first
+ * level splits sizes by power of two, the second splits each power of two
+ * into MEM_TLSF_SL_COUNT linear steps. Two levels of bitmaps tell which
+ * lists are non-empty, so finding a gap that fits is a couple of bit scans,
+ * no matter how many gaps there are.
+ */
+
+static void _tlsf_mapping(size_t size, unsigned *fl, unsigned *sl) {
+    
+    // Small sizes all go to the first class, one list per byte
+    if(size < MEM_TLSF_SL_COUNT) {
+        
+        *fl = 0;
+        *sl = (unsigned) size;
+        
+        return;
+        
+    }
+    
+    const unsigned msb = _mem_log2(size);
+    
+    *fl = msb - MEM_TLSF_SL_LOG2 + 1;
+    *sl = (unsigned) (size >> (msb - MEM_TLSF_SL_LOG2)) ^ MEM_TLSF_SL_COUNT;
+    
+}
+
+static void _tlsf_insert(pool_mgr_pt pool_mgr, unsigned gap) {
+    
+    const tlsf_pt tlsf = pool_mgr->tlsf;
+    
+    unsigned fl, sl;
+    _tlsf_mapping(pool_mgr->gap_ix[gap].size, &fl, &sl);
+    
+    _gap_list_push(pool_mgr, &(tlsf->heads[fl][sl]), gap);
+    
+    tlsf->fl_bitmap |= (uint64_t) 1 << fl;
+    tlsf->sl_bitmap[fl] |= (uint32_t) 1 << sl;
+    
+}
+
+static void _tlsf_unlink(pool_mgr_pt pool_mgr, unsigned gap) {
+    
+    const tlsf_pt tlsf = pool_mgr->tlsf;
+    
+    unsigned fl, sl;
+    _tlsf_mapping(pool_mgr->gap_ix[gap].size, &fl, &sl);
+    
+    _gap_list_remove(pool_mgr, &(tlsf->heads[fl][sl]), gap);
+    
+    // Was it the last gap of its class?
+    if(tlsf->heads[fl][sl] == MEM_GAP_IX_NIL) {
+        
+        tlsf->sl_bitmap[fl] &= ~((uint32_t) 1 << sl);
+        
+        if(tlsf->sl_bitmap[fl] == 0) {
+            tlsf->fl_bitmap &= ~((uint64_t) 1 << fl);
+        }
+        
+    }
+    
+}
+
+static void _tlsf_relocate(pool_mgr_pt pool_mgr, unsigned to) {
+    
+    unsigned fl, sl;
+    _tlsf_mapping(pool_mgr->gap_ix[to].size, &fl, &sl);
+    
+    _gap_list_relocate(pool_mgr, &(pool_mgr->tlsf->heads[fl][sl]), to);
+    
+}
+
+/*
+ * BUDDY: blocks are powers of two, aligned to their size within the pool,
+ * with one free list per order. Allocated blocks are not in the index.
+ * The sub-minimum tail of a pool whose size isn't a multiple of the
+ * smallest block is a gap on no list.
+ */
+
+static size_t _buddy_block_size(size_t size) {
+    
+    if(size <= ((size_t) 1 << MEM_BUDDY_MIN_ORDER)) {
+        return (size_t) 1 << MEM_BUDDY_MIN_ORDER;
+    }
+    
+    const unsigned order = _mem_log2(size - 1) + 1;
+    
+    // 0 if it doesn't fit in a size_t
+    return (order < MEM_BUDDY_ORDERS) ? (size_t) 1 << order : 0;
+    
+}
+
+static void _buddy_insert(pool_mgr_pt pool_mgr, unsigned gap) {
+    
+    const size_t size = pool_mgr->gap_ix[gap].size;
+    
+    if(size >> MEM_BUDDY_MIN_ORDER) {
+        
+        const unsigned order = _mem_log2(size);
+        
+        _gap_list_push(pool_mgr, &(pool_mgr->buddy->heads[order]), gap);
+        
+        pool_mgr->buddy->bitmap |= (uint64_t) 1 << order;
+        
+    } else {
+        
+        // The unusable tail, on no list
+        pool_mgr->gap_ix[gap].prev_gap = pool_mgr->gap_ix[gap].next_gap = MEM_GAP_IX_NIL;
+        
+    }
+    
+}
+
+static void _buddy_unlink(pool_mgr_pt pool_mgr, unsigned gap) {
+    
+    const size_t size = pool_mgr->gap_ix[gap].size;
+    
+    if(size >> MEM_BUDDY_MIN_ORDER) {
+        
+        const unsigned order = _mem_log2(size);
+        
+        _gap_list_remove(pool_mgr, &(pool_mgr->buddy->heads[order]), gap);
+        
+        if(pool_mgr->buddy->heads[order] == MEM_GAP_IX_NIL) {
+            pool_mgr->buddy->bitmap &= ~((uint64_t) 1 << order);
+        }
+        
+    }
+    
+}
+
+static void _buddy_relocate(pool_mgr_pt pool_mgr, unsigned to) {
+    
+    const size_t size = pool_mgr->gap_ix[to].size;
+    
+    if(size >> MEM_BUDDY_MIN_ORDER) {
+        _gap_list_relocate(pool_mgr, &(pool_mgr->buddy->heads[_mem_log2(size)]), to);
+    }
+    
+}
+
+static alloc_status _tlsf_search(uint64_t fl_bitmap, const uint32_t *sl_bitmap, size_t size, unsigned *fl, unsigned *sl) {
+    
+    // Round the request up to the next class boundary, so that anything
+    // on the class list (or above it) is large enough
+    if(size >= MEM_TLSF_SL_COUNT) {
+        
+        const size_t round = ((size_t) 1 << (_mem_log2(size) - MEM_TLSF_SL_LOG2)) - 1;
+        
+        if(size > SIZE_MAX - round) {
+            return ALLOC_FAIL;
+        }
+        
+        size += round;
+        
+    }
+    
+    _tlsf_mapping(size, fl, sl);
+    
+    // Anything left in this first-level class?
+    uint32_t slMap = sl_bitmap[*fl] & (~(uint32_t) 0 << *sl);
+    
+    if(slMap == 0) {
+        
+        // No, take the smallest non-empty class above it
+        const uint64_t flMap = (*fl + 1 < MEM_TLSF_FL_COUNT) ? fl_bitmap & (~(uint64_t) 0 << (*fl + 1)) : 0;
+        
+        if(flMap == 0) {
+            return ALLOC_FAIL;
+        }
+        
+        *fl = (unsigned) __builtin_ctzll(flMap);
+        slMap = sl_bitmap[*fl];
+        
+    }
+    
+    *sl = (unsigned) __builtin_ctz(slMap);
+    
+    return ALLOC_OK;
+    
+}
+
+static unsigned _mem_find_good_fit(pool_mgr_pt pool_mgr, size_t size) {
+    
+    const tlsf_pt tlsf = pool_mgr->tlsf;
+    
+    unsigned fl, sl;
+    
+    if(_tlsf_search(tlsf->fl_bitmap, tlsf->sl_bitmap, size, &fl, &sl) != ALLOC_OK) {
+        return MEM_GAP_IX_NIL;
+    }
+    
+    return tlsf->heads[fl][sl];
+    
+}
+
+/*
+ * Slabs (POOL_SLAB pools): requests up to MEM_SLAB_MAX_SIZE are rounded up
+ * to one of MEM_SLAB_CLASSES size classes and served from runs of
+ * MEM_SLAB_OBJECTS objects of that class. A run is a single allocation as
+ * far as the node heap and the gap index go; its objects are handed out
+ * from a bitmap, with the records kept in the slab descriptor.
+ */
+
+static unsigned _slab_class(size_t size) {
+    
+    // 16-byte steps up to 128, then four steps per power of two
+    if(size <= 128) {
+        return size ? (unsigned) ((size - 1) >> 4) : 0;
+    }
+    
+    const unsigned msb = _mem_log2(size - 1);
+    
+    return 8 + (msb - 7) * 4 + (unsigned) ((size - 1) >> (msb - 2)) - 4;
+    
+}
+
+static size_t _slab_class_size(unsigned size_class) {
+    
+    if(size_class < 8) {
+        return (size_t) (size_class + 1) << 4;
+    }
+    
+    const unsigned msb = 7 + (size_class - 8) / 4;
+    
+    return (size_t) (5 + (size_class - 8) % 4) << (msb - 2);
+    
+}
+
+static void _slab_push(pool_mgr_pt pool_mgr, slab_pt slab) {
+    
+    slab_pt *head = &(pool_mgr->slabs->partial[slab->size_class]);
+    
+    slab->prev = NULL;
+    slab->next = *head;
+    
+    if(slab->next) {
+        slab->next->prev = slab;
+    }
+    
+    *head = slab;
+    
+}
+
+static void _slab_unlink(pool_mgr_pt pool_mgr, slab_pt slab) {
+    
+    if(slab->prev) {
+        
+        slab->prev->next = slab->next;
+        
+    } else {
+        
+        pool_mgr->slabs->partial[slab->size_class] = slab->next;
+        
+    }
+    
+    if(slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    
+    slab->prev = slab->next = NULL;
+    
+}
+
+static slab_pt _slab_create(pool_mgr_pt pool_mgr, unsigned size_class) {
+    
+    // The descriptor has to fit the alignment, records are found by masking
+    assert(sizeof(slab_t) <= MEM_SLAB_ALIGN);
+    
+    const slab_cache_pt slabs = pool_mgr->slabs;
+    
+    // Make room in the run table first, nothing to undo if that fails
+    if(slabs->num_runs == slabs->runs_capacity) {
+        
+        const unsigned capacity = slabs->runs_capacity ? slabs->runs_capacity * MEM_SLAB_RUNS_EXPAND_FACTOR : MEM_SLAB_RUNS_INIT_CAPACITY;
+        
+        slab_pt *runs = (slab_pt *) realloc(slabs->runs, capacity * sizeof(slab_pt));
+        
+        if(runs == NULL) {
+            return NULL;
+        }
+        
+        slabs->runs = runs;
+        slabs->runs_capacity = capacity;
+        
+    }
+    
+    const slab_pt slab = (slab_pt) aligned_alloc(MEM_SLAB_ALIGN, MEM_SLAB_ALIGN);
+    
+    if(slab == NULL) {
+        return NULL;
+    }
+    
+    const size_t size = _slab_class_size(size_class);
+    
+    // Carve the run out of the pool like any other allocation, aligned so
+    // that every object is aligned to the largest power of two in its size
+    const node_pt node = _mem_alloc_node_aligned(pool_mgr, size * MEM_SLAB_OBJECTS, size & -size);
+    
+    if(node == NULL) {
+        
+        free(slab);
+        
+        return NULL;
+        
+    }
+    
+    slab->node = node;
+    
+    slabs->runs[slabs->num_runs] = slab;
+    node->slab = ++(slabs->num_runs);
+    
+    slab->mem = node->alloc_record.mem;
+    slab->size = size;
+    slab->size_class = size_class;
+    slab->free_mask = ~(uint64_t) 0;
+    
+    _slab_push(pool_mgr, slab);
+    
+    return slab;
+    
+}
+
+static alloc_status _slab_destroy(pool_mgr_pt pool_mgr, slab_pt slab) {
+    
+    _slab_unlink(pool_mgr, slab);
+    
+    // Fill its spot in the run table with the last run
+    const slab_cache_pt slabs = pool_mgr->slabs;
+    const slab_pt last = slabs->runs[--(slabs->num_runs)];
+    
+    slabs->runs[slab->node->slab - 1] = last;
+    last->node->slab = slab->node->slab;
+    
+    slab->node->slab = 0;
+    
+    // Give the run back to the pool
+    const alloc_status status = _add_gap(pool_mgr, slab->node);
+    
+    free(slab);
+    
+    return status;
+    
+}
+
+static alloc_pt _slab_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    
+    const unsigned size_class = _slab_class(size);
+    
+    slab_pt slab = pool_mgr->slabs->partial[size_class];
+    
+    // Nothing free in this class, start a new run
+    if(slab == NULL) {
+        
+        slab = _slab_create(pool_mgr, size_class);
+        
+        if(slab == NULL) {
+            return NULL;
+        }
+        
+    }
+    
+    // Take the lowest free object
+    const unsigned object = (unsigned) __builtin_ctzll(slab->free_mask);
+    
+    slab->free_mask &= slab->free_mask - 1;
+    
+    // Full slabs leave the list until something is freed
+    if(slab->free_mask == 0) {
+        _slab_unlink(pool_mgr, slab);
+    }
+    
+    const alloc_pt alloc = &(slab->records[object]);
+    
+    alloc->mem = slab->mem + object * slab->size;
+    alloc->size = size;
+    
+    return alloc;
+    
+}
+
+static alloc_status _slab_free(pool_mgr_pt pool_mgr, alloc_pt alloc) {
+    
+    const slab_pt slab = (slab_pt) ((uintptr_t) alloc & ~(uintptr_t) (MEM_SLAB_ALIGN - 1));
+    
+    const unsigned object = (unsigned) (alloc - slab->records);
+    
+    // A full slab has room again, put it back on the list
+    if(slab->free_mask == 0) {
+        _slab_push(pool_mgr, slab);
+    }
+    
+    slab->free_mask |= (uint64_t) 1 << object;
+    
+    // Give empty runs back, but keep the last one of the class around so
+    // that alloc/free cycles don't go through the gap index every time
+    if(slab->free_mask == ~(uint64_t) 0 && (slab->prev || slab->next)) {
+        return _slab_destroy(pool_mgr, slab);
+    }
+    
+    return ALLOC_OK;
+    
+}
+
+static void _slab_release_empty(pool_mgr_pt pool_mgr) {
+    
+    for(unsigned size_class = 0; size_class < MEM_SLAB_CLASSES; ++size_class) {
+        
+        slab_pt slab = pool_mgr->slabs->partial[size_class];
+        
+        while(slab) {
+            
+            const slab_pt next = slab->next;
+            
+            if(slab->free_mask == ~(uint64_t) 0) {
+                _slab_destroy(pool_mgr, slab);
+            }
+            
+            slab = next;
+            
+        }
+        
+    }
+    
+}
+
+/*
+ * Boundary tags (POOL_BOUNDARY_TAGS pools): every segment is a block in
+ * the pool memory, starting with a tag_t header. The allocation record
+ * handed out is in the header, and the previous block's footer (its size,
+ * written only while it is free) is the first field of the header, so both
+ * neighbours of a block are found by pointer arithmetic. Free blocks are
+ * kept on TLSF segregated lists, linked through their headers.
+ */
+
+static tag_pt _tag_at(pool_mgr_pt pool_mgr, size_t offset) {
+    
+    return (offset == MEM_TAG_NIL) ? NULL : (tag_pt) (pool_mgr->pool.mem + offset);
+    
+}
+
+static size_t _tag_offset(pool_mgr_pt pool_mgr, tag_pt tag) {
+    
+    return (tag == NULL) ? MEM_TAG_NIL : (size_t) ((char *) tag - pool_mgr->pool.mem);
+    
+}
+
+static tag_pt _tag_next(pool_mgr_pt pool_mgr, tag_pt tag) {
+    
+    const tag_pt next = (tag_pt) ((char *) tag + (tag->size & MEM_TAG_SIZE_MASK));
+    
+    return ((char *) next < pool_mgr->pool.mem + pool_mgr->tags->end) ? next : NULL;
+    
+}
+
+static void _tag_insert(pool_mgr_pt pool_mgr, tag_pt tag) {
+    
+    const tag_index_pt tags = pool_mgr->tags;
+    
+    unsigned fl, sl;
+    _tlsf_mapping(tag->size & MEM_TAG_SIZE_MASK, &fl, &sl);
+    
+    // Push on the front of the class list
+    const size_t offset = _tag_offset(pool_mgr, tag);
+    
+    tag->prev_free = MEM_TAG_NIL;
+    tag->next_free = tags->heads[fl][sl];
+    
+    if(tag->next_free != MEM_TAG_NIL) {
+        _tag_at(pool_mgr, tag->next_free)->prev_free = offset;
+    }
+    
+    tags->heads[fl][sl] = offset;
+    
+    tags->fl_bitmap |= (uint64_t) 1 << fl;
+    tags->sl_bitmap[fl] |= (uint32_t) 1 << sl;
+    
+    ++(pool_mgr->pool.num_gaps);
+    
+}
+
+static void _tag_unlink(pool_mgr_pt pool_mgr, tag_pt tag) {
+    
+    const tag_index_pt tags = pool_mgr->tags;
+    
+    unsigned fl, sl;
+    _tlsf_mapping(tag->size & MEM_TAG_SIZE_MASK, &fl, &sl);
+    
+    if(tag->prev_free != MEM_TAG_NIL) {
+        
+        _tag_at(pool_mgr, tag->prev_free)->next_free = tag->next_free;
+        
+    } else {
+        
+        tags->heads[fl][sl] = tag->next_free;
+        
+    }
+    
+    if(tag->next_free != MEM_TAG_NIL) {
+        _tag_at(pool_mgr, tag->next_free)->prev_free = tag->prev_free;
+    }
+    
+    // Was it the last block of its class?
+    if(tags->heads[fl][sl] == MEM_TAG_NIL) {
+        
+        tags->sl_bitmap[fl] &= ~((uint32_t) 1 << sl);
+        
+        if(tags->sl_bitmap[fl] == 0) {
+            tags->fl_bitmap &= ~((uint64_t) 1 << fl);
+        }
+        
+    }
+    
+    --(pool_mgr->pool.num_gaps);
+    
+}
+
+static void _tag_make_free(pool_mgr_pt pool_mgr, tag_pt tag, size_t size) {
+    
+    // The block below a free block is always allocated, or it would have merged
+    tag->size = size | MEM_TAG_PREV_ALLOCATED;
+    
+    // Write the footer, and tell the block above
+    const tag_pt next = _tag_next(pool_mgr, tag);
+    
+    if(next) {
+        
+        next->prev_size = size;
+        next->size &= ~MEM_TAG_PREV_ALLOCATED;
+        
+    }
+    
+    _tag_insert(pool_mgr, tag);
+    
+}
+
+static alloc_status _tag_open(pool_mgr_pt pool_mgr) {
+    
+    // Blocks are multiples of MEM_TAG_ALIGN, a shorter tail is never used
+    const size_t size = pool_mgr->pool.total_size & MEM_TAG_SIZE_MASK;
+    
+    // Too small to hold even a header
+    if(size < sizeof(tag_t)) {
+        return ALLOC_FAIL;
+    }
+    
+    // A file-backed pool has its lists in the file header already
+    if(pool_mgr->tags == NULL) {
+        
+        pool_mgr->tags = (tag_index_pt) calloc(1, sizeof(tag_index_t));
+        
+        if(pool_mgr->tags == NULL) {
+            return ALLOC_FAIL;
+        }
+        
+    }
+    
+    pool_mgr->tags->end = size;
+    
+    _tag_reset(pool_mgr);
+    
+    return ALLOC_OK;
+    
+}
+
+static void _tag_empty_lists(pool_mgr_pt pool_mgr) {
+    
+    const tag_index_pt tags = pool_mgr->tags;
+    
+    // The end stays
+    tags->fl_bitmap = 0;
+    
+    memset(tags->sl_bitmap, 0, sizeof(tags->sl_bitmap));
+    for(unsigned fl = 0; fl < MEM_TLSF_FL_COUNT; ++fl) {
+        for(unsigned sl = 0; sl < MEM_TLSF_SL_COUNT; ++sl) {
+            tags->heads[fl][sl] = MEM_TAG_NIL;
+        }
+    }
+    
+}
+
+static void _tag_reset(pool_mgr_pt pool_mgr) {
+    
+    const tag_index_pt tags = pool_mgr->tags;
+    
+    _tag_empty_lists(pool_mgr);
+    
+    // One free block over the whole pool
+    const tag_pt tag = (tag_pt) pool_mgr->pool.mem;
+    
+    tag->prev_size = 0;
+    
+    _tag_make_free(pool_mgr, tag, tags->end);
+    
+}
+
+static alloc_status _tag_restore(pool_mgr_pt pool_mgr) {
+    
+    const tag_index_pt tags = pool_mgr->tags;
+    
+    // Check every block before changing any: no state bits but ours, room
+    // for a header (and the record's size), and within the end (which is
+    // aligned, so the last block ends right there)
+    for(size_t at = 0; at < tags->end; ) {
+        
+        const tag_pt tag = (tag_pt) (pool_mgr->pool.mem + at);
+        
+        const size_t size = tag->size & MEM_TAG_SIZE_MASK;
+        
+        if((tag->size & ~MEM_TAG_SIZE_MASK & ~(MEM_TAG_ALLOCATED | MEM_TAG_PREV_ALLOCATED)) != 0
+           || size < sizeof(tag_t) || size > tags->end - at
+           || ((tag->size & MEM_TAG_ALLOCATED) && tag->alloc_record.size > size - sizeof(tag_t))) {
+            return ALLOC_FAIL;
+        }
+        
+        at += size;
+        
+    }
+    
+    pool_mgr->pool.alloc_size = 0;
+    pool_mgr->pool.num_allocs = 0;
+    pool_mgr->pool.num_gaps = 0;
+    
+    // The lists are rebuilt from the blocks, they may be cut short by a
+    // split or a merge that never finished
+    _tag_empty_lists(pool_mgr);
+    
+    tag_pt run = NULL;
+    
+    size_t runSize = 0;
+    
+    for(tag_pt tag = (tag_pt) pool_mgr->pool.mem; tag != NULL; tag = _tag_next(pool_mgr, tag)) {
+        
+        if(tag->size & MEM_TAG_ALLOCATED) {
+            
+            // The free blocks below become one, which tells this one
+            if(run) {
+                
+                _tag_make_free(pool_mgr, run, runSize);
+                
+                run = NULL;
+                
+            } else {
+                
+                tag->size |= MEM_TAG_PREV_ALLOCATED;
+                
+            }
+            
+            // The record is pointed back at its block's memory, wherever
+            // the file is mapped now
+            tag->alloc_record.mem = (char *) tag + sizeof(tag_t);
+            
+            pool_mgr->pool.alloc_size += tag->alloc_record.size;
+            ++(pool_mgr->pool.num_allocs);
+            
+        } else {
+            
+            if(run == NULL) {
+                
+                run = tag;
+                
+                runSize = 0;
+                
+            }
+            
+            runSize += tag->size & MEM_TAG_SIZE_MASK;
+            
+        }
+        
+    }
+    
+    if(run) {
+        _tag_make_free(pool_mgr, run, runSize);
+    }
+    
+    return ALLOC_OK;
+    
+}
+
+static alloc_pt _tag_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    
+    const tag_index_pt tags = pool_mgr->tags;
+    
+    // Header and payload, rounded up to keep the blocks above aligned
+    if(size > SIZE_MAX - sizeof(tag_t) - (MEM_TAG_ALIGN - 1)) {
+        return NULL;
+    }
+    
+    const size_t block = (sizeof(tag_t) + size + MEM_TAG_ALIGN - 1) & MEM_TAG_SIZE_MASK;
+    
+    unsigned fl, sl;
+    
+    if(_tlsf_search(tags->fl_bitmap, tags->sl_bitmap, block, &fl, &sl) != ALLOC_OK) {
+        return NULL;
+    }
+    
+    const tag_pt tag = _tag_at(pool_mgr, tags->heads[fl][sl]);
+    
+    _tag_unlink(pool_mgr, tag);
+    
+    return _tag_place(pool_mgr, tag, block, size);
+    
+}
+
+static alloc_pt _tag_alloc_aligned(pool_mgr_pt pool_mgr, size_t size, size_t alignment) {
+    
+    const tag_index_pt tags = pool_mgr->tags;
+    
+    // The memory of every block is aligned this much anyway
+    if(alignment <= MEM_TAG_ALIGN) {
+        return _tag_alloc(pool_mgr, size);
+    }
+    
+    if(size > SIZE_MAX - 2 * sizeof(tag_t) - alignment - (MEM_TAG_ALIGN - 1)) {
+        return NULL;
+    }
+    
+    const size_t block = (sizeof(tag_t) + size + MEM_TAG_ALIGN - 1) & MEM_TAG_SIZE_MASK;
+    
+    // Worst case, the aligned block comes after a free block of padding that
+    // is a header and all but MEM_TAG_ALIGN of the alignment
+    unsigned fl, sl;
+    
+    if(_tlsf_search(tags->fl_bitmap, tags->sl_bitmap, block + sizeof(tag_t) + alignment - MEM_TAG_ALIGN, &fl, &sl) != ALLOC_OK) {
+        return NULL;
+    }
+    
+    tag_pt tag = _tag_at(pool_mgr, tags->heads[fl][sl]);
+    
+    _tag_unlink(pool_mgr, tag);
+    
+    size_t padding = (size_t) (-(uintptr_t) ((char *) tag + sizeof(tag_t)) & (alignment - 1));
+    
+    if(padding) {
+        
+        // The padding has to hold a header to be a block of its own
+        if(padding < sizeof(tag_t)) {
+            padding += alignment;
+        }
+        
+        // The padding stays free, the block below it is allocated
+        const tag_pt aligned = (tag_pt) ((char *) tag + padding);
+        
+        aligned->size = (tag->size & MEM_TAG_SIZE_MASK) - padding;
+        
+        _tag_make_free(pool_mgr, tag, padding);
+        
+        tag = aligned;
         
     }
     
-    // allocate the pool store with initial capacity
-    // Create room for MEM_POOL_STORE_INIT_CAPACITY pools
-    pool_store = (pool_mgr_pt *) calloc(MEM_POOL_STORE_INIT_CAPACITY, sizeof(pool_mgr_t));
+    return _tag_place(pool_mgr, tag, block, size);
     
-    // Did the malloc call succeed?
-    if(pool_store == NULL) {
+}
+
+static alloc_status _tag_alloc_batch(pool_mgr_pt pool_mgr, const size_t *sizes, alloc_pt *out, unsigned n) {
+    
+    const tag_index_pt tags = pool_mgr->tags;
+    
+    // The blocks, back to back, out of one free block
+    size_t total = 0;
+    
+    for(unsigned u = 0; u < n; ++u) {
         
-        // Return ALLOC_FAIL on failure
-        printf("Failed to allocate necessary memory.\r\n");
+        if(sizes[u] > SIZE_MAX - sizeof(tag_t) - (MEM_TAG_ALIGN - 1)) {
+            return ALLOC_FAIL;
+        }
+        
+        const size_t block = (sizeof(tag_t) + sizes[u] + MEM_TAG_ALIGN - 1) & MEM_TAG_SIZE_MASK;
+        
+        if(block > SIZE_MAX - total) {
+            return ALLOC_FAIL;
+        }
+        
+        total += block;
+        
+    }
+    
+    unsigned fl, sl;
+    
+    if(_tlsf_search(tags->fl_bitmap, tags->sl_bitmap, total, &fl, &sl) != ALLOC_OK) {
         return ALLOC_FAIL;
+    }
+    
+    tag_pt tag = _tag_at(pool_mgr, tags->heads[fl][sl]);
+    
+    _tag_unlink(pool_mgr, tag);
+    
+    size_t available = tag->size & MEM_TAG_SIZE_MASK;
+    
+    // All but the last one get exactly their block
+    for(unsigned u = 0; u + 1 < n; ++u) {
+        
+        const size_t block = (sizeof(tag_t) + sizes[u] + MEM_TAG_ALIGN - 1) & MEM_TAG_SIZE_MASK;
+        
+        tag->size = block | MEM_TAG_ALLOCATED | MEM_TAG_PREV_ALLOCATED;
+        
+        tag->alloc_record.size = sizes[u];
+        tag->alloc_record.mem = (char *) tag + sizeof(tag_t);
+        
+        out[u] = &(tag->alloc_record);
+        
+        available -= block;
+        
+        tag = (tag_pt) ((char *) tag + block);
         
     }
     
-    // Initialize the memory management system
-    // Set the size and capacity
-    pool_store_capacity = MEM_POOL_STORE_INIT_CAPACITY;
-    pool_store_size = 0;
+    // The last one is placed like a single allocation, splitting off the rest
+    tag->size = available | MEM_TAG_PREV_ALLOCATED;
     
-    // TODO ???
-    // Has the system already been initialized?
+    out[n - 1] = _tag_place(pool_mgr, tag, (sizeof(tag_t) + sizes[n - 1] + MEM_TAG_ALIGN - 1) & MEM_TAG_SIZE_MASK, sizes[n - 1]);
     
     return ALLOC_OK;
     
 }
 
-alloc_status mem_free() {
+static alloc_pt _tag_place(pool_mgr_pt pool_mgr, tag_pt tag, size_t block, size_t size) {
     
-    // ensure that it's called only once for each mem_init
-    if(pool_store == NULL) {
-        // TODO is this the right return status?
-        return ALLOC_CALLED_AGAIN;
-    }
+    const size_t available = tag->size & MEM_TAG_SIZE_MASK;
     
-    // make sure all pool managers have been deallocated
-    for(unsigned int i = 0; i < pool_store_size; ++i) {
+    // The state of the block below stays as it is
+    const size_t state = (tag->size & MEM_TAG_PREV_ALLOCATED) | MEM_TAG_ALLOCATED;
+    
+    if(available - block >= sizeof(tag_t)) {
         
-        // Free each pool currently in use
-        mem_pool_close((pool_pt) pool_store[i]);
+        // Split, the rest stays free
+        tag->size = block | state;
+        
+        _tag_make_free(pool_mgr, (tag_pt) ((char *) tag + block), available - block);
+        
+    } else {
+        
+        // Take all of it
+        tag->size = available | state;
+        
+        const tag_pt next = _tag_next(pool_mgr, tag);
+        
+        if(next) {
+            next->size |= MEM_TAG_PREV_ALLOCATED;
+        }
         
     }
     
-    // can free the pool store array
-    // Free the pool_store
-    free(pool_store);
+    tag->alloc_record.size = size;
+    tag->alloc_record.mem = (char *) tag + sizeof(tag_t);
     
-    // update static variables
-    pool_store = NULL;
-    pool_store_size = 0;
-    pool_store_capacity = 0;
+    return &(tag->alloc_record);
+    
+}
 
+static alloc_status _tag_free(pool_mgr_pt pool_mgr, alloc_pt alloc) {
+    
+    tag_pt tag = (tag_pt) ((char *) alloc - offsetof(tag_t, alloc_record));
+    
+    size_t size = tag->size & MEM_TAG_SIZE_MASK;
+    
+    // The root of a file-backed pool goes with its block
+    if(pool_mgr->file && pool_mgr->file->root == (size_t) (alloc->mem - pool_mgr->pool.mem)) {
+        pool_mgr->file->root = MEM_TAG_NIL;
+    }
+    
+    // Merge with the block above, if it is free
+    const tag_pt next = _tag_next(pool_mgr, tag);
+    
+    if(next && !(next->size & MEM_TAG_ALLOCATED)) {
+        
+        _tag_unlink(pool_mgr, next);
+        
+        size += next->size & MEM_TAG_SIZE_MASK;
+        
+    }
+    
+    // Merge with the block below, found through its footer, if it is free
+    if(!(tag->size & MEM_TAG_PREV_ALLOCATED)) {
+        
+        tag = (tag_pt) ((char *) tag - tag->prev_size);
+        
+        _tag_unlink(pool_mgr, tag);
+        
+        size += tag->size & MEM_TAG_SIZE_MASK;
+        
+    }
+    
+    _tag_make_free(pool_mgr, tag, size);
+    
     return ALLOC_OK;
     
 }
 
-pool_pt mem_pool_open(size_t size, alloc_policy policy) {
+static alloc_status _tag_resize(pool_mgr_pt pool_mgr, alloc_pt alloc, size_t size) {
     
-    // Make sure there the pool store is allocated
-    // Has the pool_store been initialized?
-    if(pool_store == NULL) {
+    const tag_pt tag = (tag_pt) ((char *) alloc - offsetof(tag_t, alloc_record));
+    
+    if(size > SIZE_MAX - sizeof(tag_t) - (MEM_TAG_ALIGN - 1)) {
+        return ALLOC_FAIL;
+    }
+    
+    const size_t block = (sizeof(tag_t) + size + MEM_TAG_ALIGN - 1) & MEM_TAG_SIZE_MASK;
+    
+    size_t available = tag->size & MEM_TAG_SIZE_MASK;
+    
+    // The free block above, if any, can be taken over
+    const tag_pt next = _tag_next(pool_mgr, tag);
+    const int nextIsFree = next != NULL && !(next->size & MEM_TAG_ALLOCATED);
+    
+    if(block > available && (!nextIsFree || available + (next->size & MEM_TAG_SIZE_MASK) < block)) {
+        return ALLOC_FAIL;
+    }
+    
+    if(nextIsFree) {
         
-        // I'm going to choose to go ahead and initialize it here
-        if(mem_init() != ALLOC_OK) {
-            return NULL;
-        }
+        _tag_unlink(pool_mgr, next);
+        
+        available += next->size & MEM_TAG_SIZE_MASK;
         
     }
     
-    // Expand the pool store, if necessary
-    // Do we need to grab more space?
-    if(_mem_resize_pool_store() != ALLOC_OK) {
+    // Keep the state bits, the block below hasn't changed
+    const size_t state = tag->size & ~MEM_TAG_SIZE_MASK;
+    
+    if(available - block >= sizeof(tag_t)) {
         
-        // Return NULL on failure to resize
-        return NULL;
+        // Split, the rest is free
+        tag->size = block | state;
+        
+        _tag_make_free(pool_mgr, (tag_pt) ((char *) tag + block), available - block);
+        
+    } else {
+        
+        // Keep all of it
+        tag->size = available | state;
+        
+        const tag_pt above = _tag_next(pool_mgr, tag);
+        
+        if(above) {
+            above->size |= MEM_TAG_PREV_ALLOCATED;
+        }
         
     }
     
-    // Allocate a new mem pool_mgr
-    // Create the pool
-    pool_mgr_pt pool_mgr = (pool_mgr_pt) calloc(1, sizeof(pool_mgr_t));
+    alloc->size = size;
     
-    // Check success, on error return null
-    // Did the calloc call succeed?
-    if(pool_mgr == NULL) {
-        
-        // It didn't :(
+    return ALLOC_OK;
+    
+}
+
+static alloc_pt _tag_find(pool_mgr_pt pool_mgr, const char *mem) {
+    
+    // Blocks are aligned, so the header of anything handed out is too
+    if(mem < pool_mgr->pool.mem + sizeof(tag_t) || mem > pool_mgr->pool.mem + pool_mgr->tags->end
+       || (size_t) (mem - pool_mgr->pool.mem) % MEM_TAG_ALIGN != 0) {
         return NULL;
-        
     }
     
-    // Initialize pool mgr
-    // Setup the public facing pool
-    pool_mgr->pool.alloc_size = 0;
-    pool_mgr->pool.total_size = size;
-    pool_mgr->pool.policy = policy;
-    pool_mgr->pool.num_gaps = 0;
-    pool_mgr->pool.num_allocs = 0;
+    const tag_pt tag = (tag_pt) (mem - sizeof(tag_t));
     
-    // Allocate a new memory pool
-    // Attempt to allocate the size requested
-    pool_mgr->pool.mem = (char*) malloc(size);
+    // Only take it if the header says so, and points back at the memory
+    if(!(tag->size & MEM_TAG_ALLOCATED) || tag->alloc_record.mem != mem) {
+        return NULL;
+    }
     
-    // check success, on error deallocate mgr and return null
-    // Did the malloc call succeed?
-    if(pool_mgr->pool.mem == NULL) {
+    return &(tag->alloc_record);
+    
+}
+
+static void _tag_inspect(pool_mgr_pt pool_mgr, pool_segment_pt segments, unsigned *num_segments) {
+    
+    unsigned currentSegment = 0;
+    
+    // Blocks are back to back, the size of one leads to the next
+    for(tag_pt tag = (tag_pt) pool_mgr->pool.mem; tag != NULL; tag = _tag_next(pool_mgr, tag)) {
         
-        // It didn't :(
+        segments[currentSegment].size = tag->size & MEM_TAG_SIZE_MASK;
+        segments[currentSegment].allocated = (tag->size & MEM_TAG_ALLOCATED) != 0;
         
-        free(pool_mgr);
+        ++currentSegment;
         
+    }
+    
+    *num_segments = currentSegment;
+    
+}
+
+/*
+ * Arena (ARENA and STACK pools): the blocks are placed one on top of the
+ * other, each starting with an arena_block_t header that holds the record
+ * handed out and a link to the block below. An allocation bumps the top,
+ * and nothing is reused until the top comes back down: when the last block
+ * is deallocated (along with any deallocated blocks right below it), or
+ * when the pool is rolled back to a mark. A STACK pool only deallocates
+ * the last block, so it never has deallocated blocks below the top.
+ */
+
+static alloc_status _arena_open(pool_mgr_pt pool_mgr) {
+    
+    pool_mgr->arena = (arena_pt) calloc(1, sizeof(arena_t));
+    
+    if(pool_mgr->arena == NULL) {
+        return ALLOC_FAIL;
+    }
+    
+    _arena_reset(pool_mgr);
+    
+    return ALLOC_OK;
+    
+}
+
+static void _arena_reset(pool_mgr_pt pool_mgr) {
+    
+    pool_mgr->arena->top = pool_mgr->pool.mem;
+    pool_mgr->arena->last = NULL;
+    
+    // The free space on top is the one gap
+    pool_mgr->pool.num_gaps = 1;
+    
+}
+
+static alloc_pt _arena_alloc(pool_mgr_pt pool_mgr, size_t size, size_t alignment) {
+    
+    const arena_pt arena = pool_mgr->arena;
+    
+    char *const end = pool_mgr->pool.mem + pool_mgr->pool.total_size;
+    
+    // The header goes right below the memory, which is aligned
+    const size_t offset = (size_t) (arena->top - pool_mgr->pool.mem) + sizeof(arena_block_t);
+    const size_t start = (offset + alignment - 1) & ~(alignment - 1);
+    
+    if(start < offset || start > pool_mgr->pool.total_size || size > (size_t) (end - (pool_mgr->pool.mem + start))) {
         return NULL;
+    }
+    
+    char *const mem = pool_mgr->pool.mem + start;
+    
+    const arena_block_pt block = (arena_block_pt) (mem - sizeof(arena_block_t));
+    
+    block->alloc_record.mem = mem;
+    block->alloc_record.size = size;
+    block->prev = arena->last;
+    
+    arena->last = block;
+    arena->top = mem + size;
+    
+    return &(block->alloc_record);
+    
+}
+
+static void _arena_pop(pool_mgr_pt pool_mgr, arena_block_pt block) {
+    
+    const arena_pt arena = pool_mgr->arena;
+    
+    // A block still allocated (only on rollback) leaves the counters too
+    if(block->alloc_record.mem != NULL) {
+        
+        --(pool_mgr->pool.num_allocs);
+        
+        pool_mgr->pool.alloc_size -= block->alloc_record.size;
         
     }
     
-    // allocate a new node heap
-    pool_mgr->node_heap = (node_pt) calloc(MEM_NODE_HEAP_INIT_CAPACITY, sizeof(node_t));
-    pool_mgr->total_nodes = MEM_NODE_HEAP_INIT_CAPACITY;
-    pool_mgr->used_nodes = 0;
+    // The top comes down to the end of the block below
+    const arena_block_pt prev = block->prev;
     
-    // check success, on error deallocate mgr/pool and return null
-    if(pool_mgr->node_heap == NULL) {
+    arena->top = prev ? (char *) (prev + 1) + prev->alloc_record.size : pool_mgr->pool.mem;
+    arena->last = prev;
+    
+}
+
+static alloc_status _arena_free(pool_mgr_pt pool_mgr, alloc_pt alloc) {
+    
+    const arena_pt arena = pool_mgr->arena;
+    
+    // The record is the first field of the header
+    const arena_block_pt block = (arena_block_pt) alloc;
+    
+    // Not (or no longer) handed out, or not on top of a STACK pool
+    if(alloc->mem != (char *) (block + 1) || (pool_mgr->pool.policy == STACK && block != arena->last)) {
+        return ALLOC_FAIL;
+    }
+    
+    alloc->mem = NULL;
+    
+    // The memory comes back only from the top down
+    while(arena->last != NULL && arena->last->alloc_record.mem == NULL) {
+        _arena_pop(pool_mgr, arena->last);
+    }
+    
+    return ALLOC_OK;
+    
+}
+
+static alloc_status _stack_free_batch(pool_mgr_pt pool_mgr, alloc_pt *allocs, unsigned n) {
+    
+    const arena_pt arena = pool_mgr->arena;
+    
+    // Mark them deallocated, as long as they are handed out (and not twice)
+    unsigned marked = 0;
+    
+    while(marked < n && allocs[marked]->mem == (char *) ((arena_block_pt) allocs[marked] + 1)) {
         
-        // It didn't :(
+        allocs[marked]->mem = NULL;
         
-        free(pool_mgr->pool.mem);
-        free(pool_mgr);
+        ++marked;
         
-        return NULL;
+    }
+    
+    // They have to be the n blocks on top
+    arena_block_pt block = arena->last;
+    
+    unsigned below = 0;
+    
+    while(marked == n && below < n && block != NULL && block->alloc_record.mem == NULL) {
+        
+        block = block->prev;
+        
+        ++below;
         
     }
     
-    // allocate a new gap index
-    pool_mgr->gap_ix = (gap_pt) calloc(MEM_GAP_IX_INIT_CAPACITY, sizeof(gap_t));
-    pool_mgr->gap_ix_capacity = MEM_GAP_IX_INIT_CAPACITY;
+    // If not, nothing changes
+    if(below < n) {
+        
+        while(marked > 0) {
+            
+            --marked;
+            
+            allocs[marked]->mem = (char *) ((arena_block_pt) allocs[marked] + 1);
+            
+        }
+        
+        return ALLOC_FAIL;
+        
+    }
     
-    // check success, on error deallocate mgr/pool/heap and return null
-    if(pool_mgr->gap_ix == NULL) {
+    while(arena->last != block) {
+        _arena_pop(pool_mgr, arena->last);
+    }
+    
+    return ALLOC_OK;
+    
+}
+
+static alloc_status _arena_resize(pool_mgr_pt pool_mgr, alloc_pt alloc, size_t size) {
+    
+    const arena_pt arena = pool_mgr->arena;
+    
+    // The last block can move the top, either way
+    if((arena_block_pt) alloc == arena->last) {
+        
+        if(size > (size_t) (pool_mgr->pool.mem + pool_mgr->pool.total_size - alloc->mem)) {
+            return ALLOC_FAIL;
+        }
         
-        // It didn't :(
+        arena->top = alloc->mem + size;
         
-        free(pool_mgr->pool.mem);
-        free(pool_mgr->node_heap);
-        free(pool_mgr);
+    } else if(size > alloc->size) {
         
-        return NULL;
+        // Any other can only shrink, the rest is unused until the top
+        // comes back down
+        return ALLOC_FAIL;
         
     }
     
-    // initialize top node of node heap
-    // Add the starting node / gap representing a completely empty pool
-    const node_pt node = _add_node(pool_mgr, NULL);
+    alloc->size = size;
     
-    // Configure the node
-    node->alloc_record.mem = pool_mgr->pool.mem;
-    node->alloc_record.size = pool_mgr->pool.total_size;
-    node->next = NULL;
-    node->prev = NULL;
-    node->used = 1;
-    node->allocated = 1;
+    return ALLOC_OK;
     
-    // initialize top node of gap index
-    // Add the gap
-    _add_gap(pool_mgr, node);
+}
+
+static alloc_pt _arena_find(pool_mgr_pt pool_mgr, const char *mem) {
     
-    // link pool mgr to pool store
-    // Connect our new pool manager to the pointer table
-    pool_store[pool_store_size] = pool_mgr;
+    // Blocks start aligned, below the top
+    if(mem < pool_mgr->pool.mem + sizeof(arena_block_t) || mem > pool_mgr->arena->top
+       || (size_t) (mem - pool_mgr->pool.mem) % MEM_ARENA_ALIGN != 0) {
+        return NULL;
+    }
     
-    // Increment pool_store_size
-    ++pool_store_size;
+    const arena_block_pt block = (arena_block_pt) (mem - sizeof(arena_block_t));
     
-    // Return the addLess of the mgr, cast to (pool_pt)
-    // Return the pointer (casted to a pool_pt)
-    return (pool_pt) pool_mgr;
+    // Only take it if the header points back at the memory
+    if(block->alloc_record.mem != mem) {
+        return NULL;
+    }
+    
+    return &(block->alloc_record);
     
 }
 
-alloc_status mem_pool_close(pool_pt pool) {
+static unsigned _arena_inspect(pool_mgr_pt pool_mgr, pool_segment_pt segments) {
     
-    // get mgr from pool by casting the pointer to (pool_mgr_pt)
-    // Upcast the pool pointer to a pool_mgr pointer
-    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    // The blocks are linked from the top down, so count them first
+    unsigned count = 1;
     
-    // check if this pool is allocated
-    if(pool_mgr == NULL) {
-        return ALLOC_FAIL;
+    for(arena_block_pt block = pool_mgr->arena->last; block != NULL; block = block->prev) {
+        ++count;
+    }
+    
+    if(segments == NULL) {
+        return count;
     }
     
-    for(int i = 0; i < pool_mgr->used_nodes; ++i) {
+    // The free space on top
+    char *end = pool_mgr->pool.mem + pool_mgr->pool.total_size;
+    
+    segments[count - 1].size = (size_t) (end - pool_mgr->arena->top);
+    segments[count - 1].allocated = 0;
+    
+    end = pool_mgr->arena->top;
+    
+    // Each block, with its header and the padding before it, down to the
+    // end of the block below
+    unsigned currentSegment = count - 1;
+    
+    for(arena_block_pt block = pool_mgr->arena->last; block != NULL; block = block->prev) {
         
-        // check if pool has only one gap
-        if(pool_mgr->node_heap[i].allocated) {
-            return ALLOC_NOT_FREED;
-        }
+        char *const start = block->prev ? (char *) (block->prev + 1) + block->prev->alloc_record.size : pool_mgr->pool.mem;
+        
+        --currentSegment;
+        
+        segments[currentSegment].size = (size_t) (end - start);
+        segments[currentSegment].allocated = block->alloc_record.mem != NULL;
+        
+        end = start;
         
     }
     
-    // check if it has zero allocations
-    if(pool_mgr->pool.num_allocs <= 0) {
-        // TODO How does this case differ?
-        //return ALLOC_FAIL;
-    }
+    return count;
+    
+}
 
-    // find mgr in pool store and set to null
-    for(unsigned i = 0; i < pool_store_size; ++i) {
-        
-        if(pool_store[i] == pool_mgr) {
-            pool_store[i] = NULL;
-            break;
-        }
-        
+/*
+ * Compact (POOL_COMPACT pools): the segment list is an array of 16-byte
+ * nodes, with 32-bit offsets, sizes and links, the state in the links'
+ * top bits, and no allocation records, so a pool is used through
+ * mem_alloc_ptr and mem_free_ptr. There is no gap index either: a fit is
+ * found by walking the list, which touches four nodes per cache line. The
+ * first node always starts the pool, since a node merges into the one
+ * before it. A page map of node positions finds a node by address.
+ */
+
+static alloc_status _compact_open(pool_mgr_pt pool_mgr, size_t size) {
+    
+    const compact_pt compact = (compact_pt) calloc(1, sizeof(compact_t));
+    
+    if(compact == NULL) {
+        return ALLOC_FAIL;
     }
     
-    // Free the allocated memory
-    // free memory pool
-    free(pool_mgr->pool.mem);
+    compact->nodes = (compact_node_pt) calloc(MEM_COMPACT_INIT_CAPACITY, sizeof(compact_node_t));
+    compact->capacity = MEM_COMPACT_INIT_CAPACITY;
+    compact->page_map = (uint32_t *) calloc((size >> MEM_PAGE_SHIFT) + 1, sizeof(uint32_t));
     
-    // Free the array of gaps
-    // free gap index
-    free(pool_mgr->gap_ix);
+    if(compact->nodes == NULL || compact->page_map == NULL) {
+        
+        free(compact->nodes);
+        free(compact->page_map);
+        free(compact);
+        
+        return ALLOC_FAIL;
+        
+    }
     
-    // Free the array of nodes
-    // free node heap
-    free(pool_mgr->node_heap);
+    pool_mgr->compact = compact;
     
-    // Free the pool_mgr struct
-    // free mgr
-    free(pool_mgr);
+    _compact_reset(pool_mgr);
     
     return ALLOC_OK;
     
 }
 
-alloc_pt mem_new_alloc(pool_pt pool, size_t size) {
+static void _compact_reset(pool_mgr_pt pool_mgr) {
     
-    // Get pool_mgr from pool by casting the pointer to (pool_mgr_pt)
-    // get mgr from pool by casting the pointer to (pool_mgr_pt)
-    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    const compact_pt compact = pool_mgr->compact;
     
-    // Check if any gaps, return null if none
-    if(pool_mgr->pool.num_gaps < 1) {
-        return NULL;
+    for(size_t page = 0; page <= pool_mgr->pool.total_size >> MEM_PAGE_SHIFT; ++page) {
+        compact->page_map[page] = MEM_COMPACT_NIL;
     }
     
-    // expand heap node, if necessary, quit on error
-    // check used nodes fewer than total nodes, quit on error
-    // get a node for allocation:
-    // Get a new node
-    
-    // if FIRST_FIT, then find the first sufficient node in the node heap
+    // One gap over the whole pool
+    const compact_node_pt first = &(compact->nodes[0]);
     
-    // if BEST_FIT, then find the first sufficient node in the gap index
+    first->offset = 0;
+    first->size = (uint32_t) pool_mgr->pool.total_size;
+    first->next = MEM_COMPACT_NIL;
+    first->prev = MEM_COMPACT_NIL;
+    first->allocated = 0;
+    first->used = 1;
     
-    // check if node found
-    // update metadata (num_allocs, alloc_size)
-    // calculate the size of the remaining gap, if any
-    // remove node from gap index
-    // convert gap_node to an allocation node of given size
-    // adjust node heap:
-    //   if remaining gap, need a new node
-    //   find an unused one in the node heap
-    //   make sure one was found
-    //   initialize it to a gap node
-    //   update metadata (used_nodes)
-    //   update linked list (new node right after the node for allocation)
-    //   add to gap index
-    //   check if successful
-    // return allocation record by casting the node to (alloc_pt)
+    compact->used_nodes = 1;
+    compact->free_nodes = MEM_COMPACT_NIL;
+    compact->page_map[0] = 0;
     
-    // Configure the node
+    pool_mgr->pool.num_gaps = 1;
     
-    // Steal some memory from the gap table
+}
+
+static unsigned _compact_new_node(pool_mgr_pt pool_mgr) {
     
-    // Find a block of memory from the gap table
-    node_pt newNode = NULL;
-    node_pt best = NULL;
+    const compact_pt compact = pool_mgr->compact;
     
-    if(pool_mgr->pool.policy == FIRST_FIT) {
+    // A dead node first
+    if(compact->free_nodes != MEM_COMPACT_NIL) {
         
-        // Look through the gaps, choose the first one (closest fitting)
+        const unsigned node = compact->free_nodes;
         
-        // loop through the node heap and the segments array
-        int currentSegment = 0;
+        compact->free_nodes = compact->nodes[node].next;
         
-        node_pt currentNode = pool_mgr->node_heap;
-        
-        // Traverse the linked list
-        while(currentNode) {
-            
-            // If node is used and NOT allocated
-            if(currentNode->used == 1 && currentNode->allocated == 0) {
-                
-                // Is this gap large enough?
-                if(currentNode->alloc_record.size >= size) {
-                    
-                    // We found one
-                    best = currentNode;
-                    
-                    break;
-                    
-                }
-                
-                ++currentSegment;
-                
-            }
-            
-            currentNode = currentNode->next;
- 
-        }
+        return node;
         
     }
     
-    if(pool_mgr->pool.policy == BEST_FIT) {
+    if(compact->used_nodes == compact->capacity) {
         
-        // Look through all the gaps, find the best one (closest fitting)
-
-        // loop through the node heap and the segments array
-        int currentSegment = 0;
+        if(compact->capacity > (MEM_COMPACT_NIL - 1) / MEM_COMPACT_EXPAND_FACTOR) {
+            return MEM_COMPACT_NIL;
+        }
         
-        node_pt currentNode = pool_mgr->node_heap;
+        const unsigned capacity = compact->capacity * MEM_COMPACT_EXPAND_FACTOR;
         
-        // Traverse the linked list
-        while(currentNode) {
-            
-            // If node is used and NOT allocated
-            if(currentNode->used == 1 && currentNode->allocated == 0) {
-                
-                // Is this gap large enough?
-                if(currentNode->alloc_record.size >= size) {
-                    
-                    // We found one, is it smaller than best?
-                    if(best != NULL) {
-                        
-                        if(currentNode->alloc_record.size < best->alloc_record.size) {
-                            
-                            // This gap is large enough, and smaller than best, it's now the new best
-                            best = currentNode;
-                            
-                        }
-                        
-                    } else {
-                        
-                        // best is unpopulated, set it to this gap
-                        best = currentNode;
-                        
-                    }
-                    
-                }
-
-                ++currentSegment;
-                
-            }
-            
-            currentNode = currentNode->next;
-            
+        const compact_node_pt nodes = (compact_node_pt) realloc(compact->nodes, capacity * sizeof(compact_node_t));
+        
+        if(nodes == NULL) {
+            return MEM_COMPACT_NIL;
         }
         
+        compact->nodes = nodes;
+        compact->capacity = capacity;
+        
     }
     
-    if(best != NULL) {
-        
-        // Find the corresponding gap
-        for (int i = 0; i < pool_mgr->pool.num_gaps; ++i) {
-            
-            if(pool_mgr->gap_ix[i].node == best) {
-                
-                newNode = _convert_gap_to_node_and_gap(pool_mgr, &(pool_mgr->gap_ix[i]), size);
-                
-                break;
-                
-            }
-            
-        }
-        
+    return compact->used_nodes++;
+    
+}
+
+static void _compact_map(pool_mgr_pt pool_mgr, unsigned node) {
+    
+    const compact_pt compact = pool_mgr->compact;
+    
+    uint32_t *const entry = &(compact->page_map[compact->nodes[node].offset >> MEM_PAGE_SHIFT]);
+    
+    if(*entry == MEM_COMPACT_NIL || compact->nodes[*entry].offset > compact->nodes[node].offset) {
+        *entry = node;
     }
     
-    if(newNode) {
-        
-        ++(pool_mgr->pool.num_allocs);
-        
-        pool_mgr->pool.alloc_size += size;
+}
+
+static void _compact_unmap(pool_mgr_pt pool_mgr, unsigned node) {
+    
+    const compact_pt compact = pool_mgr->compact;
+    
+    const uint32_t page = compact->nodes[node].offset >> MEM_PAGE_SHIFT;
+    
+    if(compact->page_map[page] != node) {
+        return;
+    }
+    
+    // The next node takes over the page, if it starts in it
+    const unsigned next = compact->nodes[node].next;
+    
+    if(next != MEM_COMPACT_NIL && compact->nodes[next].offset >> MEM_PAGE_SHIFT == page) {
         
-        return &(newNode->alloc_record);
+        compact->page_map[page] = next;
         
     } else {
         
-        printf("Failed to alloc memory!\r\n");
-        
-        return NULL;
+        compact->page_map[page] = MEM_COMPACT_NIL;
         
     }
     
 }
 
-alloc_status mem_del_alloc(pool_pt pool, alloc_pt alloc) {
+static void _compact_unlink(pool_mgr_pt pool_mgr, unsigned node) {
     
-    const size_t size = alloc->size;
+    const compact_pt compact = pool_mgr->compact;
     
-    // get mgr from pool by casting the pointer to (pool_mgr_pt)
-    // get node from alloc by casting the pointer to (node_pt)
-    // find the node in the node heap
-    // this is node-to-delete
-    // make sure it's found
-    // convert to gap node
-    // update metadata (num_allocs, alloc_size)
-    // if the next node in the list is also a gap, merge into node-to-delete
-    //   remove the next node from gap index
-    //   check success
-    //   add the size to the node-to-delete
-    //   update node as unused
-    //   update metadata (used nodes)
-    //   update linked list:
-    /*
-                    if (next->next) {
-                        next->next->prev = node_to_del;
-                        node_to_del->next = next->next;
-                    } else {
-                        node_to_del->next = NULL;
-                    }
-                    next->next = NULL;
-                    next->prev = NULL;
-     */
-
-    // this merged node-to-delete might need to be added to the gap index
-    // but one more thing to check...
-    // if the previous node in the list is also a gap, merge into previous!
-    //   remove the previous node from gap index
-    //   check success
-    //   add the size of node-to-delete to the previous
-    //   update node-to-delete as unused
-    //   update metadata (used_nodes)
-    //   update linked list
-    /*
-                    if (node_to_del->next) {
-                        prev->next = node_to_del->next;
-                        node_to_del->next->prev = prev;
-                    } else {
-                        prev->next = NULL;
-                    }
-                    node_to_del->next = NULL;
-                    node_to_del->prev = NULL;
-     */
-    //   change the node to add to the previous node!
-    // add the resulting node to the gap index
-    // check success
+    const compact_node_pt dead = &(compact->nodes[node]);
+    
+    _compact_unmap(pool_mgr, node);
+    
+    // Never the first node, the one before takes its place
+    compact->nodes[dead->prev].next = dead->next;
+    
+    if(dead->next != MEM_COMPACT_NIL) {
+        compact->nodes[dead->next].prev = dead->prev;
+    }
+    
+    dead->used = 0;
+    dead->next = compact->free_nodes;
+    
+    compact->free_nodes = node;
+    
+}
 
-    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+static char *_compact_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    
+    const compact_pt compact = pool_mgr->compact;
+    
+    if(size > MEM_COMPACT_MAX_SIZE) {
+        return NULL;
+    }
+    
+    // The first gap it fits, or the smallest (an exact fit ends the walk)
+    unsigned found = MEM_COMPACT_NIL;
     
-    // Upcast to node
-    const node_pt node = (node_pt) alloc;
+    for(unsigned node = 0; node != MEM_COMPACT_NIL; node = compact->nodes[node].next) {
+        
+        const compact_node_pt gap = &(compact->nodes[node]);
+        
+        if(gap->allocated || gap->size < size) {
+            continue;
+        }
+        
+        if(found == MEM_COMPACT_NIL || gap->size < compact->nodes[found].size) {
+            found = node;
+        }
+        
+        if(pool_mgr->pool.policy == FIRST_FIT || gap->size == size) {
+            break;
+        }
+        
+    }
     
-    // Call the internal function that will handle this
+    if(found == MEM_COMPACT_NIL) {
+        return NULL;
+    }
     
-    if(_mem_add_to_gap_ix(pool_mgr, alloc->size, node) == ALLOC_OK) {
+    // What is left of the gap after the allocation stays a gap
+    if(compact->nodes[found].size > size) {
         
-        --(pool_mgr->pool.num_allocs);
+        const unsigned rest = _compact_new_node(pool_mgr);
         
-        pool_mgr->pool.alloc_size -= size;
+        if(rest == MEM_COMPACT_NIL) {
+            return NULL;
+        }
         
-        return ALLOC_OK;
+        // The array may have moved
+        const compact_node_pt node = &(compact->nodes[found]);
+        const compact_node_pt gap = &(compact->nodes[rest]);
+        
+        gap->offset = node->offset + (uint32_t) size;
+        gap->size = node->size - (uint32_t) size;
+        gap->next = node->next;
+        gap->prev = found;
+        gap->allocated = 0;
+        gap->used = 1;
+        
+        if(node->next != MEM_COMPACT_NIL) {
+            compact->nodes[node->next].prev = rest;
+        }
+        
+        node->next = rest;
+        node->size = (uint32_t) size;
+        
+        _compact_map(pool_mgr, rest);
         
     } else {
         
-        return ALLOC_FAIL;
+        --(pool_mgr->pool.num_gaps);
         
     }
     
+    compact->nodes[found].allocated = 1;
+    
+    return pool_mgr->pool.mem + compact->nodes[found].offset;
+    
 }
 
-void mem_inspect_pool(pool_pt pool, pool_segment_pt *segments, unsigned *num_segments) {
+static unsigned _compact_find(pool_mgr_pt pool_mgr, const char *mem) {
     
-    // get the mgr from the pool
-    // Upcast the pool pointer to a pool_mgr pointer
-    const pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    const compact_pt compact = pool_mgr->compact;
     
-    // allocate the segments array with size == used_nodes
-    *segments = (pool_segment_pt) calloc(pool_mgr->used_nodes, sizeof(pool_segment_t));
+    if(mem < pool_mgr->pool.mem || mem >= pool_mgr->pool.mem + pool_mgr->pool.total_size) {
+        return MEM_COMPACT_NIL;
+    }
     
-    // check successful
-    if(segments == NULL) {
-        return;
+    const uint32_t offset = (uint32_t) (mem - pool_mgr->pool.mem);
+    
+    // Walk from the first node starting in the page up to mem, an
+    // allocation has to start right there
+    unsigned node = compact->page_map[offset >> MEM_PAGE_SHIFT];
+    
+    while(node != MEM_COMPACT_NIL && compact->nodes[node].offset < offset) {
+        node = compact->nodes[node].next;
     }
     
-    // loop through the node heap and the segments array
-    int currentSegment = 0;
+    if(node == MEM_COMPACT_NIL || compact->nodes[node].offset != offset || compact->nodes[node].allocated == 0) {
+        return MEM_COMPACT_NIL;
+    }
     
-    node_pt currentNode = pool_mgr->node_heap;
+    return node;
     
-    // Traverse the linked list
-    while(currentNode) {
+}
+
+static void _compact_free(pool_mgr_pt pool_mgr, unsigned node) {
+    
+    const compact_pt compact = pool_mgr->compact;
+    
+    compact_node_pt gap = &(compact->nodes[node]);
+    
+    --(pool_mgr->pool.num_allocs);
+    
+    pool_mgr->pool.alloc_size -= gap->size;
+    
+    gap->allocated = 0;
+    
+    ++(pool_mgr->pool.num_gaps);
+    
+    // A gap after it merges into it
+    const unsigned next = gap->next;
+    
+    if(next != MEM_COMPACT_NIL && compact->nodes[next].allocated == 0) {
         
-        if(currentNode->used != 0) {
-            (*segments)[currentSegment].size = currentNode->alloc_record.size;
-            (*segments)[currentSegment].allocated = currentNode->allocated;
-            ++currentSegment;
-        }
+        gap->size += compact->nodes[next].size;
+        
+        _compact_unlink(pool_mgr, next);
         
-        currentNode = currentNode->next;
+        --(pool_mgr->pool.num_gaps);
         
     }
     
-    /*for(int i = 0; i < pool_mgr->used_nodes; ++i) {
+    // And it merges into a gap before it
+    const unsigned prev = gap->prev;
+    
+    if(prev != MEM_COMPACT_NIL && compact->nodes[prev].allocated == 0) {
         
-        // Skip unused nodes
-        if(pool_mgr->node_heap[i].used == 0) {
-            continue;
-        }
+        compact->nodes[prev].size += gap->size;
         
-        // for each node, write the size and allocated in the segment
-        (*segments)[currentSegment].size = pool_mgr->node_heap[i].alloc_record.size;
-        (*segments)[currentSegment].allocated = pool_mgr->node_heap[i].allocated;
+        _compact_unlink(pool_mgr, node);
         
-        ++currentSegment;
+        --(pool_mgr->pool.num_gaps);
         
-    }*/
-    
-    // "return" the values:
-    *num_segments = currentSegment;
-    return;
+    }
     
 }
 
-/***********************************/
-/*                                 */
-/* Definitions of static functions */
-/*                                 */
-/***********************************/
-
-static alloc_status _mem_resize_pool_store() {
+static unsigned _compact_inspect(pool_mgr_pt pool_mgr, pool_segment_pt segments) {
     
-    // check if necessary
-    /*
-                if (((float) pool_store_size / pool_store_capacity)
-                    > MEM_POOL_STORE_FILL_FACTOR) {...}
-     */
-    // don't forget to update capacity variables
+    const compact_pt compact = pool_mgr->compact;
     
-    // Are too many pools in use?
-    if(pool_store_size < pool_store_capacity * MEM_POOL_STORE_FILL_FACTOR) {
+    unsigned count = 0;
+    
+    for(unsigned node = 0; node != MEM_COMPACT_NIL; node = compact->nodes[node].next) {
         
-        // NO, do nothing
-        return ALLOC_OK;
+        segments[count].size = compact->nodes[node].size;
+        segments[count].allocated = compact->nodes[node].allocated;
+        
+        ++count;
         
     }
     
-    // We'll use a temporary pointer, in the event that the realloc call fails,
-    // we'd rather deny the mem_pool_open call rather than obliterate the entire pool_store
+    return count;
     
-    pool_mgr_pt * bob = (pool_mgr_pt *) realloc(pool_store, pool_store_capacity * MEM_POOL_STORE_EXPAND_FACTOR * sizeof(pool_mgr_pt));
+}
+
+/*
+ * Gap scan (POOL_GAP_SCAN pools): there is no tree, the sizes and start
+ * offsets of the gaps are kept in plain arrays in address order, with the
+ * gap_ix position of each alongside, and a fit is found by testing the
+ * sizes four at a time with AVX2. First fit stops at the first block with
+ * a hit and NEXT_FIT starts at the cursor's place, best fit has to test
+ * them all (unless it finds an exact fit). Adding and removing a gap
+ * shifts the arrays above it, so this suits pools that don't have many.
+ * Sizes stay below 2^63, so signed vector compares will do.
+ */
+
+static unsigned _gap_scan_position(pool_mgr_pt pool_mgr, unsigned count, size_t offset) {
     
-    // Did the realloc call succeed?
-    if(bob == NULL) {
-        
-        // Return NULL on failure
-        printf("Failed to resize node heap.\r\n");
-        return ALLOC_FAIL;
-        
-    } else {
+    const size_t *starts = pool_mgr->gap_starts;
+    
+    unsigned low = 0, high = count;
+    
+    // First of the count entries that starts at or above offset
+    while(low < high) {
         
-        // Assign bob to the pool_store
-        pool_store = bob;
+        const unsigned middle = low + (high - low) / 2;
         
-        // Modify the pool_store_capacity to match the new size
-        pool_store_capacity *= MEM_POOL_STORE_EXPAND_FACTOR;
+        if(starts[middle] < offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
         
     }
+    
+    return low;
+    
+}
 
-    return ALLOC_OK;
+static unsigned _gap_scan_find(pool_mgr_pt pool_mgr, unsigned count, size_t start, unsigned slot) {
+    
+    unsigned position = _gap_scan_position(pool_mgr, count, start);
+    
+    // Zero-size gaps can share their start with the next one
+    while(pool_mgr->gap_slots[position] != slot) {
+        ++position;
+    }
+    
+    return position;
     
 }
 
-static alloc_status _mem_resize_node_heap(pool_mgr_pt pool_mgr) {
+static void _gap_scan_insert(pool_mgr_pt pool_mgr, unsigned gap) {
     
-    // Are too many pools in use?
-    if(pool_mgr->used_nodes < pool_mgr->total_nodes * MEM_NODE_HEAP_FILL_FACTOR) {
-        
-        // NO, do nothing
-        return ALLOC_OK;
-        
+    // The gap has been counted already, the arrays hold the others
+    const unsigned count = pool_mgr->pool.num_gaps - 1;
+    
+    const size_t start = (size_t) (pool_mgr->gap_ix[gap].node->alloc_record.mem - pool_mgr->pool.mem);
+    const size_t size = pool_mgr->gap_ix[gap].size;
+    
+    unsigned position = _gap_scan_position(pool_mgr, count, start);
+    
+    // A zero-size gap comes before a gap that starts where it does, as in
+    // the node list, so the gaps end in address order too
+    while(position < count && pool_mgr->gap_starts[position] == start && pool_mgr->gap_sizes[position] < size) {
+        ++position;
     }
     
-    // We'll use a temporary pointer, in the event that the realloc call fails
+    const unsigned above = count - position;
     
-    node_pt bob = (node_pt) realloc(pool_mgr->node_heap, pool_mgr->total_nodes * MEM_NODE_HEAP_EXPAND_FACTOR * sizeof(node_t));
+    memmove(pool_mgr->gap_sizes + position + 1, pool_mgr->gap_sizes + position, above * sizeof(size_t));
+    memmove(pool_mgr->gap_starts + position + 1, pool_mgr->gap_starts + position, above * sizeof(size_t));
+    memmove(pool_mgr->gap_slots + position + 1, pool_mgr->gap_slots + position, above * sizeof(unsigned));
     
-    // Did the realloc call succeed?
-    if(bob == NULL) {
-        
-        // Return NULL on failure
-        printf("Failed to resize node heap.\r\n");
-        return ALLOC_FAIL;
-        
-    } else {
-        
-        // Assign bob to the pool_store
-        pool_mgr->node_heap = bob;
+    pool_mgr->gap_sizes[position] = size;
+    pool_mgr->gap_starts[position] = start;
+    pool_mgr->gap_slots[position] = gap;
+    
+    pool_mgr->gap_ix[gap].scan_start = start;
+    
+}
+
+static void _gap_scan_remove(pool_mgr_pt pool_mgr, unsigned gap) {
+    
+    const unsigned count = pool_mgr->pool.num_gaps;
+    
+    // Found by where it started when it went in, the node may have moved on
+    const unsigned position = _gap_scan_find(pool_mgr, count, pool_mgr->gap_ix[gap].scan_start, gap);
+    const unsigned above = count - position - 1;
+    
+    memmove(pool_mgr->gap_sizes + position, pool_mgr->gap_sizes + position + 1, above * sizeof(size_t));
+    memmove(pool_mgr->gap_starts + position, pool_mgr->gap_starts + position + 1, above * sizeof(size_t));
+    memmove(pool_mgr->gap_slots + position, pool_mgr->gap_slots + position + 1, above * sizeof(unsigned));
+    
+}
+
+static int _gap_scan_update(pool_mgr_pt pool_mgr, unsigned gap, size_t size, node_pt node) {
+    
+    const unsigned count = pool_mgr->pool.num_gaps;
+    
+    const size_t start = (size_t) (node->alloc_record.mem - pool_mgr->pool.mem);
+    const unsigned position = _gap_scan_find(pool_mgr, count, pool_mgr->gap_ix[gap].scan_start, gap);
+    
+    // A gap that shrinks or grows stays between its neighbours, anything
+    // else has to be taken out and put back in
+    if((position > 0 && pool_mgr->gap_starts[position - 1] >= start) ||
+       (position + 1 < count && pool_mgr->gap_starts[position + 1] <= start)) {
         
-        // Modify the pool_store_capacity to match the new size
-        pool_mgr->total_nodes *= MEM_NODE_HEAP_EXPAND_FACTOR;
+        return 0;
         
     }
     
-    return ALLOC_OK;
+    pool_mgr->gap_sizes[position] = size;
+    pool_mgr->gap_starts[position] = start;
+    
+    pool_mgr->gap_ix[gap].scan_start = start;
+    
+    return 1;
     
 }
 
-static alloc_status _mem_resize_gap_ix(pool_mgr_pt pool_mgr) {
+static unsigned _gap_scan_first_fit_scalar(const size_t *sizes, unsigned num_gaps, size_t size) {
     
-    // Are too many gaps in use?
-    if(pool_mgr->gap_ix_capacity < pool_mgr->gap_ix_capacity * MEM_GAP_IX_FILL_FACTOR) {
+    // The arrays are in address order, the first that fits is the lowest
+    for(unsigned gap = 0; gap < num_gaps; ++gap) {
         
-        // NO, do nothing
-        return ALLOC_OK;
+        if(sizes[gap] >= size) {
+            return gap;
+        }
         
     }
     
-    // We'll use a temporary pointer, in the event that the realloc call fails
+    return MEM_GAP_IX_NIL;
     
-    gap_pt bob = (gap_pt) realloc(pool_mgr->gap_ix, pool_mgr->gap_ix_capacity * MEM_GAP_IX_EXPAND_FACTOR * sizeof(gap_t));
+}
+
+static unsigned _gap_scan_best_fit_scalar(const size_t *sizes, unsigned num_gaps, size_t size) {
     
-    // Did the realloc call succeed?
-    if(bob == NULL) {
-        
-        // Return NULL on failure
-        printf("Failed to resize gap index.\r\n");
-        return ALLOC_FAIL;
-        
-    } else {
-        
-        // Assign bob to the pool_store
-        pool_mgr->gap_ix = bob;
+    unsigned found = MEM_GAP_IX_NIL;
+    size_t smallest = SIZE_MAX;
+    
+    // Smallest of the gaps that fit, the first (lowest addressed) among
+    // equals, and nothing beats an exact fit
+    for(unsigned gap = 0; gap < num_gaps; ++gap) {
         
-        // Modify the pool_store_capacity to match the new size
-        pool_mgr->gap_ix_capacity *= MEM_GAP_IX_EXPAND_FACTOR;
+        if(sizes[gap] >= size && sizes[gap] < smallest) {
+            
+            if(sizes[gap] == size) {
+                return gap;
+            }
+            
+            smallest = sizes[gap];
+            found = gap;
+            
+        }
         
     }
     
-    return ALLOC_OK;
+    return found;
     
 }
 
-static alloc_status _mem_add_to_gap_ix(pool_mgr_pt pool_mgr, size_t size, node_pt node) {
+#if MEM_GAP_SCAN_AVX2
+
+__attribute__((target("avx2")))
+static unsigned _gap_scan_first_fit_avx2(const size_t *sizes, unsigned num_gaps, size_t size) {
     
-    // expand the gap index, if necessary (call the function)
-    // add the entry at the end
-    // update metadata (num_gaps)
-    // sort the gap index (call the function)
-    // check success
+    const __m256i need = _mm256_set1_epi64x((long long) size - 1);
     
-    return _add_gap(pool_mgr, node);
+    unsigned gap = 0;
     
-}
-
-static alloc_status _mem_remove_from_gap_ix(pool_mgr_pt pool_mgr, size_t size, node_pt node) {
+    for(; gap + 4 <= num_gaps; gap += 4) {
+        
+        const __m256i s = _mm256_loadu_si256((const __m256i *) (sizes + gap));
+        
+        // One bit per lane that fits, the lowest is the lowest addressed
+        const int fits = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(s, need)));
+        
+        if(fits) {
+            return gap + (unsigned) __builtin_ctz((unsigned) fits);
+        }
+        
+    }
     
-    // No gap found, the pool is full
-    printf("Failed to find available memory in pool.\r\n");
-    return ALLOC_FAIL;
+    // The rest one at a time
+    const unsigned tail = _gap_scan_first_fit_scalar(sizes + gap, num_gaps - gap, size);
+    
+    return (tail == MEM_GAP_IX_NIL) ? MEM_GAP_IX_NIL : gap + tail;
     
 }
 
-int _partitionGap(gap_pt gaps, int l, int r) {
+__attribute__((target("avx2")))
+static unsigned _gap_scan_best_fit_avx2(const size_t *sizes, unsigned num_gaps, size_t size) {
     
-    // Jacked a quick and dirty QuickSort implementation from
-    // http://www.comp.dit.ie/rlawlor/Alg_DS/sorting/quickSort.c
+    const __m256i need = _mm256_set1_epi64x((long long) size - 1);
+    const __m256i exact = _mm256_set1_epi64x((long long) size);
+    const __m256i step = _mm256_set1_epi64x(4);
     
-    // We'll need to modify this to work with the gap index...
-
-    // expand the gap index, if necessary (call the function)
-    // add the entry at the end
-    // update metadata (num_gaps)
-    // sort the gap index (call the function)
-    // check success
-
-    int i = l, j = r + 1;
+    __m256i index = _mm256_setr_epi64x(0, 1, 2, 3);
+    __m256i smallest = _mm256_set1_epi64x(INT64_MAX);
+    __m256i found = _mm256_set1_epi64x(-1);
     
-    gap_t t;
-    gap_pt pivot;
+    unsigned gap = 0;
     
-    pivot = &(gaps[l]);
-    
-    while(1) {
+    for(; gap + 4 <= num_gaps; gap += 4) {
         
-        do ++i; while(gaps[i].size <= pivot->size && i <= r );
+        const __m256i s = _mm256_loadu_si256((const __m256i *) (sizes + gap));
         
-        do --j; while(gaps[j].size > pivot->size);
+        // Nothing beats an exact fit, and any earlier one would have ended
+        // the scan already
+        const int hits = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(s, exact)));
         
-        if(i >= j) break;
+        if(hits) {
+            return gap + (unsigned) __builtin_ctz((unsigned) hits);
+        }
+        
+        // Fits, and is strictly smaller than what the lane has, so each
+        // lane keeps the lowest addressed of its smallest
+        const __m256i better = _mm256_and_si256(_mm256_cmpgt_epi64(s, need), _mm256_cmpgt_epi64(smallest, s));
+        
+        smallest = _mm256_blendv_epi8(smallest, s, better);
+        found = _mm256_blendv_epi8(found, index, better);
+        
+        index = _mm256_add_epi64(index, step);
+        
+    }
+    
+    int64_t sizeLanes[4], indices[4];
+    
+    _mm256_storeu_si256((__m256i *) sizeLanes, smallest);
+    _mm256_storeu_si256((__m256i *) indices, found);
+    
+    unsigned best = MEM_GAP_IX_NIL;
+    size_t bestSize = SIZE_MAX;
+    
+    // Smallest lane, the lowest position among equals
+    for(unsigned lane = 0; lane < 4; ++lane) {
+        
+        if(indices[lane] < 0) {
+            continue;
+        }
         
-        t = gaps[i];
-        gaps[i] = gaps[j];
-        gaps[j] = t;
+        if((size_t) sizeLanes[lane] < bestSize || ((size_t) sizeLanes[lane] == bestSize && (unsigned) indices[lane] < best)) {
+            
+            bestSize = (size_t) sizeLanes[lane];
+            best = (unsigned) indices[lane];
+            
+        }
         
     }
     
-    t = gaps[l];
-    gaps[l] = gaps[j];
-    gaps[j] = t;
+    // The rest one at a time, they come after, so only a smaller one wins
+    const unsigned tail = _gap_scan_best_fit_scalar(sizes + gap, num_gaps - gap, size);
     
-    return j;
+    if(tail != MEM_GAP_IX_NIL && sizes[gap + tail] < bestSize) {
+        best = gap + tail;
+    }
+    
+    return best;
     
 }
 
-void _quickSortGap(gap_pt gaps, int l, int r) {
+#endif
+
+static void _gap_scan_select() {
     
-    // Jacked a quick and dirty QuickSort implementation from
-    // http://www.comp.dit.ie/rlawlor/Alg_DS/sorting/quickSort.c
+#if MEM_GAP_SCAN_AVX2
     
-    // We'll need to modify this to work with the gap index...
-
-    if(l < r) {
+    // CPUID says whether the vector scans can run here
+    __builtin_cpu_init();
+    
+    if(__builtin_cpu_supports("avx2")) {
         
-        int j = _partitionGap(gaps, l, r);
+        _gap_scan_first_fit = _gap_scan_first_fit_avx2;
+        _gap_scan_best_fit = _gap_scan_best_fit_avx2;
         
-        _quickSortGap(gaps, l, j - 1);
-        _quickSortGap(gaps, j + 1, r);
+        return;
         
     }
     
+#endif
+    
+    _gap_scan_first_fit = _gap_scan_first_fit_scalar;
+    _gap_scan_best_fit = _gap_scan_best_fit_scalar;
+    
 }
 
-static alloc_status _mem_sort_gap_ix(pool_mgr_pt pool_mgr) {
+static unsigned _mem_scan_fit(pool_mgr_pt pool_mgr, size_t size) {
     
-    // loop from num_gaps - 1 until but not including 0:
-    //    if the size of the current entry is less than the previous (u - 1)
-    //    or if the sizes are the same but the current entry points to a
-    //    node with a lower address of pool allocation address (mem)
-    //       swap them (by copying) (remember to use a temporary variable)
+    const unsigned num_gaps = pool_mgr->pool.num_gaps;
+    const size_t *sizes = pool_mgr->gap_sizes;
     
-    // Sort the gap list, smallest sizes first
-    _quickSortGap(pool_mgr->gap_ix, 0, pool_mgr->pool.num_gaps - 1);
+    // Nothing in the pool is that large, and the vector compares are signed
+    if(size > pool_mgr->pool.total_size) {
+        return MEM_GAP_IX_NIL;
+    }
     
-    return ALLOC_OK;
+    unsigned position = MEM_GAP_IX_NIL;
+    
+    if(pool_mgr->pool.policy == BEST_FIT) {
+        
+        position = _gap_scan_best_fit(sizes, num_gaps, size);
+        
+    } else if(pool_mgr->pool.policy == NEXT_FIT) {
+        
+        // From the first gap that ends above the cursor to the top, then
+        // from the bottom up to there. Gaps don't overlap, so they end in
+        // address order too.
+        const size_t cursor = (size_t) (pool_mgr->cursor - pool_mgr->pool.mem);
+        
+        unsigned from = 0, high = num_gaps;
+        
+        while(from < high) {
+            
+            const unsigned middle = from + (high - from) / 2;
+            
+            if(pool_mgr->gap_starts[middle] + sizes[middle] <= cursor) {
+                from = middle + 1;
+            } else {
+                high = middle;
+            }
+            
+        }
+        
+        position = _gap_scan_first_fit(sizes + from, num_gaps - from, size);
+        
+        if(position != MEM_GAP_IX_NIL) {
+            position += from;
+        } else {
+            position = _gap_scan_first_fit(sizes, from, size);
+        }
+        
+    } else {
+        
+        position = _gap_scan_first_fit(sizes, num_gaps, size);
+        
+    }
+    
+    return (position == MEM_GAP_IX_NIL) ? MEM_GAP_IX_NIL : pool_mgr->gap_slots[position];
     
 }
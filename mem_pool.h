@@ -9,7 +9,22 @@
 
 /* type declarations */
 
-typedef enum _alloc_policy { FIRST_FIT, BEST_FIT } alloc_policy;
+typedef enum _alloc_policy { FIRST_FIT, BEST_FIT, TLSF, BUDDY, NEXT_FIT, ARENA, STACK } alloc_policy;
+
+// Options for mem_pool_open_flags, or-ed together
+typedef enum _pool_flags {
+    POOL_SLAB           = 1 << 0,   // serve small requests from size-class slabs
+    POOL_BOUNDARY_TAGS  = 1 << 1,   // keep segment headers in the pool (TLSF only)
+    POOL_GAP_SCAN       = 1 << 2,   // find fits by scanning arrays of gaps (FIRST_FIT, NEXT_FIT, BEST_FIT)
+    POOL_GROW           = 1 << 3,   // add memory to the pool when it runs out (not with POOL_BOUNDARY_TAGS)
+    POOL_MMAP           = 1 << 4,   // map the pool memory, aligned to 2 MiB, instead of allocating it
+    POOL_HUGE_PAGES     = 1 << 5,   // map the pool memory on huge pages where possible (implies POOL_MMAP)
+    POOL_PREFAULT       = 1 << 6,   // fault in the pages of the pool memory when the pool is opened
+    POOL_COMPACT        = 1 << 7    // 16-byte nodes, used by pointer only (FIRST_FIT, BEST_FIT, under 4 GiB)
+} pool_flags;
+
+// Every option, any other bit makes mem_pool_open_flags fail
+#define POOL_ALL_FLAGS (POOL_SLAB | POOL_BOUNDARY_TAGS | POOL_GAP_SCAN | POOL_GROW | POOL_MMAP | POOL_HUGE_PAGES | POOL_PREFAULT | POOL_COMPACT)
 
 typedef struct _pool {
     char *mem;
@@ -25,6 +40,9 @@ typedef struct _alloc {
     char *mem;
 } alloc_t, *alloc_pt;
 
+// How far up an ARENA or STACK pool is filled, for mem_pool_rollback
+typedef size_t pool_mark_t;
+
 typedef struct _pool_segment {
     size_t size;
     unsigned long allocated; // 1-allocation, 0-gap (note: 8 bytes)
@@ -48,15 +66,60 @@ mem_free();
 pool_pt
 mem_pool_open(size_t size, alloc_policy policy);
 
+pool_pt
+mem_pool_open_flags(size_t size, alloc_policy policy, unsigned flags);
+
+pool_pt
+mem_pool_open_file(const char *path, size_t size, alloc_policy policy);
+
 alloc_status
 mem_pool_close(pool_pt pool);
 
+alloc_status
+mem_pool_reset(pool_pt pool);
+
+pool_mark_t
+mem_pool_mark(pool_pt pool);
+
+alloc_status
+mem_pool_rollback(pool_pt pool, pool_mark_t mark);
+
+alloc_status
+mem_pool_trim(pool_pt pool, size_t keep_bytes);
+
+double
+mem_pool_prefault_ms(pool_pt pool);
+
+alloc_status
+mem_pool_set_root(pool_pt pool, alloc_pt alloc);
+
+alloc_pt
+mem_pool_root(pool_pt pool);
+
 alloc_pt
 mem_new_alloc(pool_pt pool, size_t size);
 
+alloc_pt
+mem_new_alloc_aligned(pool_pt pool, size_t size, size_t alignment);
+
+alloc_status
+mem_new_alloc_batch(pool_pt pool, const size_t *sizes, alloc_pt *out, unsigned n);
+
 alloc_status
 mem_del_alloc(pool_pt pool, alloc_pt alloc);
 
+alloc_status
+mem_del_alloc_batch(pool_pt pool, alloc_pt *allocs, unsigned n);
+
+alloc_pt
+mem_realloc_alloc(pool_pt pool, alloc_pt alloc, size_t size);
+
+void *
+mem_alloc_ptr(pool_pt pool, size_t size);
+
+alloc_status
+mem_free_ptr(pool_pt pool, void *mem);
+
 void
 mem_inspect_pool(pool_pt pool, pool_segment_pt *segments, unsigned *num_segments);
 
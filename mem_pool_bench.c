@@ -0,0 +1,770 @@
+//
+// Benchmarks for the mem_pool internals.
+//
+// The gap index is static to mem_pool.c, so the translation unit is pulled in
+// whole and its routines are timed directly, without the node heap or the
+// gap merging getting in the way.
+//
+
+#define _POSIX_C_SOURCE 199309L
+#define _DEFAULT_SOURCE
+
+#include <time.h>
+
+#include "mem_pool.c"
+
+
+/*****            constants            *****/
+
+static const unsigned BENCH_MIN_GAPS    = 1000;
+static const unsigned BENCH_MAX_GAPS    = 1000000;
+static const unsigned BENCH_LOOKUPS     = 1000000;
+static const unsigned BENCH_MAX_GAP     = 4096;
+static const unsigned BENCH_SMALL_SIZE  = 512;
+static const unsigned BENCH_SCAN_GAPS   = 4096;
+
+static const size_t   BENCH_LATENCY_POOL_SIZE   = 64 << 20;
+static const unsigned BENCH_LATENCY_LIVE        = 10000;
+static const unsigned BENCH_LATENCY_OPS         = 200000;
+
+static const unsigned BENCH_COMPACT_LIVE        = 2000;
+static const unsigned BENCH_COMPACT_OPS         = 100000;
+
+static const unsigned BENCH_REALLOC_BUFFERS     = 64;
+static const unsigned BENCH_REALLOC_APPENDS     = 200000;
+static const size_t   BENCH_REALLOC_MAX_SIZE    = 64 << 10;
+
+static const unsigned BENCH_BATCH_MESSAGES      = 100000;
+static const unsigned BENCH_BATCH_LIVE          = 256;
+#define               BENCH_BATCH_MAX_OBJECTS   50
+
+static const unsigned BENCH_SCRATCH_QUERIES     = 100000;
+static const unsigned BENCH_SCRATCH_DEPTH       = 8;
+#define               BENCH_SCRATCH_MAX_OBJECTS 24
+
+static const size_t   BENCH_ACCESS_POOL_SIZE    = (size_t) 512 << 20;
+static const unsigned BENCH_ACCESSES            = 10000000;
+
+// Where results go that would otherwise be optimized away
+static volatile size_t bench_sink;
+
+
+/*****         helper routines         *****/
+
+static double now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+static size_t random_size() {
+    return 1 + (size_t) rand() % BENCH_MAX_GAP;
+}
+
+static int compare_double(const void *a, const void *b) {
+    const double x = *(const double *) a, y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+static void print_percentiles(const char *what, double *samples, unsigned num_samples) {
+    qsort(samples, num_samples, sizeof(double), compare_double);
+
+    printf("  %-6s p50 %8.0f ns, p99 %8.0f ns, max %8.0f ns\n", what,
+           samples[num_samples / 2],
+           samples[(size_t) num_samples * 99 / 100],
+           samples[num_samples - 1]);
+}
+
+static const char *policy_name(alloc_policy policy) {
+    switch (policy) {
+        case FIRST_FIT: return "FIRST_FIT";
+        case BEST_FIT:  return "BEST_FIT";
+        case TLSF:      return "TLSF";
+        case BUDDY:     return "BUDDY";
+        case NEXT_FIT:  return "NEXT_FIT";
+        case ARENA:     return "ARENA";
+        case STACK:     return "STACK";
+    }
+
+    return "?";
+}
+
+
+/*****             benchmarks           *****/
+
+// Cost of the gap tree at num_gaps entries, ordered for the given policy
+static void bench_gap_ix(alloc_policy policy, unsigned num_gaps) {
+    pool_mgr_t pool_mgr = {0};
+
+    pool_mgr.pool.policy = policy;
+
+    pool_mgr.gap_ix = (gap_pt) calloc(MEM_GAP_IX_INIT_CAPACITY, sizeof(gap_t));
+    pool_mgr.gap_ix_capacity = MEM_GAP_IX_INIT_CAPACITY;
+    pool_mgr.gap_ix_root = MEM_GAP_IX_NIL;
+
+    // one fake gap node per entry, the addresses only have to be distinct
+    node_pt nodes = (node_pt) calloc(num_gaps, sizeof(node_t));
+    char *mem = (char *) malloc(num_gaps);
+
+    assert(pool_mgr.gap_ix && nodes && mem);
+
+    double start = now_ns();
+
+    for (unsigned u = 0; u < num_gaps; u ++) {
+        nodes[u].alloc_record.mem = mem + u;
+        nodes[u].alloc_record.size = random_size();
+        nodes[u].used = 1;
+
+        _mem_add_to_gap_ix(&pool_mgr, nodes[u].alloc_record.size, &nodes[u]);
+    }
+
+    const double insert_ns = (now_ns() - start) / num_gaps;
+
+    // fit lookups for random request sizes
+    unsigned found = 0;
+
+    start = now_ns();
+
+    for (unsigned u = 0; u < BENCH_LOOKUPS; u ++) {
+        const unsigned gap = (policy == FIRST_FIT) ?
+                             _mem_find_first_fit(&pool_mgr, random_size()) :
+                             _mem_find_best_fit(&pool_mgr, random_size());
+
+        found += gap != MEM_GAP_IX_NIL;
+    }
+
+    const double lookup_ns = (now_ns() - start) / BENCH_LOOKUPS;
+
+    // remove a gap and put it back with a new size, as a split would
+    start = now_ns();
+
+    for (unsigned u = 0; u < BENCH_LOOKUPS; u ++) {
+        node_pt node = &nodes[(unsigned) rand() % num_gaps];
+
+        _mem_remove_from_gap_ix(&pool_mgr, node->alloc_record.size, node);
+
+        node->alloc_record.size = random_size();
+
+        _mem_add_to_gap_ix(&pool_mgr, node->alloc_record.size, node);
+    }
+
+    const double update_ns = (now_ns() - start) / BENCH_LOOKUPS;
+
+    printf("%10u gaps: insert %7.1f ns, lookup %7.1f ns, remove+insert %7.1f ns (%u hits)\n",
+           num_gaps, insert_ns, lookup_ns, update_ns, found);
+
+    free(mem);
+    free(nodes);
+    free(pool_mgr.gap_ix);
+}
+
+
+// First fit the way the node list walk did it, for comparison with the scans
+static unsigned walk_first_fit(pool_mgr_pt pool_mgr, size_t size) {
+    for (node_pt node = _mem_node_at(pool_mgr, 0); node != NULL; node = _mem_node_next(pool_mgr, node)) {
+        if (!node->allocated && node->alloc_record.size >= size) return node->gap;
+    }
+
+    return MEM_GAP_IX_NIL;
+}
+
+// A pool with num_gaps gaps between allocations, from every other one of
+// 2 * num_gaps allocations of the given sizes being freed
+static pool_pt fragmented_pool(unsigned flags, unsigned num_gaps, const size_t *sizes, alloc_pt *allocs) {
+    pool_pt pool = mem_pool_open_flags(BENCH_LATENCY_POOL_SIZE, FIRST_FIT, flags);
+
+    assert(pool);
+
+    for (unsigned u = 0; u < 2 * num_gaps; u ++) {
+        allocs[u] = mem_new_alloc(pool, sizes[u]);
+
+        assert(allocs[u]);
+    }
+
+    for (unsigned u = 0; u < 2 * num_gaps; u += 2) {
+        mem_del_alloc(pool, allocs[u]);
+    }
+
+    return pool;
+}
+
+// Free one of the allocations, which merges it with the gaps on both sides,
+// and allocate its size again
+static void churn_segment(pool_pt pool, alloc_pt *allocs, const size_t *sizes, unsigned u) {
+    mem_del_alloc(pool, allocs[u]);
+
+    allocs[u] = mem_new_alloc(pool, sizes[u]);
+
+    assert(allocs[u]);
+}
+
+static void close_fragmented_pool(pool_pt pool, unsigned num_gaps, alloc_pt *allocs) {
+    for (unsigned u = 1; u < 2 * num_gaps; u += 2) {
+        mem_del_alloc(pool, allocs[u]);
+    }
+
+    mem_pool_close(pool);
+}
+
+// First fit lookups with num_gaps gaps: the node list walk and the gap tree
+// of a plain pool, and the scalar and selected gap scans of a POOL_GAP_SCAN
+// pool with the same segments. Then a free and an allocation in each, which
+// is what keeping the scanned gaps in address order costs.
+static void bench_gap_scan(unsigned num_gaps) {
+    const unsigned lookups = BENCH_LOOKUPS / 10;
+
+    size_t *sizes = (size_t *) calloc(2 * num_gaps, sizeof(size_t));
+    size_t *requests = (size_t *) calloc(lookups, sizeof(size_t));
+    unsigned *victims = (unsigned *) calloc(lookups, sizeof(unsigned));
+    alloc_pt *tree_allocs = (alloc_pt *) calloc(2 * num_gaps, sizeof(alloc_pt));
+    alloc_pt *scan_allocs = (alloc_pt *) calloc(2 * num_gaps, sizeof(alloc_pt));
+
+    assert(sizes && requests && victims && tree_allocs && scan_allocs);
+
+    for (unsigned u = 0; u < 2 * num_gaps; u ++) sizes[u] = random_size();
+    for (unsigned u = 0; u < lookups; u ++) requests[u] = random_size();
+    for (unsigned u = 0; u < lookups; u ++) victims[u] = 2 * ((unsigned) rand() % num_gaps) + 1;
+
+    pool_pt tree_pool = fragmented_pool(0, num_gaps, sizes, tree_allocs);
+    pool_pt scan_pool = fragmented_pool(POOL_GAP_SCAN, num_gaps, sizes, scan_allocs);
+    pool_mgr_pt tree_mgr = (pool_mgr_pt) tree_pool;
+    pool_mgr_pt scan_mgr = (pool_mgr_pt) scan_pool;
+
+    const unsigned gaps = scan_pool->num_gaps;
+    unsigned found = 0;
+
+    double start = now_ns();
+    for (unsigned u = 0; u < lookups; u ++) found += walk_first_fit(tree_mgr, requests[u]) != MEM_GAP_IX_NIL;
+    const double walk_ns = (now_ns() - start) / lookups;
+
+    start = now_ns();
+    for (unsigned u = 0; u < lookups; u ++) found += _mem_find_first_fit(tree_mgr, requests[u]) != MEM_GAP_IX_NIL;
+    const double tree_ns = (now_ns() - start) / lookups;
+
+    start = now_ns();
+    for (unsigned u = 0; u < lookups; u ++) {
+        found += _gap_scan_first_fit_scalar(scan_mgr->gap_sizes, gaps, requests[u]) != MEM_GAP_IX_NIL;
+    }
+    const double scalar_ns = (now_ns() - start) / lookups;
+
+    // whatever _gap_scan_select picked, the vector scan if the CPU has AVX2
+    start = now_ns();
+    for (unsigned u = 0; u < lookups; u ++) {
+        found += _gap_scan_first_fit(scan_mgr->gap_sizes, gaps, requests[u]) != MEM_GAP_IX_NIL;
+    }
+    const double scan_ns = (now_ns() - start) / lookups;
+
+    start = now_ns();
+    for (unsigned u = 0; u < lookups; u ++) churn_segment(tree_pool, tree_allocs, sizes, victims[u]);
+    const double tree_churn_ns = (now_ns() - start) / lookups;
+
+    start = now_ns();
+    for (unsigned u = 0; u < lookups; u ++) churn_segment(scan_pool, scan_allocs, sizes, victims[u]);
+    const double scan_churn_ns = (now_ns() - start) / lookups;
+
+    printf("%10u gaps: list walk %7.1f ns, tree %6.1f ns, scalar scan %6.1f ns, %s scan %6.1f ns (%u hits); free+alloc tree %6.1f ns, scan %7.1f ns\n",
+           gaps, walk_ns, tree_ns, scalar_ns, _gap_scan_first_fit == _gap_scan_first_fit_scalar ? "selected" : "AVX2", scan_ns, found,
+           tree_churn_ns, scan_churn_ns);
+
+    close_fragmented_pool(scan_pool, num_gaps, scan_allocs);
+    close_fragmented_pool(tree_pool, num_gaps, tree_allocs);
+
+    free(scan_allocs);
+    free(tree_allocs);
+    free(victims);
+    free(requests);
+    free(sizes);
+}
+
+
+// Per-call latency of mem_new_alloc/mem_del_alloc on a fragmented pool
+// with a steady number of live allocations of random sizes up to max_size
+static void bench_latency(alloc_policy policy, unsigned flags, size_t max_size) {
+    pool_pt pool = mem_pool_open_flags(BENCH_LATENCY_POOL_SIZE, policy, flags);
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+
+    alloc_pt *live = (alloc_pt *) calloc(BENCH_LATENCY_LIVE, sizeof(alloc_pt));
+    double *alloc_ns = (double *) calloc(BENCH_LATENCY_OPS, sizeof(double));
+    double *free_ns = (double *) calloc(BENCH_LATENCY_OPS, sizeof(double));
+
+    assert(pool && live && alloc_ns && free_ns);
+
+    for (unsigned u = 0; u < BENCH_LATENCY_LIVE; u ++) {
+        live[u] = mem_new_alloc(pool, 1 + (size_t) rand() % max_size);
+
+        assert(live[u]);
+    }
+
+    for (unsigned u = 0; u < BENCH_LATENCY_OPS; u ++) {
+        const unsigned victim = (unsigned) rand() % BENCH_LATENCY_LIVE;
+        const size_t size = 1 + (size_t) rand() % max_size;
+
+        double start = now_ns();
+        mem_del_alloc(pool, live[victim]);
+        free_ns[u] = now_ns() - start;
+
+        start = now_ns();
+        live[victim] = mem_new_alloc(pool, size);
+        alloc_ns[u] = now_ns() - start;
+
+        assert(live[victim]);
+    }
+
+    printf("%s%s (%u live, %u gaps, %u nodes in %lu KiB at the end):\n", policy_name(policy),
+           (flags & POOL_SLAB) ? ((flags & POOL_GAP_SCAN) ? "+SLAB+SCAN" : "+SLAB") : (flags & POOL_BOUNDARY_TAGS) ? "+TAGS" : "", BENCH_LATENCY_LIVE, pool->num_gaps, pool_mgr->used_nodes,
+           (unsigned long) (pool_mgr->total_nodes * sizeof(node_t)) >> 10);
+    print_percentiles("alloc", alloc_ns, BENCH_LATENCY_OPS);
+    print_percentiles("free", free_ns, BENCH_LATENCY_OPS);
+
+    // buddy blocks are rounded up, the pool only counts the requested bytes
+    if (policy == BUDDY) {
+        pool_segment_pt segs = NULL;
+        unsigned num_segs = 0;
+        size_t block_size = 0;
+
+        mem_inspect_pool(pool, &segs, &num_segs);
+
+        for (unsigned u = 0; u < num_segs; u ++) {
+            if (segs[u].allocated) block_size += segs[u].size;
+        }
+
+        printf("  %lu bytes requested in %lu bytes of blocks (%.1f%% internal fragmentation)\n",
+               (unsigned long) pool->alloc_size, (unsigned long) block_size,
+               100.0 * (double) (block_size - pool->alloc_size) / (double) block_size);
+
+        free(segs);
+    }
+
+    for (unsigned u = 0; u < BENCH_LATENCY_LIVE; u ++) {
+        mem_del_alloc(pool, live[u]);
+    }
+
+    mem_pool_close(pool);
+
+    free(free_ns);
+    free(alloc_ns);
+    free(live);
+}
+
+// Pointer allocations on a fragmented pool, with full nodes and the gap tree
+// or with compact nodes and list walks, and what the metadata takes
+static void bench_compact(alloc_policy policy, unsigned flags) {
+    pool_pt pool = mem_pool_open_flags(BENCH_LATENCY_POOL_SIZE, policy, flags);
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+
+    char **live = (char **) calloc(BENCH_COMPACT_LIVE, sizeof(char *));
+    double *alloc_ns = (double *) calloc(BENCH_COMPACT_OPS, sizeof(double));
+    double *free_ns = (double *) calloc(BENCH_COMPACT_OPS, sizeof(double));
+
+    assert(pool && live && alloc_ns && free_ns);
+
+    for (unsigned u = 0; u < BENCH_COMPACT_LIVE; u ++) {
+        live[u] = mem_alloc_ptr(pool, random_size());
+
+        assert(live[u]);
+    }
+
+    for (unsigned u = 0; u < BENCH_COMPACT_OPS; u ++) {
+        const unsigned victim = (unsigned) rand() % BENCH_COMPACT_LIVE;
+        const size_t size = random_size();
+
+        double start = now_ns();
+        mem_free_ptr(pool, live[victim]);
+        free_ns[u] = now_ns() - start;
+
+        start = now_ns();
+        live[victim] = mem_alloc_ptr(pool, size);
+        alloc_ns[u] = now_ns() - start;
+
+        assert(live[victim]);
+    }
+
+    // the node array (or heap and gap index) and the page map
+    const size_t pages = (BENCH_LATENCY_POOL_SIZE >> MEM_PAGE_SHIFT) + 1;
+    const unsigned segments = pool->num_allocs + pool->num_gaps;
+    size_t metadata;
+
+    if (pool_mgr->compact) {
+        metadata = pool_mgr->compact->capacity * sizeof(compact_node_t) + pages * sizeof(uint32_t);
+    } else {
+        metadata = pool_mgr->total_nodes * sizeof(node_t) + pool_mgr->gap_ix_capacity * sizeof(gap_t) + pages * sizeof(node_pt);
+    }
+
+    printf("%s%s (%u live, %u gaps, metadata %lu KiB, %.1f bytes per segment):\n", policy_name(policy),
+           (flags & POOL_COMPACT) ? "+COMPACT" : "", BENCH_COMPACT_LIVE, pool->num_gaps,
+           (unsigned long) metadata >> 10, (double) metadata / segments);
+    print_percentiles("alloc", alloc_ns, BENCH_COMPACT_OPS);
+    print_percentiles("free", free_ns, BENCH_COMPACT_OPS);
+
+    for (unsigned u = 0; u < BENCH_COMPACT_LIVE; u ++) {
+        mem_free_ptr(pool, live[u]);
+    }
+
+    mem_pool_close(pool);
+
+    free(free_ns);
+    free(alloc_ns);
+    free(live);
+}
+
+// Message buffers growing by appends, side by side, each one dropped and
+// started over once it is large. Either resized, or moved by hand.
+static void bench_realloc(alloc_policy policy, unsigned flags, int by_hand) {
+    pool_pt pool = mem_pool_open_flags(BENCH_LATENCY_POOL_SIZE, policy, flags);
+
+    alloc_pt *buffers = (alloc_pt *) calloc(BENCH_REALLOC_BUFFERS, sizeof(alloc_pt));
+
+    assert(pool && buffers);
+
+    for (unsigned u = 0; u < BENCH_REALLOC_BUFFERS; u ++) {
+        buffers[u] = mem_new_alloc(pool, 1);
+
+        assert(buffers[u]);
+    }
+
+    unsigned in_place = 0;
+
+    const double start = now_ns();
+
+    for (unsigned u = 0; u < BENCH_REALLOC_APPENDS; u ++) {
+        const unsigned victim = (unsigned) rand() % BENCH_REALLOC_BUFFERS;
+        alloc_pt buffer = buffers[victim];
+
+        if (buffer->size >= BENCH_REALLOC_MAX_SIZE) {
+            mem_del_alloc(pool, buffer);
+            buffers[victim] = mem_new_alloc(pool, 1);
+            continue;
+        }
+
+        const size_t size = buffer->size + 1 + (size_t) rand() % 256;
+
+        if (by_hand) {
+            buffers[victim] = mem_new_alloc(pool, size);
+            assert(buffers[victim]);
+            memcpy(buffers[victim]->mem, buffer->mem, buffer->size);
+            mem_del_alloc(pool, buffer);
+        } else {
+            const char *mem = buffer->mem;
+
+            buffers[victim] = mem_realloc_alloc(pool, buffer, size);
+            in_place += (buffers[victim]->mem == mem);
+        }
+
+        assert(buffers[victim]);
+    }
+
+    const double append_ns = (now_ns() - start) / BENCH_REALLOC_APPENDS;
+
+    char name[32];
+    snprintf(name, sizeof(name), "%s%s", policy_name(policy), (flags & POOL_BOUNDARY_TAGS) ? "+TAGS" : "");
+
+    printf("  %-11s %-19s %8.1f ns/append", name, by_hand ? "new + memcpy + del" : "mem_realloc_alloc", append_ns);
+
+    if (by_hand) {
+        printf("\n");
+    } else {
+        printf(" (%.1f%% in place)\n", 100.0 * in_place / BENCH_REALLOC_APPENDS);
+    }
+
+    for (unsigned u = 0; u < BENCH_REALLOC_BUFFERS; u ++) {
+        mem_del_alloc(pool, buffers[u]);
+    }
+
+    mem_pool_close(pool);
+
+    free(buffers);
+}
+
+// Messages of 20 to 50 small objects, allocated together, and freed
+// together once BENCH_BATCH_LIVE newer messages have come in
+static void bench_batch(alloc_policy policy, unsigned flags, int batched) {
+    pool_pt pool = mem_pool_open_flags(BENCH_LATENCY_POOL_SIZE, policy, flags);
+
+    alloc_pt *messages = (alloc_pt *) calloc(BENCH_BATCH_LIVE * BENCH_BATCH_MAX_OBJECTS, sizeof(alloc_pt));
+    unsigned *counts = (unsigned *) calloc(BENCH_BATCH_LIVE, sizeof(unsigned));
+
+    assert(pool && messages && counts);
+
+    size_t sizes[BENCH_BATCH_MAX_OBJECTS];
+    unsigned long objects = 0;
+    double alloc_ns = 0;
+    double free_ns = 0;
+
+    for (unsigned u = 0; u < BENCH_BATCH_MESSAGES; u ++) {
+        const unsigned slot = u % BENCH_BATCH_LIVE;
+        alloc_pt *message = messages + slot * BENCH_BATCH_MAX_OBJECTS;
+
+        double start = now_ns();
+
+        if (batched) {
+            mem_del_alloc_batch(pool, message, counts[slot]);
+        } else {
+            for (unsigned v = 0; v < counts[slot]; v ++) {
+                mem_del_alloc(pool, message[v]);
+            }
+        }
+
+        free_ns += now_ns() - start;
+
+        counts[slot] = 20 + (unsigned) rand() % (BENCH_BATCH_MAX_OBJECTS - 20 + 1);
+
+        for (unsigned v = 0; v < counts[slot]; v ++) {
+            sizes[v] = 16 + (size_t) rand() % 241;
+        }
+
+        start = now_ns();
+
+        if (batched) {
+            const alloc_status status = mem_new_alloc_batch(pool, sizes, message, counts[slot]);
+
+            assert(status == ALLOC_OK);
+        } else {
+            for (unsigned v = 0; v < counts[slot]; v ++) {
+                message[v] = mem_new_alloc(pool, sizes[v]);
+
+                assert(message[v]);
+            }
+        }
+
+        alloc_ns += now_ns() - start;
+        objects += counts[slot];
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%s%s", policy_name(policy),
+             (flags & POOL_SLAB) ? "+SLAB" : (flags & POOL_BOUNDARY_TAGS) ? "+TAGS" : "");
+
+    printf("  %-11s %-10s %8.1f ns/object alloc, %6.1f ns/object free\n", name, batched ? "batch" : "one by one",
+           alloc_ns / objects, free_ns / objects);
+
+    for (unsigned u = 0; u < BENCH_BATCH_LIVE; u ++) {
+        for (unsigned v = 0; v < counts[u]; v ++) {
+            mem_del_alloc(pool, messages[u * BENCH_BATCH_MAX_OBJECTS + v]);
+        }
+    }
+
+    mem_pool_close(pool);
+
+    free(counts);
+    free(messages);
+}
+
+// Scratch allocations with nested lifetimes, released a scope at a time:
+// by rolling an ARENA pool back, or one by one, last first, otherwise
+static void scratch_scope(pool_pt pool, unsigned depth, unsigned long *objects) {
+    alloc_pt allocs[BENCH_SCRATCH_MAX_OBJECTS];
+    const unsigned count = 4 + (unsigned) rand() % (BENCH_SCRATCH_MAX_OBJECTS - 4 + 1);
+    const pool_mark_t mark = mem_pool_mark(pool);
+
+    for (unsigned u = 0; u < count; u ++) {
+        allocs[u] = mem_new_alloc(pool, 16 + (size_t) rand() % 241);
+
+        assert(allocs[u]);
+    }
+
+    *objects += count;
+
+    if (depth > 1) {
+        scratch_scope(pool, depth - 1, objects);
+    }
+
+    if (pool->policy == ARENA) {
+        mem_pool_rollback(pool, mark);
+    } else {
+        for (unsigned u = count; u > 0; u --) {
+            mem_del_alloc(pool, allocs[u - 1]);
+        }
+    }
+}
+
+static void bench_scratch(alloc_policy policy, unsigned flags) {
+    pool_pt pool = mem_pool_open_flags(BENCH_LATENCY_POOL_SIZE, policy, flags);
+
+    assert(pool);
+
+    unsigned long objects = 0;
+
+    const double start = now_ns();
+
+    for (unsigned u = 0; u < BENCH_SCRATCH_QUERIES; u ++) {
+        scratch_scope(pool, 1 + (unsigned) rand() % BENCH_SCRATCH_DEPTH, &objects);
+    }
+
+    const double elapsed = now_ns() - start;
+
+    char name[32];
+    snprintf(name, sizeof(name), "%s%s", policy_name(policy),
+             (flags & POOL_SLAB) ? "+SLAB" : (flags & POOL_BOUNDARY_TAGS) ? "+TAGS" : "");
+
+    printf("  %-11s %8.1f ns/object (alloc and free)\n", name, elapsed / objects);
+
+    mem_pool_close(pool);
+}
+
+
+// Reads at random places of a large allocation, where every one is likely
+// a TLB miss unless the pool memory is on huge pages
+static void bench_random_access(unsigned flags) {
+    pool_pt pool = mem_pool_open_flags(BENCH_ACCESS_POOL_SIZE, FIRST_FIT, flags);
+
+    assert(pool);
+
+    alloc_pt alloc = mem_new_alloc(pool, BENCH_ACCESS_POOL_SIZE);
+
+    assert(alloc);
+
+    memset(alloc->mem, 1, BENCH_ACCESS_POOL_SIZE);
+
+    const size_t words = BENCH_ACCESS_POOL_SIZE / sizeof(size_t);
+    const size_t *const mem = (const size_t *) alloc->mem;
+
+    size_t index = 0;
+
+    const double start = now_ns();
+
+    for (unsigned u = 0; u < BENCH_ACCESSES; u ++) {
+        // A cheap random walk, the next place depends on the last read
+        index = (index * 6364136223846793005ULL + 1442695040888963407ULL + mem[index]) % words;
+    }
+
+    const double elapsed = now_ns() - start;
+
+    bench_sink = index;
+
+    printf("  %-11s %8.1f ns/access\n",
+           (flags & POOL_HUGE_PAGES) ? "HUGE_PAGES" : (flags & POOL_MMAP) ? "MMAP" : "malloc",
+           elapsed / BENCH_ACCESSES);
+
+    mem_del_alloc(pool, alloc);
+    mem_pool_close(pool);
+}
+
+
+// Opening a pool and writing all of it once, which is when its pages are
+// faulted in unless the pool was prefaulted
+static void bench_first_touch(unsigned flags) {
+    const double start = now_ns();
+
+    pool_pt pool = mem_pool_open_flags(BENCH_ACCESS_POOL_SIZE, FIRST_FIT, flags);
+
+    assert(pool);
+
+    const double opened = now_ns();
+
+    alloc_pt alloc = mem_new_alloc(pool, BENCH_ACCESS_POOL_SIZE);
+
+    assert(alloc);
+
+    memset(alloc->mem, 1, BENCH_ACCESS_POOL_SIZE);
+
+    const double written = now_ns();
+
+    printf("  %-11s open %8.1f ms (prefault %8.1f ms), first write %8.1f ms\n",
+           (flags & POOL_PREFAULT) ? "PREFAULT" : "-",
+           (opened - start) / 1e6, mem_pool_prefault_ms(pool), (written - opened) / 1e6);
+
+    mem_del_alloc(pool, alloc);
+    mem_pool_close(pool);
+}
+
+
+/*****              driver              *****/
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    srand(42);
+
+    printf("FIRST_FIT gap index (per operation):\n");
+
+    for (unsigned num_gaps = BENCH_MIN_GAPS; num_gaps <= BENCH_MAX_GAPS; num_gaps *= 10) {
+        bench_gap_ix(FIRST_FIT, num_gaps);
+    }
+
+    printf("BEST_FIT gap index (per operation):\n");
+
+    for (unsigned num_gaps = BENCH_MIN_GAPS; num_gaps <= BENCH_MAX_GAPS; num_gaps *= 10) {
+        bench_gap_ix(BEST_FIT, num_gaps);
+    }
+
+    mem_init();
+
+    printf("FIRST_FIT gap scans (per lookup):\n");
+
+    for (unsigned num_gaps = 16; num_gaps <= BENCH_SCAN_GAPS; num_gaps *= 4) {
+        bench_gap_scan(num_gaps);
+    }
+
+    printf("Allocation latency:\n");
+
+    bench_latency(FIRST_FIT, 0, BENCH_MAX_GAP);
+    bench_latency(NEXT_FIT, 0, BENCH_MAX_GAP);
+    bench_latency(BEST_FIT, 0, BENCH_MAX_GAP);
+    bench_latency(TLSF, 0, BENCH_MAX_GAP);
+    bench_latency(TLSF, POOL_BOUNDARY_TAGS, BENCH_MAX_GAP);
+    bench_latency(BUDDY, 0, BENCH_MAX_GAP);
+
+    printf("Small object latency (up to %u bytes):\n", BENCH_SMALL_SIZE);
+
+    bench_latency(FIRST_FIT, 0, BENCH_SMALL_SIZE);
+    bench_latency(FIRST_FIT, POOL_SLAB, BENCH_SMALL_SIZE);
+    bench_latency(FIRST_FIT, POOL_SLAB | POOL_GAP_SCAN, BENCH_SMALL_SIZE);
+    bench_latency(TLSF, 0, BENCH_SMALL_SIZE);
+    bench_latency(TLSF, POOL_SLAB, BENCH_SMALL_SIZE);
+    bench_latency(TLSF, POOL_BOUNDARY_TAGS, BENCH_SMALL_SIZE);
+
+    printf("Compact nodes (pointer API):\n");
+
+    bench_compact(FIRST_FIT, 0);
+    bench_compact(FIRST_FIT, POOL_COMPACT);
+    bench_compact(BEST_FIT, 0);
+    bench_compact(BEST_FIT, POOL_COMPACT);
+
+    printf("Growing buffers (%u, up to %lu KiB):\n", BENCH_REALLOC_BUFFERS, (unsigned long) BENCH_REALLOC_MAX_SIZE >> 10);
+
+    bench_realloc(FIRST_FIT, 0, 1);
+    bench_realloc(FIRST_FIT, 0, 0);
+    bench_realloc(TLSF, 0, 1);
+    bench_realloc(TLSF, 0, 0);
+    bench_realloc(TLSF, POOL_BOUNDARY_TAGS, 1);
+    bench_realloc(TLSF, POOL_BOUNDARY_TAGS, 0);
+
+    printf("Messages (%u to %u objects of up to 256 bytes):\n", 20, BENCH_BATCH_MAX_OBJECTS);
+
+    bench_batch(FIRST_FIT, 0, 0);
+    bench_batch(FIRST_FIT, 0, 1);
+    bench_batch(TLSF, 0, 0);
+    bench_batch(TLSF, 0, 1);
+    bench_batch(TLSF, POOL_SLAB, 0);
+    bench_batch(TLSF, POOL_SLAB, 1);
+    bench_batch(TLSF, POOL_BOUNDARY_TAGS, 0);
+    bench_batch(TLSF, POOL_BOUNDARY_TAGS, 1);
+
+    printf("Nested scratch scopes (up to %u deep):\n", BENCH_SCRATCH_DEPTH);
+
+    bench_scratch(FIRST_FIT, 0);
+    bench_scratch(TLSF, 0);
+    bench_scratch(TLSF, POOL_SLAB);
+    bench_scratch(TLSF, POOL_BOUNDARY_TAGS);
+    bench_scratch(STACK, 0);
+    bench_scratch(ARENA, 0);
+
+    printf("Random reads (%lu MiB pool):\n", (unsigned long) (BENCH_ACCESS_POOL_SIZE >> 20));
+
+    bench_random_access(0);
+    bench_random_access(POOL_MMAP);
+    bench_random_access(POOL_HUGE_PAGES);
+
+    printf("First touch (%lu MiB pool):\n", (unsigned long) (BENCH_ACCESS_POOL_SIZE >> 20));
+
+    bench_first_touch(0);
+    bench_first_touch(POOL_PREFAULT);
+
+    mem_free();
+
+    return 0;
+}
@@ -2,12 +2,22 @@
 // Created by Ivo Georgiev on 3/3/16.
 //
 
+// mincore and sysconf, for checking which pool pages are resident, and
+// fork, for leaving a pool file open
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <setjmp.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
 #include "cmocka.h"
 #include "mem_pool.h"
@@ -2316,141 +2326,2651 @@ static void test_pool_scenario19(void **state) {
 }
 
 /*******************************************/
-/***          5. STRESS TEST             ***/
-/***                                     ***/
-/***         [non-functional]            ***/
-/***         [see NOTE below]            ***/
+/***          5. TLSF SCENARIOS          ***/
 /*******************************************/
 
-void test_pool_stresstest(void **state) {
-    (void) state; /* unused */
+static int pool_tlsf_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = TLSF;
+    pool_pt pool = NULL;
 
-    const unsigned num_pools = 200;
-    const unsigned num_allocations = 1000;
-    const unsigned min_alloc_size = 10;
-    const unsigned pool_size =
-            (num_allocations / 2) *
-            (2 * min_alloc_size + (num_allocations - 1) * min_alloc_size);
-    assert_int_equal(pool_size, 5005000);
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "TLSF");
+    pool = mem_pool_open(POOL_SIZE, POOL_POLICY);
+    assert_non_null(pool);
 
+    *state = pool;
 
-    pool_pt pools[num_pools];
-    alloc_pt allocations[num_pools][num_allocations];
+    return 0;
+}
+
+static int pool_tlsf_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario20(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
 
     /*
-     * NOTE: This will work iff the address of the allocation
-     * in the pool is returned to the user instead of the
-     * address of the allocation record. Since allocation records
-     * are a part of the nodes, when the node heap is reallocated
-     * the node addresses shift with it, and so do the allocation
-     * record addresses. The allocation addresses on the pool
-     * remain the same, however, so they can be returned to the
-     * user and gotten from the user upon request for deletion.
+     * Scenario 20:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 100, 1000, 10000.
+     * 3. Deallocate the 1000. There is a gap in the middle.
+     * 4. Allocate 500. It comes out of the 1000 gap, whose size
+     *    class is above the one 500 rounds up to.
+     * 5. Deallocate the 100. It doesn't touch any gap.
+     * 6. Deallocate the 500. It merges with the gaps on both sides.
+     * 7. Deallocate the 10000. Pool is again one single gap.
      */
 
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0}
+            };
+    check_metadata(pool, TLSF, POOL_SIZE, 0, 0, 1);
+
+
+    alloc_pt alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    alloc_pt alloc1 = mem_new_alloc(pool, 1000);
+    assert_non_null(alloc1);
+    alloc_pt alloc2 = mem_new_alloc(pool, 10000);
+    assert_non_null(alloc2);
+
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp1[4] =
+            {
+                    {100, 1},
+                    {1000, 0},
+                    {10000, 1},
+                    {pool->total_size - 11100, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, TLSF, POOL_SIZE, 10100, 2, 2);
+
+
+    alloc1 = mem_new_alloc(pool, 500);
+    assert_non_null(alloc1);
+
+    pool_segment_t exp2[5] =
+            {
+                    {100, 1},
+                    {500, 1},
+                    {500, 0},
+                    {10000, 1},
+                    {pool->total_size - 11100, 0}
+            };
+    check_pool(pool, exp2);
+
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp3[5] =
+            {
+                    {100, 0},
+                    {500, 1},
+                    {500, 0},
+                    {10000, 1},
+                    {pool->total_size - 11100, 0}
+            };
+    check_pool(pool, exp3);
+
+
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp4[3] =
+            {
+                    {1100, 0},
+                    {10000, 1},
+                    {pool->total_size - 11100, 0}
+            };
+    check_pool(pool, exp4);
+    check_metadata(pool, TLSF, POOL_SIZE, 10000, 1, 2);
+
+
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_pool(pool, exp0);
+}
+
+/*******************************************/
+/***          6. BUDDY SCENARIOS         ***/
+/*******************************************/
+
+static int pool_buddy_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = BUDDY;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "BUDDY");
+    pool = mem_pool_open(POOL_SIZE, POOL_POLICY);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_buddy_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario21(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
     /*
-     * Testing dynamic reallocation of pool structures:
+     * Scenario 21:
      *
-     * 1. 200 pools of 5005000 each (many pools)
-     * 2. In each pool 1000 allocations of different sizes (many allocations)
-     * 3. In each pool 500 deallocations (many gaps)
+     * 1. Pool starts out carved into power-of-two blocks,
+     *    one per set bit of the pool size.
+     * 2. Allocate 100. It rounds up to 128 and the smallest
+     *    block that fits (512) is split twice.
+     * 3. Allocate 100. It takes the 128 buddy.
+     * 4. Deallocate the first 100. Its buddy is allocated,
+     *    so nothing merges.
+     * 5. Deallocate the second 100. The buddies merge back
+     *    up into the 512 block.
      */
 
-    // initialize store
-    assert_int_equal(mem_init(), ALLOC_OK);
+    pool_segment_t exp0[7] =
+            {
+                    {524288, 0},
+                    {262144, 0},
+                    {131072, 0},
+                    {65536, 0},
+                    {16384, 0},
+                    {512, 0},
+                    {64, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, BUDDY, POOL_SIZE, 0, 0, 7);
 
-    // allocate pools
-    for (unsigned pix=0; pix < num_pools; ++pix) {
-        // open pool
-        pools[pix] =
-                mem_pool_open(pool_size, (pix % 2) ? FIRST_FIT : BEST_FIT);
-        assert_non_null(pools[pix]);
-        // allocate pool
-        unsigned allocated = 0;
-        for (unsigned aix=0; aix < num_allocations; ++aix) {
-            allocations[pix][aix] =
-                    mem_new_alloc(pools[pix], (aix + 1) * min_alloc_size);
-            allocated += (aix + 1) * min_alloc_size;
-            if (!allocations[pix][aix]) {
-                INFO("ASSERT WILL FAIL at pix = %u, aix = %u, allocated = %u\n", pix, aix, allocated);
-            }
-            assert_non_null(allocations[pix][aix]);
-        }
-        // delete every other allocation
-        for (unsigned aix=0; aix < num_allocations; ++aix) {
-            if (aix % 2) {
-                assert_int_equal(
-                        mem_del_alloc(pools[pix], allocations[pix][aix]),
-                        ALLOC_OK);
-                allocations[pix][aix] = NULL;
-            }
-        }
-    }
 
-    // delete pools
-    for (unsigned pix=0; pix < num_pools; ++pix) {
-        // delete pool's allocations
-        for (unsigned aix=0; aix < num_allocations; ++aix) {
-            if (allocations[pix][aix]) {
-                // delete allocation
-                assert_int_equal(
-                    mem_del_alloc(pools[pix], allocations[pix][aix]),
-                    ALLOC_OK);
-            }
-        }
-        // close pool
-        assert_int_equal(mem_pool_close(pools[pix]), ALLOC_OK);
-    }
+    alloc_pt alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+
+    pool_segment_t exp1[9] =
+            {
+                    {524288, 0},
+                    {262144, 0},
+                    {131072, 0},
+                    {65536, 0},
+                    {16384, 0},
+                    {128, 1},
+                    {128, 0},
+                    {256, 0},
+                    {64, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, BUDDY, POOL_SIZE, 100, 1, 8);
+
+
+    alloc_pt alloc1 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc1);
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+
+    // the pool reports whole blocks, the metadata requested bytes
+    pool_segment_t exp2[9] =
+            {
+                    {524288, 0},
+                    {262144, 0},
+                    {131072, 0},
+                    {65536, 0},
+                    {16384, 0},
+                    {128, 0},
+                    {128, 1},
+                    {256, 0},
+                    {64, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, BUDDY, POOL_SIZE, 100, 1, 8);
 
-    // free store
-    assert_int_equal(mem_free(), ALLOC_OK);
-}
 
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_pool(pool, exp0);
+    check_metadata(pool, BUDDY, POOL_SIZE, 0, 0, 7);
+}
 
 /*******************************************/
-/***         6. DRIVER ROUTINE           ***/
+/***          7. SLAB SCENARIOS          ***/
 /*******************************************/
 
-int run_test_suite() {
-    const struct CMUnitTest tests[] = {
-            cmocka_unit_test(test_pool_store_smoketest),
-            cmocka_unit_test(test_pool_smoketest),
+static int pool_slab_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = FIRST_FIT;
+    pool_pt pool = NULL;
 
-            cmocka_unit_test(test_pool_nonempty),
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
 
-            cmocka_unit_test_setup_teardown(test_pool_ff_metadata, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_bf_metadata, pool_bf_setup, pool_bf_teardown),
+    INFO("Allocating pool of %lu bytes with policy %s and slabs\n",
+         (long) POOL_SIZE, "FIRST_FIT");
+    pool = mem_pool_open_flags(POOL_SIZE, POOL_POLICY, POOL_SLAB);
+    assert_non_null(pool);
 
-            cmocka_unit_test_setup_teardown(test_pool_scenario00, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario01, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario02, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario03, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario04, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario05, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario06, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario07, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario08, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario09, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario10, pool_ff_setup, pool_ff_teardown),
+    *state = pool;
 
-            cmocka_unit_test_setup_teardown(test_pool_scenario11, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario12, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario13, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario14, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario15, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario16, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario17, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario18, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario19, pool_bf_setup, pool_bf_teardown),
+    return 0;
+}
+
+static int pool_slab_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario22(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 22:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 65 x 16. The first 64 fill one slab run, which
+     *    is a single allocation in the pool, the last one starts
+     *    a second run.
+     * 3. Allocate 1000. It is too large for a slab.
+     * 4. Deallocate the last 16. Its run is empty, but it's the
+     *    only one of its class with free objects, so it stays.
+     * 5. Deallocate the first 64 x 16. Their run is given back.
+     * 6. Deallocate the 1000. The empty run is released on close.
+     */
+
+    const unsigned NUM_SMALL = 65;
+    alloc_pt small[65];
+
+    for (unsigned u = 0; u < NUM_SMALL; u ++) {
+        small[u] = mem_new_alloc(pool, 16);
+        assert_non_null(small[u]);
+    }
+
+    assert_ptr_equal(small[1]->mem, small[0]->mem + 16);
+    assert_ptr_equal(small[64]->mem, small[0]->mem + 1024);
+
+    alloc_pt alloc0 = mem_new_alloc(pool, 1000);
+    assert_non_null(alloc0);
+
+    pool_segment_t exp0[4] =
+            {
+                    {1024, 1},
+                    {1024, 1},
+                    {1000, 1},
+                    {pool->total_size - 3048, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 65 * 16 + 1000, 66, 1);
+
+
+    status = mem_del_alloc(pool, small[64]);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 64 * 16 + 1000, 65, 1);
+
+
+    for (unsigned u = 0; u < 64; u ++) {
+        status = mem_del_alloc(pool, small[u]);
+        assert_int_equal(status, ALLOC_OK);
+    }
+
+    pool_segment_t exp1[4] =
+            {
+                    {1024, 0},
+                    {1024, 1},
+                    {1000, 1},
+                    {pool->total_size - 3048, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 1000, 1, 2);
+
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp2[3] =
+            {
+                    {1024, 0},
+                    {1024, 1},
+                    {pool->total_size - 2048, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 2);
+}
+
+/*******************************************/
+/***        8. NEXT_FIT SCENARIOS        ***/
+/*******************************************/
+
+static int pool_nf_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = NEXT_FIT;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "NEXT_FIT");
+    pool = mem_pool_open(POOL_SIZE, POOL_POLICY);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_nf_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario23(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 23:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 100, 200, 300.
+     * 3. Deallocate the 100. There is a gap at the top.
+     * 4. Allocate 50. It goes after the 300, where the last
+     *    allocation ended, not in the gap at the top.
+     * 5. Allocate the rest of the pool.
+     * 6. Allocate 10. Nothing fits after the last allocation,
+     *    so the search wraps around to the gap at the top.
+     * 7. Deallocate everything. Pool is again one single gap.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0}
+            };
+    check_metadata(pool, NEXT_FIT, POOL_SIZE, 0, 0, 1);
+
+
+    alloc_pt alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    alloc_pt alloc1 = mem_new_alloc(pool, 200);
+    assert_non_null(alloc1);
+    alloc_pt alloc2 = mem_new_alloc(pool, 300);
+    assert_non_null(alloc2);
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+
+    alloc_pt alloc3 = mem_new_alloc(pool, 50);
+    assert_non_null(alloc3);
+
+    pool_segment_t exp1[5] =
+            {
+                    {100, 0},
+                    {200, 1},
+                    {300, 1},
+                    {50, 1},
+                    {pool->total_size - 650, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, NEXT_FIT, POOL_SIZE, 550, 3, 2);
+
+
+    alloc_pt alloc4 = mem_new_alloc(pool, pool->total_size - 650);
+    assert_non_null(alloc4);
+
+    alloc_pt alloc5 = mem_new_alloc(pool, 10);
+    assert_non_null(alloc5);
+
+    pool_segment_t exp2[6] =
+            {
+                    {10, 1},
+                    {90, 0},
+                    {200, 1},
+                    {300, 1},
+                    {50, 1},
+                    {pool->total_size - 650, 1}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, NEXT_FIT, POOL_SIZE, pool->total_size - 90, 5, 1);
+
+
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc3);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc4);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc5);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_pool(pool, exp0);
+}
+
+/*******************************************/
+/***      9. POINTER API SCENARIOS       ***/
+/*******************************************/
+
+static void test_pool_scenario24(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 24:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 100, 5000, 100 by pointer. The 5000 spans
+     *    more than one page.
+     * 3. Deallocating an address inside an allocation, or outside
+     *    the pool, fails and changes nothing.
+     * 4. Deallocate the 5000 by pointer. There is a gap in the middle.
+     * 5. Deallocating the 5000 again fails, it's in a gap now.
+     * 6. Deallocate the rest by pointer. Pool is again one single gap.
+     * 7. Allocate 0 and 100 by pointer. The 0 gets a byte, so the two
+     *    are different addresses, and each deallocates its own.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0}
+            };
+
+    char *mem0 = mem_alloc_ptr(pool, 100);
+    assert_non_null(mem0);
+    char *mem1 = mem_alloc_ptr(pool, 5000);
+    assert_non_null(mem1);
+    char *mem2 = mem_alloc_ptr(pool, 100);
+    assert_non_null(mem2);
+
+    assert_ptr_equal(mem0, pool->mem);
+    assert_ptr_equal(mem1, pool->mem + 100);
+    assert_ptr_equal(mem2, pool->mem + 5100);
+
+    pool_segment_t exp1[4] =
+            {
+                    {100, 1},
+                    {5000, 1},
+                    {100, 1},
+                    {pool->total_size - 5200, 0}
+            };
+    check_pool(pool, exp1);
+
+
+    status = mem_free_ptr(pool, mem1 + 4500);
+    assert_int_equal(status, ALLOC_FAIL);
+    status = mem_free_ptr(pool, pool->mem + pool->total_size);
+    assert_int_equal(status, ALLOC_FAIL);
+
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 5200, 3, 1);
+
+
+    status = mem_free_ptr(pool, mem1);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp2[4] =
+            {
+                    {100, 1},
+                    {5000, 0},
+                    {100, 1},
+                    {pool->total_size - 5200, 0}
+            };
+    check_pool(pool, exp2);
+
+    status = mem_free_ptr(pool, mem1);
+    assert_int_equal(status, ALLOC_FAIL);
+
+
+    status = mem_free_ptr(pool, mem0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_free_ptr(pool, mem2);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+
+
+    mem0 = mem_alloc_ptr(pool, 0);
+    assert_non_null(mem0);
+    mem1 = mem_alloc_ptr(pool, 100);
+    assert_non_null(mem1);
+
+    assert_ptr_equal(mem0, pool->mem);
+    assert_ptr_equal(mem1, pool->mem + 1);
+
+    pool_segment_t exp3[3] =
+            {
+                    {1, 1},
+                    {100, 1},
+                    {pool->total_size - 101, 0}
+            };
+    check_pool(pool, exp3);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 101, 2, 1);
+
+    status = mem_free_ptr(pool, mem0);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp4[3] =
+            {
+                    {1, 0},
+                    {100, 1},
+                    {pool->total_size - 101, 0}
+            };
+    check_pool(pool, exp4);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 100, 1, 2);
+
+    status = mem_free_ptr(pool, mem1);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+static void test_pool_scenario25(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 25:
+     *
+     * 1. Allocate 3 x 48 by pointer. They come out of one slab run.
+     * 2. Deallocating an address inside an object fails.
+     * 3. Deallocate the middle one by pointer, then again, which fails.
+     * 4. Allocate 48 by pointer. It takes the freed object.
+     * 5. Deallocate all by pointer.
+     */
+
+    char *mem[3];
+
+    for (unsigned u = 0; u < 3; u ++) {
+        mem[u] = mem_alloc_ptr(pool, 48);
+        assert_non_null(mem[u]);
+        assert_ptr_equal(mem[u], pool->mem + u * 48);
+    }
+
+    status = mem_free_ptr(pool, mem[1] + 8);
+    assert_int_equal(status, ALLOC_FAIL);
+
+    status = mem_free_ptr(pool, mem[1]);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_free_ptr(pool, mem[1]);
+    assert_int_equal(status, ALLOC_FAIL);
+
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 96, 2, 1);
+
+
+    char *again = mem_alloc_ptr(pool, 48);
+    assert_ptr_equal(again, mem[1]);
+
+    for (unsigned u = 0; u < 3; u ++) {
+        status = mem_free_ptr(pool, mem[u]);
+        assert_int_equal(status, ALLOC_OK);
+    }
+
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+/*******************************************/
+/***     10. BOUNDARY TAG SCENARIOS      ***/
+/*******************************************/
+
+static int pool_tags_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = TLSF;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s and boundary tags\n",
+         (long) POOL_SIZE, "TLSF");
+    pool = mem_pool_open_flags(POOL_SIZE, POOL_POLICY, POOL_BOUNDARY_TAGS);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_tags_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario26(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 26:
+     *
+     * 1. Boundary tags only go with TLSF, and not with slabs.
+     * 2. Allocate 100, 1000, 100. Each block has a 32-byte header
+     *    in front of the memory and is rounded up to 16 bytes.
+     * 3. Deallocate the 1000 by pointer. Deallocating inside it fails.
+     * 4. Allocate 200. It splits the freed block.
+     * 5. Deallocate the first 100, then the 200. The 200 merges with
+     *    both neighbours.
+     * 6. Deallocate the last 100. Pool is again one single gap.
+     */
+
+    assert_null(mem_pool_open_flags(POOL_SIZE, FIRST_FIT, POOL_BOUNDARY_TAGS));
+    assert_null(mem_pool_open_flags(POOL_SIZE, TLSF, POOL_BOUNDARY_TAGS | POOL_SLAB));
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0}
+            };
+    check_pool(pool, exp0);
+
+    char *mem0 = mem_alloc_ptr(pool, 100);
+    assert_non_null(mem0);
+    char *mem1 = mem_alloc_ptr(pool, 1000);
+    assert_non_null(mem1);
+    alloc_pt alloc2 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc2);
+
+    assert_ptr_equal(mem0, pool->mem + 32);
+    assert_ptr_equal(mem1, pool->mem + 144 + 32);
+    assert_ptr_equal(alloc2->mem, pool->mem + 1184 + 32);
+
+    pool_segment_t exp1[4] =
+            {
+                    {144, 1},
+                    {1040, 1},
+                    {144, 1},
+                    {pool->total_size - 1328, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, TLSF, POOL_SIZE, 1200, 3, 1);
+
+
+    status = mem_free_ptr(pool, mem1 + 16);
+    assert_int_equal(status, ALLOC_FAIL);
+    status = mem_free_ptr(pool, mem1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_free_ptr(pool, mem1);
+    assert_int_equal(status, ALLOC_FAIL);
+
+    pool_segment_t exp2[4] =
+            {
+                    {144, 1},
+                    {1040, 0},
+                    {144, 1},
+                    {pool->total_size - 1328, 0}
+            };
+    check_pool(pool, exp2);
+
+
+    char *mem3 = mem_alloc_ptr(pool, 200);
+    assert_ptr_equal(mem3, mem1);
+
+    pool_segment_t exp3[5] =
+            {
+                    {144, 1},
+                    {240, 1},
+                    {800, 0},
+                    {144, 1},
+                    {pool->total_size - 1328, 0}
+            };
+    check_pool(pool, exp3);
+    check_metadata(pool, TLSF, POOL_SIZE, 400, 3, 2);
+
+
+    status = mem_free_ptr(pool, mem0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_free_ptr(pool, mem3);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp4[3] =
+            {
+                    {1184, 0},
+                    {144, 1},
+                    {pool->total_size - 1328, 0}
+            };
+    check_pool(pool, exp4);
+
+
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_pool(pool, exp0);
+    check_metadata(pool, TLSF, POOL_SIZE, 0, 0, 1);
+}
+
+/*******************************************/
+/***       11. GAP SCAN SCENARIOS        ***/
+/*******************************************/
+
+static int pool_scan_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = FIRST_FIT;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s and gap scans\n",
+         (long) POOL_SIZE, "FIRST_FIT");
+    pool = mem_pool_open_flags(POOL_SIZE, POOL_POLICY, POOL_GAP_SCAN);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_scan_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario27(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 27:
+     *
+     * 1. Gap scans only go with FIRST_FIT, NEXT_FIT and BEST_FIT.
+     * 2. Allocate 100, 200, 300, 400, 500.
+     * 3. Deallocate the 200 and the 400.
+     * 4. Allocate 150. It goes in the lowest gap, where the 200 was.
+     * 5. Allocate 300. The rest of that gap is too small, it goes
+     *    where the 400 was.
+     * 6. Deallocate all. Pool is again one single gap.
+     */
+
+    assert_null(mem_pool_open_flags(POOL_SIZE, TLSF, POOL_GAP_SCAN));
+    assert_null(mem_pool_open_flags(POOL_SIZE, BUDDY, POOL_GAP_SCAN));
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0}
+            };
+
+    alloc_pt alloc[5];
+
+    for (unsigned u = 0; u < 5; u ++) {
+        alloc[u] = mem_new_alloc(pool, 100 * (u + 1));
+        assert_non_null(alloc[u]);
+    }
+
+    status = mem_del_alloc(pool, alloc[1]);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc[3]);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp1[6] =
+            {
+                    {100, 1},
+                    {200, 0},
+                    {300, 1},
+                    {400, 0},
+                    {500, 1},
+                    {pool->total_size - 1500, 0}
+            };
+    check_pool(pool, exp1);
+
+
+    alloc_pt alloc5 = mem_new_alloc(pool, 150);
+    assert_ptr_equal(alloc5->mem, pool->mem + 100);
+    alloc_pt alloc6 = mem_new_alloc(pool, 300);
+    assert_ptr_equal(alloc6->mem, pool->mem + 600);
+
+    pool_segment_t exp2[8] =
+            {
+                    {100, 1},
+                    {150, 1},
+                    {50, 0},
+                    {300, 1},
+                    {300, 1},
+                    {100, 0},
+                    {500, 1},
+                    {pool->total_size - 1500, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 1350, 5, 3);
+
+
+    alloc_pt rest[5] = {alloc[0], alloc[2], alloc[4], alloc5, alloc6};
+
+    for (unsigned u = 0; u < 5; u ++) {
+        status = mem_del_alloc(pool, rest[u]);
+        assert_int_equal(status, ALLOC_OK);
+    }
+
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+/*******************************************/
+/***  12. REALLOC AND ALIGNED SCENARIOS  ***/
+/*******************************************/
+
+static void test_pool_scenario28(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 28:
+     *
+     * 1. Allocate 100, 200, 300.
+     * 2. Grow the 300 to 500. It grows into the gap above, in place.
+     * 3. Shrink the 200 to 150. A 50 gap is split off after it.
+     * 4. Grow the 150 to 180, then to 200. It takes the 50 gap, in
+     *    place, until the gap is gone.
+     * 5. Grow the 100 to 300. There is no gap above it, so it moves
+     *    to the end, contents and all, and leaves a gap behind.
+     * 6. Shrink the 500 to 400. The 100 tail becomes a new gap.
+     * 7. Deallocate all. Pool is again one single gap.
+     */
+
+    alloc_pt alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    alloc_pt alloc1 = mem_new_alloc(pool, 200);
+    assert_non_null(alloc1);
+    alloc_pt alloc2 = mem_new_alloc(pool, 300);
+    assert_non_null(alloc2);
+
+    for (unsigned u = 0; u < 100; u ++) {
+        alloc0->mem[u] = (char) u;
+    }
+
+
+    alloc_pt realloc2 = mem_realloc_alloc(pool, alloc2, 500);
+    assert_ptr_equal(realloc2, alloc2);
+    assert_ptr_equal(alloc2->mem, pool->mem + 300);
+
+    pool_segment_t exp0[4] =
+            {
+                    {100, 1},
+                    {200, 1},
+                    {500, 1},
+                    {pool->total_size - 800, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 800, 3, 1);
+
+
+    alloc_pt realloc1 = mem_realloc_alloc(pool, alloc1, 150);
+    assert_ptr_equal(realloc1, alloc1);
+
+    pool_segment_t exp1[5] =
+            {
+                    {100, 1},
+                    {150, 1},
+                    {50, 0},
+                    {500, 1},
+                    {pool->total_size - 800, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 750, 3, 2);
+
+
+    realloc1 = mem_realloc_alloc(pool, alloc1, 180);
+    assert_ptr_equal(realloc1, alloc1);
+
+    pool_segment_t exp2[5] =
+            {
+                    {100, 1},
+                    {180, 1},
+                    {20, 0},
+                    {500, 1},
+                    {pool->total_size - 800, 0}
+            };
+    check_pool(pool, exp2);
+
+    realloc1 = mem_realloc_alloc(pool, alloc1, 200);
+    assert_ptr_equal(realloc1, alloc1);
+
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 800, 3, 1);
+
+
+    alloc_pt realloc0 = mem_realloc_alloc(pool, alloc0, 300);
+    assert_non_null(realloc0);
+    assert_ptr_equal(realloc0->mem, pool->mem + 800);
+
+    for (unsigned u = 0; u < 100; u ++) {
+        assert_int_equal(realloc0->mem[u], (char) u);
+    }
+
+    pool_segment_t exp3[5] =
+            {
+                    {100, 0},
+                    {200, 1},
+                    {500, 1},
+                    {300, 1},
+                    {pool->total_size - 1100, 0}
+            };
+    check_pool(pool, exp3);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 1000, 3, 2);
+
+
+    realloc2 = mem_realloc_alloc(pool, alloc2, 400);
+    assert_ptr_equal(realloc2, alloc2);
+
+    pool_segment_t exp4[6] =
+            {
+                    {100, 0},
+                    {200, 1},
+                    {400, 1},
+                    {100, 0},
+                    {300, 1},
+                    {pool->total_size - 1100, 0}
+            };
+    check_pool(pool, exp4);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 900, 3, 3);
+
+
+    status = mem_del_alloc(pool, realloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, realloc1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, realloc2);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp5[1] =
+            {
+                    {pool->total_size, 0}
+            };
+    check_pool(pool, exp5);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+static void test_pool_scenario29(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 29:
+     *
+     * 1. Allocate 100.
+     * 2. Allocate 200 aligned to 64. It starts at 128, and the 28
+     *    bytes of padding before it become a gap.
+     * 3. Allocate 1000 aligned to 4096. The padding before it
+     *    becomes a gap too.
+     * 4. Allocate 20. It goes into the first padding gap.
+     * 5. An alignment that isn't a power of two fails.
+     * 6. Deallocate all. Pool is again one single gap.
+     */
+
+    alloc_pt alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+
+    alloc_pt alloc1 = mem_new_alloc_aligned(pool, 200, 64);
+    assert_non_null(alloc1);
+    assert_int_equal((uintptr_t) alloc1->mem % 64, 0);
+    assert_ptr_equal(alloc1->mem, pool->mem + 128);
+
+    pool_segment_t exp0[4] =
+            {
+                    {100, 1},
+                    {28, 0},
+                    {200, 1},
+                    {pool->total_size - 328, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 300, 2, 2);
+
+
+    alloc_pt alloc2 = mem_new_alloc_aligned(pool, 1000, 4096);
+    assert_non_null(alloc2);
+    assert_int_equal((uintptr_t) alloc2->mem % 4096, 0);
+    assert_ptr_equal(alloc2->mem, pool->mem + 4096);
+
+    alloc_pt alloc3 = mem_new_alloc(pool, 20);
+    assert_non_null(alloc3);
+    assert_ptr_equal(alloc3->mem, pool->mem + 100);
+
+    pool_segment_t exp1[7] =
+            {
+                    {100, 1},
+                    {20, 1},
+                    {8, 0},
+                    {200, 1},
+                    {3768, 0},
+                    {1000, 1},
+                    {pool->total_size - 5096, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 1320, 4, 3);
+
+
+    assert_null(mem_new_alloc_aligned(pool, 100, 48));
+
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc3);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp2[1] =
+            {
+                    {pool->total_size, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+/*******************************************/
+/***         13. BATCH SCENARIOS         ***/
+/*******************************************/
+
+static void test_pool_scenario30(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 30:
+     *
+     * 1. Allocate 100.
+     * 2. Allocate 50, 0, 200, 70 as a batch. They are carved back
+     *    to back out of the gap after the 100, in order.
+     * 3. A batch larger than the pool fails and changes nothing.
+     * 4. Deallocate all. Pool is again one single gap.
+     */
+
+    alloc_pt alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+
+    const size_t sizes[4] = {50, 0, 200, 70};
+    alloc_pt batch[4];
+
+    status = mem_new_alloc_batch(pool, sizes, batch, 4);
+    assert_int_equal(status, ALLOC_OK);
+
+    assert_ptr_equal(batch[0]->mem, pool->mem + 100);
+    assert_ptr_equal(batch[1]->mem, pool->mem + 150);
+    assert_ptr_equal(batch[2]->mem, pool->mem + 150);
+    assert_ptr_equal(batch[3]->mem, pool->mem + 350);
+
+    pool_segment_t exp0[6] =
+            {
+                    {100, 1},
+                    {50, 1},
+                    {0, 1},
+                    {200, 1},
+                    {70, 1},
+                    {pool->total_size - 420, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 420, 5, 1);
+
+
+    const size_t too_large[2] = {POOL_SIZE / 2, POOL_SIZE / 2};
+    alloc_pt none[2];
+
+    status = mem_new_alloc_batch(pool, too_large, none, 2);
+    assert_int_equal(status, ALLOC_FAIL);
+
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 420, 5, 1);
+
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+
+    for (unsigned u = 0; u < 4; u ++) {
+        status = mem_del_alloc(pool, batch[u]);
+        assert_int_equal(status, ALLOC_OK);
+    }
+
+    pool_segment_t exp1[1] =
+            {
+                    {pool->total_size, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+static void test_pool_scenario31(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 31:
+     *
+     * 1. Allocate 6 x 100.
+     * 2. Deallocate the 5th, 2nd, 3rd and 6th as a batch. The 2nd
+     *    and 3rd merge into one gap, the 5th and 6th merge with the
+     *    gap at the end.
+     * 3. Deallocate the other two as a batch. Pool is again one
+     *    single gap.
+     */
+
+    alloc_pt allocs[6];
+
+    for (unsigned u = 0; u < 6; u ++) {
+        allocs[u] = mem_new_alloc(pool, 100);
+        assert_non_null(allocs[u]);
+    }
+
+    alloc_pt batch0[4] = {allocs[4], allocs[1], allocs[2], allocs[5]};
+
+    status = mem_del_alloc_batch(pool, batch0, 4);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp0[4] =
+            {
+                    {100, 1},
+                    {200, 0},
+                    {100, 1},
+                    {pool->total_size - 400, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 200, 2, 2);
+
+
+    alloc_pt batch1[2] = {allocs[3], allocs[0]};
+
+    status = mem_del_alloc_batch(pool, batch1, 2);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp1[1] =
+            {
+                    {pool->total_size, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+/*******************************************/
+/***         14. RESET SCENARIOS         ***/
+/*******************************************/
+
+static void test_pool_scenario32(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 32:
+     *
+     * 1. Allocate 6 x 100, deallocate the 2nd and 4th.
+     * 2. Reset. Pool is again one single gap.
+     * 3. Allocate 100. It comes from the start of the pool.
+     * 4. Deallocate it.
+     */
+
+    alloc_pt allocs[6];
+
+    for (unsigned u = 0; u < 6; u ++) {
+        allocs[u] = mem_new_alloc(pool, 100);
+        assert_non_null(allocs[u]);
+    }
+
+    status = mem_del_alloc(pool, allocs[1]);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, allocs[3]);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 400, 4, 3);
+
+
+    status = mem_pool_reset(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+
+
+    alloc_pt alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    assert_ptr_equal(alloc0->mem, pool->mem);
+
+    pool_segment_t exp1[2] =
+            {
+                    {100, 1},
+                    {pool->total_size - 100, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 100, 1, 1);
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+static void test_pool_scenario33(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 33:
+     *
+     * 1. Allocate 3 x 48 by pointer and 1000 by pointer.
+     * 2. Reset. The slab runs are gone with the rest.
+     * 3. Allocate 48 by pointer. It comes from a new run at the
+     *    start of the pool.
+     * 4. Deallocate it.
+     */
+
+    for (unsigned u = 0; u < 3; u ++) {
+        assert_non_null(mem_alloc_ptr(pool, 48));
+    }
+
+    assert_non_null(mem_alloc_ptr(pool, 1000));
+
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 1144, 4, 1);
+
+
+    status = mem_pool_reset(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+
+
+    char *mem = mem_alloc_ptr(pool, 48);
+    assert_ptr_equal(mem, pool->mem);
+
+    status = mem_free_ptr(pool, mem);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+/*******************************************/
+/***     15. ARENA AND STACK SCENARIOS   ***/
+/*******************************************/
+
+static int pool_arena_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = ARENA;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "ARENA");
+    pool = mem_pool_open(POOL_SIZE, POOL_POLICY);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_arena_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario34(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 34:
+     *
+     * 1. ARENA takes no options.
+     * 2. Allocate 100, 40. Each block has a 24-byte header in front
+     *    of the memory, which is aligned to 16 bytes.
+     * 3. Mark, then allocate 1000, 8.
+     * 4. Deallocate the 100. It isn't on top, so the memory stays.
+     * 5. Roll back to the mark. The 1000 and 8 are gone.
+     * 6. Deallocate the 40. The 100 below it goes too, and the pool
+     *    is again one single gap.
+     */
+
+    assert_null(mem_pool_open_flags(POOL_SIZE, ARENA, POOL_SLAB));
+
+    alloc_pt alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    assert_ptr_equal(alloc0->mem, pool->mem + 32);
+    alloc_pt alloc1 = mem_new_alloc(pool, 40);
+    assert_non_null(alloc1);
+    assert_ptr_equal(alloc1->mem, pool->mem + 160);
+
+    const pool_mark_t mark = mem_pool_mark(pool);
+    assert_int_equal(mark, 200);
+
+    alloc_pt alloc2 = mem_new_alloc(pool, 1000);
+    assert_non_null(alloc2);
+    assert_ptr_equal(alloc2->mem, pool->mem + 224);
+    alloc_pt alloc3 = mem_new_alloc(pool, 8);
+    assert_non_null(alloc3);
+    assert_ptr_equal(alloc3->mem, pool->mem + 1248);
+
+    pool_segment_t exp0[5] =
+            {
+                    {132, 1},
+                    {68, 1},
+                    {1024, 1},
+                    {32, 1},
+                    {pool->total_size - 1256, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, ARENA, POOL_SIZE, 1148, 4, 1);
+
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_FAIL);
+
+    pool_segment_t exp1[5] =
+            {
+                    {132, 0},
+                    {68, 1},
+                    {1024, 1},
+                    {32, 1},
+                    {pool->total_size - 1256, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, ARENA, POOL_SIZE, 1048, 3, 1);
+
+
+    status = mem_pool_rollback(pool, mark);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp2[3] =
+            {
+                    {132, 0},
+                    {68, 1},
+                    {pool->total_size - 200, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, ARENA, POOL_SIZE, 40, 1, 1);
+
+
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp3[1] =
+            {
+                    {pool->total_size, 0}
+            };
+    check_pool(pool, exp3);
+    check_metadata(pool, ARENA, POOL_SIZE, 0, 0, 1);
+}
+
+static int pool_stack_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = STACK;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "STACK");
+    pool = mem_pool_open(POOL_SIZE, POOL_POLICY);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_stack_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario35(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 35:
+     *
+     * 1. Allocate 100, 200, 300. The blocks are placed as in ARENA.
+     * 2. Deallocating the 200, which isn't on top, fails.
+     * 3. Deallocate the 300.
+     * 4. Reallocate the 200 to 50, in place. Reallocating the 100 to
+     *    1000 fails, it isn't on top.
+     * 5. Deallocating the 50 and the 200 as a batch fails, but the
+     *    50 and the 100 are the two on top, so that one works. Pool
+     *    is again one single gap.
+     */
+
+    alloc_pt alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    alloc_pt alloc1 = mem_new_alloc(pool, 200);
+    assert_non_null(alloc1);
+    alloc_pt alloc2 = mem_new_alloc(pool, 300);
+    assert_non_null(alloc2);
+
+    pool_segment_t exp0[4] =
+            {
+                    {132, 1},
+                    {228, 1},
+                    {324, 1},
+                    {pool->total_size - 684, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, STACK, POOL_SIZE, 600, 3, 1);
+
+
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_FAIL);
+
+    check_pool(pool, exp0);
+
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp1[3] =
+            {
+                    {132, 1},
+                    {228, 1},
+                    {pool->total_size - 360, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, STACK, POOL_SIZE, 300, 2, 1);
+
+
+    assert_ptr_equal(mem_realloc_alloc(pool, alloc1, 50), alloc1);
+    assert_null(mem_realloc_alloc(pool, alloc0, 1000));
+
+    pool_segment_t exp2[3] =
+            {
+                    {132, 1},
+                    {78, 1},
+                    {pool->total_size - 210, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, STACK, POOL_SIZE, 150, 2, 1);
+
+
+    alloc_pt batch0[2] = {alloc1, alloc1};
+
+    status = mem_del_alloc_batch(pool, batch0, 2);
+    assert_int_equal(status, ALLOC_FAIL);
+
+    check_pool(pool, exp2);
+
+    alloc_pt batch1[2] = {alloc0, alloc1};
+
+    status = mem_del_alloc_batch(pool, batch1, 2);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp3[1] =
+            {
+                    {pool->total_size, 0}
+            };
+    check_pool(pool, exp3);
+    check_metadata(pool, STACK, POOL_SIZE, 0, 0, 1);
+}
+
+/*******************************************/
+/***         16. GROWTH SCENARIOS        ***/
+/*******************************************/
+
+static int pool_grow_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = FIRST_FIT;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s and growth\n",
+         (long) POOL_SIZE, "FIRST_FIT");
+    pool = mem_pool_open_flags(POOL_SIZE, POOL_POLICY, POOL_GROW);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_grow_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario36(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 36:
+     *
+     * 1. Boundary tags and growth don't go together.
+     * 2. Allocate 600000, 600000. The second doesn't fit, so the
+     *    pool grows by its own size, and the gap left at the end
+     *    merges with the new region.
+     * 3. Allocate 3000000. The pool grows by that much.
+     * 4. Allocate 100 MiB. That is more than the pool can grow by
+     *    (64 MiB for a pool this small), so it fails and the pool
+     *    stays as it was.
+     * 5. Deallocate all. Pool is one single gap, of the grown size.
+     */
+
+    assert_null(mem_pool_open_flags(POOL_SIZE, TLSF, POOL_BOUNDARY_TAGS | POOL_GROW));
+
+    alloc_pt alloc0 = mem_new_alloc(pool, 600000);
+    assert_non_null(alloc0);
+    alloc_pt alloc1 = mem_new_alloc(pool, 600000);
+    assert_non_null(alloc1);
+    assert_ptr_equal(alloc1->mem, pool->mem + 600000);
+
+    pool_segment_t exp0[3] =
+            {
+                    {600000, 1},
+                    {600000, 1},
+                    {800000, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, 2 * POOL_SIZE, 1200000, 2, 1);
+
+
+    alloc_pt alloc2 = mem_new_alloc(pool, 3000000);
+    assert_non_null(alloc2);
+    assert_ptr_equal(alloc2->mem, pool->mem + 1200000);
+
+    pool_segment_t exp1[4] =
+            {
+                    {600000, 1},
+                    {600000, 1},
+                    {3000000, 1},
+                    {800000, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, 5 * POOL_SIZE, 4200000, 3, 1);
+
+
+    assert_null(mem_new_alloc(pool, 100 << 20));
+
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, 5 * POOL_SIZE, 4200000, 3, 1);
+
+
+    alloc_pt batch[3] = {alloc0, alloc1, alloc2};
+
+    status = mem_del_alloc_batch(pool, batch, 3);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp2[1] =
+            {
+                    {5 * POOL_SIZE, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, FIRST_FIT, 5 * POOL_SIZE, 0, 0, 1);
+}
+
+/*******************************************/
+/***          17. TRIM SCENARIOS         ***/
+/*******************************************/
+
+static void test_pool_scenario37(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 37:
+     *
+     * 1. Allocate 100, 200000, 100, and fill them.
+     * 2. Deallocate the 200000.
+     * 3. Trim, keeping nothing. The pages inside the gap are released,
+     *    so they read as zeros again, while the segments and the
+     *    contents of the allocations are as they were.
+     * 4. Allocate 200000 again, in the trimmed gap, and fill it.
+     * 5. Trim, keeping more than the gap left. Nothing changes.
+     * 6. Deallocate all.
+     */
+
+    alloc_pt alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    alloc_pt alloc1 = mem_new_alloc(pool, 200000);
+    assert_non_null(alloc1);
+    alloc_pt alloc2 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc2);
+
+    memset(alloc0->mem, 'a', 100);
+    memset(alloc1->mem, 'b', 200000);
+    memset(alloc2->mem, 'c', 100);
+
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+
+
+    status = mem_pool_trim(pool, 0);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp0[4] =
+            {
+                    {100, 1},
+                    {200000, 0},
+                    {100, 1},
+                    {POOL_SIZE - 200200, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 200, 2, 2);
+
+    for (unsigned u = 0; u < 100; u ++) {
+        assert_int_equal(alloc0->mem[u], 'a');
+        assert_int_equal(alloc2->mem[u], 'c');
+    }
+
+    // Whatever the page size (up to 64 KiB), the gap covers whole pages
+    // from here to there
+    const uintptr_t page = 64 << 10;
+    const char *from = (const char *) (((uintptr_t) pool->mem + 100 + page - 1) & ~(page - 1));
+    const char *to = (const char *) (((uintptr_t) pool->mem + 200100) & ~(page - 1));
+
+    assert_true(from < to);
+
+    for (const char *p = from; p < to; ++p) {
+        assert_int_equal(*p, 0);
+    }
+
+    assert_int_equal(pool->mem[100], 'b');
+
+
+    alloc1 = mem_new_alloc(pool, 200000);
+    assert_non_null(alloc1);
+    assert_ptr_equal(alloc1->mem, pool->mem + 100);
+
+    memset(alloc1->mem, 'b', 200000);
+
+    status = mem_pool_trim(pool, POOL_SIZE);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp1[4] =
+            {
+                    {100, 1},
+                    {200000, 1},
+                    {100, 1},
+                    {POOL_SIZE - 200200, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 200200, 3, 1);
+
+    assert_int_equal(alloc1->mem[199999], 'b');
+
+
+    alloc_pt batch[3] = {alloc0, alloc1, alloc2};
+
+    status = mem_del_alloc_batch(pool, batch, 3);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+/*******************************************/
+/***      18. MAPPED POOL SCENARIOS      ***/
+/*******************************************/
+
+static int pool_huge_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = TLSF;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s on huge pages\n",
+         (long) POOL_SIZE, "TLSF");
+    pool = mem_pool_open_flags(POOL_SIZE, POOL_POLICY, POOL_HUGE_PAGES);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_huge_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario38(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 38:
+     *
+     * 1. The pool memory starts on a 2 MiB boundary, whether or not
+     *    the system has huge pages.
+     * 2. Allocate 100, 500000, and fill them.
+     * 3. Deallocate both. Pool is one single gap.
+     */
+
+    assert_int_equal((uintptr_t) pool->mem & ((2 << 20) - 1), 0);
+
+    alloc_pt alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    alloc_pt alloc1 = mem_new_alloc(pool, 500000);
+    assert_non_null(alloc1);
+
+    memset(alloc0->mem, 'a', 100);
+    memset(alloc1->mem, 'b', 500000);
+
+    pool_segment_t exp0[3] =
+            {
+                    {100, 1},
+                    {500000, 1},
+                    {POOL_SIZE - 500100, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, TLSF, POOL_SIZE, 500100, 2, 1);
+
+
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp1[1] =
+            {
+                    {POOL_SIZE, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, TLSF, POOL_SIZE, 0, 0, 1);
+}
+
+static void test_pool_scenario39(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 39:
+     *
+     * 1. The pool wasn't prefaulted, so it took no time. Unknown
+     *    options, and options the policy doesn't take, are turned
+     *    down with prefaulting asked for too.
+     * 2. Open another pool of the same size, prefaulted. That took
+     *    some time, and every page of it is resident right away.
+     * 3. Allocate the whole of the new pool, and fill it.
+     * 4. Deallocate it, and close the new pool.
+     */
+
+    assert_true(mem_pool_prefault_ms(pool) == 0);
+
+    assert_null(mem_pool_open_flags(POOL_SIZE, FIRST_FIT, (1u << 20) | POOL_PREFAULT));
+    assert_null(mem_pool_open_flags(POOL_SIZE, ARENA, POOL_SLAB | POOL_PREFAULT));
+    assert_null(mem_pool_open_flags(POOL_SIZE, TLSF, POOL_GAP_SCAN | POOL_PREFAULT));
+
+    pool_pt prefaulted = mem_pool_open_flags(POOL_SIZE, FIRST_FIT, POOL_PREFAULT);
+    assert_non_null(prefaulted);
+
+    assert_true(mem_pool_prefault_ms(prefaulted) > 0);
+
+    const uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+    char *first = (char *) ((uintptr_t) prefaulted->mem & ~(page - 1));
+    const size_t pages = (size_t) (prefaulted->mem + POOL_SIZE - first + page - 1) / page;
+
+    unsigned char *resident = calloc(pages, 1);
+    assert_non_null(resident);
+
+    assert_int_equal(mincore(first, pages * page, resident), 0);
+
+    for (size_t u = 0; u < pages; ++u) {
+        assert_int_equal(resident[u] & 1, 1);
+    }
+
+    free(resident);
+
+    alloc_pt alloc0 = mem_new_alloc(prefaulted, POOL_SIZE);
+    assert_non_null(alloc0);
+
+    memset(alloc0->mem, 'a', POOL_SIZE);
+
+    check_metadata(prefaulted, FIRST_FIT, POOL_SIZE, POOL_SIZE, 1, 0);
+
+
+    status = mem_del_alloc(prefaulted, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_pool_close(prefaulted);
+    assert_int_equal(status, ALLOC_OK);
+}
+
+/*******************************************/
+/***      19. FILE-BACKED SCENARIOS      ***/
+/*******************************************/
+
+static const char *POOL_FILE = "test_pool_file.dat";
+
+static int pool_file_setup(void **state) {
+    alloc_status status;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s in %s\n",
+         (long) POOL_SIZE, "TLSF", POOL_FILE);
+    remove(POOL_FILE);
+    pool = mem_pool_open_file(POOL_FILE, POOL_SIZE, TLSF);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_file_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    remove(POOL_FILE);
+
+    return 0;
+}
+
+static void test_pool_scenario40(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 40:
+     *
+     * 1. Only TLSF pools can be kept in a file.
+     * 2. Allocate 100, 1000, 10000, and fill them. The 1000 is the
+     *    root of the pool.
+     * 3. Deallocate the 100, and close the pool with the other two
+     *    still allocated.
+     * 4. Open the file again. The segments, the metadata, the root and
+     *    what the allocations hold are what they were.
+     * 5. Deallocate the 1000 and the 10000. Pool is one single gap.
+     */
+
+    assert_null(mem_pool_open_file("test_pool_file_ff.dat", POOL_SIZE, FIRST_FIT));
+    assert_null(mem_pool_root(pool));
+
+    alloc_pt alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    alloc_pt alloc1 = mem_new_alloc(pool, 1000);
+    assert_non_null(alloc1);
+    alloc_pt alloc2 = mem_new_alloc(pool, 10000);
+    assert_non_null(alloc2);
+
+    memset(alloc0->mem, 'a', 100);
+    memset(alloc1->mem, 'b', 1000);
+    memset(alloc2->mem, 'c', 10000);
+
+    status = mem_pool_set_root(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+
+    pool = mem_pool_open_file(POOL_FILE, 0, TLSF);
+    assert_non_null(pool);
+    *state = pool;
+
+    pool_segment_t exp0[4] =
+            {
+                    {144, 0},
+                    {1040, 1},
+                    {10032, 1},
+                    {pool->total_size - 11216, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, TLSF, POOL_SIZE, 11000, 2, 2);
+
+    alloc1 = mem_pool_root(pool);
+    assert_non_null(alloc1);
+    assert_ptr_equal(alloc1->mem, pool->mem + 144 + 32);
+    assert_int_equal(alloc1->size, 1000);
+
+    char *mem2 = pool->mem + 1184 + 32;
+
+    for(unsigned i = 0; i < 1000; ++i) {
+        assert_int_equal(alloc1->mem[i], 'b');
+    }
+
+    for(unsigned i = 0; i < 10000; ++i) {
+        assert_int_equal(mem2[i], 'c');
+    }
+
+
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_free_ptr(pool, mem2);
+    assert_int_equal(status, ALLOC_OK);
+
+    assert_null(mem_pool_root(pool));
+
+    pool_segment_t exp1[1] =
+            {
+                    {pool->total_size, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, TLSF, POOL_SIZE, 0, 0, 1);
+}
+
+static void test_pool_scenario41(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 41:
+     *
+     * 1. The file can't be opened again while the pool is open.
+     * 2. Allocate 1000 and 10000, and fill them. The 1000 is the root
+     *    of the pool. Close the pool.
+     * 3. Map a page where the pool was, and open the file again. The
+     *    pool has moved, and the segments, the metadata, the root and
+     *    what the allocations hold are what they were.
+     * 4. Deallocate the 1000 and the 10000. Pool is one single gap.
+     */
+
+    assert_null(mem_pool_open_file(POOL_FILE, 0, TLSF));
+    check_metadata(pool, TLSF, POOL_SIZE, 0, 0, 1);
+
+    alloc_pt alloc0 = mem_new_alloc(pool, 1000);
+    assert_non_null(alloc0);
+    alloc_pt alloc1 = mem_new_alloc(pool, 10000);
+    assert_non_null(alloc1);
+
+    memset(alloc0->mem, 'b', 1000);
+    memset(alloc1->mem, 'c', 10000);
+
+    status = mem_pool_set_root(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+
+    const uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+    char *old_mem = pool->mem;
+    void *old_page = (void *) ((uintptr_t) old_mem & ~(page - 1));
+
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+
+    void *blocker = mmap(old_page, page, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert_ptr_equal(blocker, old_page);
+
+    pool = mem_pool_open_file(POOL_FILE, 0, TLSF);
+    assert_non_null(pool);
+    *state = pool;
+
+    assert_ptr_not_equal(pool->mem, old_mem);
+
+    pool_segment_t exp0[3] =
+            {
+                    {1040, 1},
+                    {10032, 1},
+                    {pool->total_size - 11072, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, TLSF, POOL_SIZE, 11000, 2, 1);
+
+    alloc0 = mem_pool_root(pool);
+    assert_non_null(alloc0);
+    assert_ptr_equal(alloc0->mem, pool->mem + 32);
+    assert_int_equal(alloc0->size, 1000);
+
+    char *mem1 = pool->mem + 1040 + 32;
+
+    for(unsigned i = 0; i < 1000; ++i) {
+        assert_int_equal(alloc0->mem[i], 'b');
+    }
+
+    for(unsigned i = 0; i < 10000; ++i) {
+        assert_int_equal(mem1[i], 'c');
+    }
+
+    assert_int_equal(munmap(blocker, page), 0);
+
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_free_ptr(pool, mem1);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp1[1] =
+            {
+                    {pool->total_size, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, TLSF, POOL_SIZE, 0, 0, 1);
+}
+
+// Opens the pool file in a child process, allocates 1000 and 10000
+// there, and ends it without closing the pool
+static void pool_file_abandon(void) {
+    int wstatus = 0;
+
+    pid_t pid = fork();
+    assert_true(pid >= 0);
+
+    if (pid == 0) {
+        pool_pt pool = mem_pool_open_file(POOL_FILE, 0, TLSF);
+        if (pool == NULL) {
+            _exit(1);
+        }
+
+        alloc_pt alloc0 = mem_new_alloc(pool, 1000);
+        alloc_pt alloc1 = mem_new_alloc(pool, 10000);
+        if (alloc0 == NULL || alloc1 == NULL) {
+            _exit(1);
+        }
+
+        memset(alloc0->mem, 'b', 1000);
+        memset(alloc1->mem, 'c', 10000);
+
+        _exit(mem_pool_set_root(pool, alloc0) == ALLOC_OK ? 0 : 1);
+    }
+
+    assert_int_equal(waitpid(pid, &wstatus, 0), pid);
+    assert_true(WIFEXITED(wstatus));
+    assert_int_equal(WEXITSTATUS(wstatus), 0);
+}
+
+// Overwrites one byte of the pool file, and returns what was there
+static char pool_file_poke(long offset, char byte) {
+    FILE *file = fopen(POOL_FILE, "r+b");
+    assert_non_null(file);
+
+    assert_int_equal(fseek(file, offset, SEEK_SET), 0);
+    int old = fgetc(file);
+    assert_true(old != EOF);
+
+    assert_int_equal(fseek(file, offset, SEEK_SET), 0);
+    assert_int_equal(fputc(byte, file), byte);
+    assert_int_equal(fclose(file), 0);
+
+    return (char) old;
+}
+
+static void test_pool_scenario42(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 42:
+     *
+     * 1. Close the pool. Another process opens the file, allocates
+     *    1000 and 10000 in it, and ends without closing the pool.
+     * 2. Open the file again. The counters are recounted, and the
+     *    segments, the root and what the allocations hold are what
+     *    the other process left. Close the pool.
+     * 3. A file with a wrong magic number isn't opened. Put the magic
+     *    number back, and it is.
+     * 4. Another process opens the file and ends without closing the
+     *    pool again. Give the first block a size of 0; the file isn't
+     *    opened.
+     * 5. A file of zeros, as a create that was cut short leaves it, is
+     *    a new pool. Allocate 1000 in it, and deallocate it. The pool
+     *    stays open for the teardown.
+     */
+
+    const size_t total_size = pool->total_size;
+
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+    *state = NULL;
+
+    pool_file_abandon();
+
+
+    pool = mem_pool_open_file(POOL_FILE, 0, TLSF);
+    assert_non_null(pool);
+
+    pool_segment_t exp0[3] =
+            {
+                    {1040, 1},
+                    {10032, 1},
+                    {pool->total_size - 11072, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, TLSF, POOL_SIZE, 11000, 2, 1);
+
+    alloc_pt alloc0 = mem_pool_root(pool);
+    assert_non_null(alloc0);
+    assert_ptr_equal(alloc0->mem, pool->mem + 32);
+    assert_int_equal(alloc0->size, 1000);
+
+    char *mem1 = pool->mem + 1040 + 32;
+
+    for(unsigned i = 0; i < 1000; ++i) {
+        assert_int_equal(alloc0->mem[i], 'b');
+    }
+
+    for(unsigned i = 0; i < 10000; ++i) {
+        assert_int_equal(mem1[i], 'c');
+    }
+
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+
+    char magic = pool_file_poke(0, 'X');
+    assert_null(mem_pool_open_file(POOL_FILE, 0, TLSF));
+
+    pool_file_poke(0, magic);
+    pool = mem_pool_open_file(POOL_FILE, 0, TLSF);
+    assert_non_null(pool);
+
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+
+    pool_file_abandon();
+
+    // The first block's size follows its prev_size, past the header (the
+    // pool memory in the file is rounded up to 4 KiB)
+    FILE *file = fopen(POOL_FILE, "rb");
+    assert_non_null(file);
+    assert_int_equal(fseek(file, 0, SEEK_END), 0);
+    const long header_size = ftell(file) - (long) ((total_size + 4095) & ~(size_t) 4095);
+    assert_int_equal(fclose(file), 0);
+
+    for(long i = 0; i < (long) sizeof(size_t); ++i) {
+        pool_file_poke(header_size + (long) sizeof(size_t) + i, 0);
+    }
+
+    assert_null(mem_pool_open_file(POOL_FILE, 0, TLSF));
+
+
+    remove(POOL_FILE);
+
+    file = fopen(POOL_FILE, "wb");
+    assert_non_null(file);
+    assert_int_equal(fseek(file, 3 * 4096 - 1, SEEK_SET), 0);
+    assert_int_equal(fputc(0, file), 0);
+    assert_int_equal(fclose(file), 0);
+
+    pool = mem_pool_open_file(POOL_FILE, POOL_SIZE, TLSF);
+    assert_non_null(pool);
+    *state = pool;
+
+    check_metadata(pool, TLSF, POOL_SIZE, 0, 0, 1);
+    assert_null(mem_pool_root(pool));
+
+    alloc0 = mem_new_alloc(pool, 1000);
+    assert_non_null(alloc0);
+
+    pool_segment_t exp1[2] =
+            {
+                    {1040, 1},
+                    {pool->total_size - 1040, 0}
+            };
+    check_pool(pool, exp1);
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    check_metadata(pool, TLSF, POOL_SIZE, 0, 0, 1);
+}
+
+/*******************************************/
+/***        20. COMPACT SCENARIOS        ***/
+/*******************************************/
+
+static int pool_compact_setup(void **state) {
+    alloc_status status;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "FIRST_FIT (compact)");
+    pool = mem_pool_open_flags(POOL_SIZE, FIRST_FIT, POOL_COMPACT);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_compact_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario43(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 43:
+     *
+     * 1. Compact pools are only FIRST_FIT or BEST_FIT, under 4 GiB,
+     *    and without the options that need full nodes. They hand out
+     *    no allocation records.
+     * 2. Allocate 100, 1000, 100, 500, 100 by pointer.
+     * 3. Deallocate the 1000 and the 500. Deallocating an address
+     *    inside an allocation, or a gap, fails.
+     * 4. Allocate 400 by pointer. It goes in the first gap it fits,
+     *    where the 1000 was.
+     * 5. Open a BEST_FIT compact pool, with the same segments. There
+     *    the 400 goes where the 500 was.
+     * 6. Deallocate all by pointer. Pools are again one single gap.
+     */
+
+    assert_null(mem_pool_open_flags(POOL_SIZE, TLSF, POOL_COMPACT));
+    assert_null(mem_pool_open_flags(POOL_SIZE, NEXT_FIT, POOL_COMPACT));
+    assert_null(mem_pool_open_flags(POOL_SIZE, FIRST_FIT, POOL_COMPACT | POOL_SLAB));
+    assert_null(mem_pool_open_flags(POOL_SIZE, FIRST_FIT, POOL_COMPACT | POOL_GROW));
+
+    if (sizeof(size_t) > 4) {
+        assert_null(mem_pool_open_flags((size_t) UINT32_MAX + 1, FIRST_FIT, POOL_COMPACT));
+    }
+
+    assert_null(mem_new_alloc(pool, 100));
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+
+    pool_pt best = mem_pool_open_flags(POOL_SIZE, BEST_FIT, POOL_COMPACT);
+    assert_non_null(best);
+
+    char *mem[5], *bestMem[5];
+    const size_t sizes[5] = {100, 1000, 100, 500, 100};
+
+    for (unsigned u = 0; u < 5; ++u) {
+        mem[u] = mem_alloc_ptr(pool, sizes[u]);
+        assert_non_null(mem[u]);
+        bestMem[u] = mem_alloc_ptr(best, sizes[u]);
+        assert_non_null(bestMem[u]);
+    }
+
+    assert_ptr_equal(mem[4], pool->mem + 1700);
+
+    pool_segment_t exp0[6] =
+            {
+                    {100, 1},
+                    {1000, 1},
+                    {100, 1},
+                    {500, 1},
+                    {100, 1},
+                    {pool->total_size - 1800, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 1800, 5, 1);
+
+
+    status = mem_free_ptr(pool, mem[1]);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_free_ptr(pool, mem[3]);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_free_ptr(best, bestMem[1]);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_free_ptr(best, bestMem[3]);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free_ptr(pool, mem[2] + 50);
+    assert_int_equal(status, ALLOC_FAIL);
+    status = mem_free_ptr(pool, mem[1]);
+    assert_int_equal(status, ALLOC_FAIL);
+
+    pool_segment_t exp1[6] =
+            {
+                    {100, 1},
+                    {1000, 0},
+                    {100, 1},
+                    {500, 0},
+                    {100, 1},
+                    {pool->total_size - 1800, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 300, 3, 3);
+
+
+    mem[1] = mem_alloc_ptr(pool, 400);
+    assert_ptr_equal(mem[1], pool->mem + 100);
+
+    pool_segment_t exp2[7] =
+            {
+                    {100, 1},
+                    {400, 1},
+                    {600, 0},
+                    {100, 1},
+                    {500, 0},
+                    {100, 1},
+                    {pool->total_size - 1800, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 700, 4, 3);
+
+
+    bestMem[3] = mem_alloc_ptr(best, 400);
+    assert_ptr_equal(bestMem[3], best->mem + 1200);
+
+    pool_segment_t exp3[7] =
+            {
+                    {100, 1},
+                    {1000, 0},
+                    {100, 1},
+                    {400, 1},
+                    {100, 0},
+                    {100, 1},
+                    {best->total_size - 1800, 0}
+            };
+    check_pool(best, exp3);
+    check_metadata(best, BEST_FIT, POOL_SIZE, 700, 4, 3);
+
+
+    const unsigned live[4] = {0, 1, 2, 4};
+    const unsigned bestLive[4] = {0, 2, 3, 4};
+
+    for (unsigned u = 0; u < 4; ++u) {
+        status = mem_free_ptr(pool, mem[live[u]]);
+        assert_int_equal(status, ALLOC_OK);
+        status = mem_free_ptr(best, bestMem[bestLive[u]]);
+        assert_int_equal(status, ALLOC_OK);
+    }
+
+    pool_segment_t exp4[1] =
+            {
+                    {pool->total_size, 0}
+            };
+    check_pool(pool, exp4);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+    check_pool(best, exp4);
+    check_metadata(best, BEST_FIT, POOL_SIZE, 0, 0, 1);
+
+    status = mem_pool_close(best);
+    assert_int_equal(status, ALLOC_OK);
+}
+
+/*******************************************/
+/***         21. STRESS TEST             ***/
+/*******************************************/
+
+void test_pool_stresstest(void **state) {
+    (void) state; /* unused */
+
+    const unsigned num_pools = 200;
+    const unsigned num_allocations = 1000;
+    const unsigned min_alloc_size = 10;
+    const unsigned pool_size =
+            (num_allocations / 2) *
+            (2 * min_alloc_size + (num_allocations - 1) * min_alloc_size);
+    assert_int_equal(pool_size, 5005000);
+
+
+    pool_pt pools[num_pools];
+    alloc_pt allocations[num_pools][num_allocations];
+
+    /*
+     * NOTE: The allocation records are a part of the nodes, so
+     * this only works because the node heap grows by adding
+     * chunks and never moves the nodes it already handed out.
+     */
+
+    /*
+     * Testing dynamic reallocation of pool structures:
+     *
+     * 1. 200 pools of 5005000 each (many pools)
+     * 2. In each pool 1000 allocations of different sizes (many allocations)
+     * 3. In each pool 500 deallocations (many gaps)
+     */
+
+    const clock_t start = clock();
+
+    // initialize store
+    assert_int_equal(mem_init(), ALLOC_OK);
+
+    // allocate pools
+    for (unsigned pix=0; pix < num_pools; ++pix) {
+        // open pool
+        pools[pix] =
+                mem_pool_open(pool_size, (pix % 2) ? FIRST_FIT : BEST_FIT);
+        assert_non_null(pools[pix]);
+        // allocate pool
+        unsigned allocated = 0;
+        for (unsigned aix=0; aix < num_allocations; ++aix) {
+            allocations[pix][aix] =
+                    mem_new_alloc(pools[pix], (aix + 1) * min_alloc_size);
+            allocated += (aix + 1) * min_alloc_size;
+            if (!allocations[pix][aix]) {
+                INFO("ASSERT WILL FAIL at pix = %u, aix = %u, allocated = %u\n", pix, aix, allocated);
+            }
+            assert_non_null(allocations[pix][aix]);
+        }
+        // delete every other allocation
+        for (unsigned aix=0; aix < num_allocations; ++aix) {
+            if (aix % 2) {
+                assert_int_equal(
+                        mem_del_alloc(pools[pix], allocations[pix][aix]),
+                        ALLOC_OK);
+                allocations[pix][aix] = NULL;
+            }
+        }
+    }
+
+    // delete pools
+    for (unsigned pix=0; pix < num_pools; ++pix) {
+        // delete pool's allocations
+        for (unsigned aix=0; aix < num_allocations; ++aix) {
+            if (allocations[pix][aix]) {
+                // delete allocation
+                assert_int_equal(
+                    mem_del_alloc(pools[pix], allocations[pix][aix]),
+                    ALLOC_OK);
+            }
+        }
+        // close pool
+        assert_int_equal(mem_pool_close(pools[pix]), ALLOC_OK);
+    }
+
+    // free store
+    assert_int_equal(mem_free(), ALLOC_OK);
+
+    INFO("Stress test took %.3f s of CPU time\n", (double) (clock() - start) / CLOCKS_PER_SEC);
+}
+
+
+/*******************************************/
+/***        22. DRIVER ROUTINE           ***/
+/*******************************************/
+
+int run_test_suite() {
+    const struct CMUnitTest tests[] = {
+            cmocka_unit_test(test_pool_store_smoketest),
+            cmocka_unit_test(test_pool_smoketest),
+
+            cmocka_unit_test(test_pool_nonempty),
+
+            cmocka_unit_test_setup_teardown(test_pool_ff_metadata, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_bf_metadata, pool_bf_setup, pool_bf_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario00, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario01, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario02, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario03, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario04, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario05, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario06, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario07, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario08, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario09, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario10, pool_ff_setup, pool_ff_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario11, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario12, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario13, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario14, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario15, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario16, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario17, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario18, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario19, pool_bf_setup, pool_bf_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario20, pool_tlsf_setup, pool_tlsf_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario21, pool_buddy_setup, pool_buddy_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario22, pool_slab_setup, pool_slab_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario23, pool_nf_setup, pool_nf_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario24, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario25, pool_slab_setup, pool_slab_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario26, pool_tags_setup, pool_tags_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario27, pool_scan_setup, pool_scan_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario28, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario29, pool_ff_setup, pool_ff_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario30, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario31, pool_ff_setup, pool_ff_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario32, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario33, pool_slab_setup, pool_slab_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario34, pool_arena_setup, pool_arena_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario35, pool_stack_setup, pool_stack_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario36, pool_grow_setup, pool_grow_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario37, pool_ff_setup, pool_ff_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario38, pool_huge_setup, pool_huge_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario39, pool_ff_setup, pool_ff_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario40, pool_file_setup, pool_file_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario41, pool_file_setup, pool_file_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario42, pool_file_setup, pool_file_teardown),
+
+            cmocka_unit_test_setup_teardown(test_pool_scenario43, pool_compact_setup, pool_compact_teardown),
 
-            // do not uncomment until the project is changed to return the allocation address
-//            cmocka_unit_test(test_pool_stresstest),
+            cmocka_unit_test(test_pool_stresstest),
     };
 
     return cmocka_run_group_tests_name("pool_test_suite", tests, NULL, NULL);
 }
 
 /* future editions */
-// TODO stress test: many pools, many allocations, many gaps (requires project refactoring, see NOTE in test body)
 // TODO test memory leaks: any way to do it w/o having to rewrite the source file?
 // TODO fix the final PASSED line of std::cerr output to the end of the file (?)